@@ -0,0 +1,92 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include "interpreter/allocations.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace verona::interpreter
+{
+  static thread_local uint64_t allocations = 0;
+
+  uint64_t heap_allocations()
+  {
+    return allocations;
+  }
+}
+
+// The global operators new and delete are replaced in order to count
+// allocations. Every form which does not take an alignment is replaced, so that
+// memory is never allocated by one implementation and freed by another.
+void* operator new(size_t size)
+{
+  verona::interpreter::allocations++;
+  if (size == 0)
+    size = 1;
+
+  // As the standard operator new does, give the new_handler a chance to free
+  // up memory each time allocation fails.
+  while (true)
+  {
+    void* p = std::malloc(size);
+    if (p != nullptr)
+      return p;
+
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+  try
+  {
+    return operator new(size);
+  }
+  catch (const std::bad_alloc&)
+  {
+    return nullptr;
+  }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+  return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
@@ -0,0 +1,21 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include <cstdint>
+
+namespace verona::interpreter
+{
+  /**
+   * Number of heap allocations made through the global operator new by the
+   * calling thread so far.
+   *
+   * Objects allocated in regions, and the runtime's own allocations, do not go
+   * through operator new and are not counted.
+   *
+   * This is only available when the interpreter is built with
+   * USE_ALLOCATION_STATS, as counting means replacing the global operator new
+   * and delete for the whole program.
+   */
+  uint64_t heap_allocations();
+}
@@ -0,0 +1,163 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include "interpreter/code.h"
+
+#include <fmt/format.h>
+
+namespace verona::interpreter
+{
+  void Code::translate(Function& function)
+  {
+    size_t ip = function.address;
+    FunctionHeader header = function_header(ip);
+    check(ip, header.size);
+
+    function.name = header.name;
+    function.argc = header.argc;
+    function.retc = header.retc;
+    function.locals = header.locals;
+
+    size_t end = ip + header.size;
+
+    // Index in the body of the instruction at each offset, used to resolve
+    // jump targets once the whole body has been decoded.
+    std::unordered_map<size_t, size_t> offsets;
+    std::vector<std::pair<size_t, size_t>> jumps;
+    std::vector<std::pair<size_t, size_t>> prints;
+
+    while (ip < end)
+    {
+      size_t index = function.body.size();
+      offsets[ip] = index;
+
+      Instruction& instruction = function.body.emplace_back();
+      instruction.address = static_cast<CodePtr>(ip);
+      instruction.opcode = opcode(ip);
+
+      switch (instruction.opcode)
+      {
+#define DECODE(NAME) \
+  case Opcode::NAME: \
+    decode<Opcode::NAME>(instruction, ip); \
+    break;
+
+        DECODE(BinOp);
+        DECODE(Clear);
+        DECODE(Copy);
+        DECODE(FulfillSleepingCown);
+        DECODE(Freeze);
+        DECODE(Int64);
+        DECODE(Match);
+        DECODE(Move);
+        DECODE(MutView);
+        DECODE(New);
+        DECODE(NewRegion);
+        DECODE(NewSleepingCown);
+        DECODE(NewCown);
+        DECODE(Return);
+        DECODE(String);
+        DECODE(TraceRegion);
+        DECODE(Unreachable);
+
+#undef DECODE
+
+        case Opcode::Call:
+          decode<Opcode::Call>(instruction, ip);
+          instruction.method_cache = &function.method_caches.emplace_back();
+          break;
+
+        case Opcode::Load:
+          decode<Opcode::Load>(instruction, ip);
+          instruction.field_cache = &function.field_caches.emplace_back();
+          break;
+
+        case Opcode::Store:
+          decode<Opcode::Store>(instruction, ip);
+          instruction.field_cache = &function.field_caches.emplace_back();
+          break;
+
+        case Opcode::Jump:
+        {
+          decode<Opcode::Jump>(instruction, ip);
+          int16_t offset = std::get<0>(instruction.operands<Opcode::Jump>());
+          jumps.push_back({index, instruction.address + offset});
+          break;
+        }
+
+        case Opcode::JumpIf:
+        {
+          decode<Opcode::JumpIf>(instruction, ip);
+          int16_t offset =
+            std::get<1>(instruction.operands<Opcode::JumpIf>());
+          jumps.push_back({index, instruction.address + offset});
+          break;
+        }
+
+        case Opcode::LoadDescriptor:
+        {
+          decode<Opcode::LoadDescriptor>(instruction, ip);
+          get_descriptor(
+            std::get<1>(instruction.operands<Opcode::LoadDescriptor>()));
+          break;
+        }
+
+        case Opcode::Print:
+        {
+          decode<Opcode::Print>(instruction, ip);
+          uint8_t argc = std::get<1>(instruction.operands<Opcode::Print>());
+          prints.push_back({index, function.registers.size()});
+          for (uint8_t i = 0; i < argc; i++)
+          {
+            function.registers.push_back(load<Register>(ip));
+          }
+          break;
+        }
+
+        case Opcode::When:
+        {
+          decode<Opcode::When>(instruction, ip);
+          CodePtr body = std::get<0>(instruction.operands<Opcode::When>());
+          instruction.function = this->function(body);
+          break;
+        }
+
+        default:
+          throw std::logic_error(fmt::format(
+            "Invalid opcode {:#x} at {:#x}",
+            static_cast<int>(instruction.opcode),
+            instruction.address));
+      }
+    }
+
+    if (ip != end)
+    {
+      throw std::logic_error(fmt::format(
+        "Instruction overflows the end of function {}", function.name));
+    }
+
+    offsets[end] = function.body.size();
+    Instruction& last = function.body.emplace_back();
+    last.address = static_cast<CodePtr>(end);
+    last.opcode = Opcode::Unreachable;
+    last.set_operands<Opcode::Unreachable>({});
+
+    // The body doesn't change anymore, so pointers into it are now stable.
+    for (auto [index, target] : jumps)
+    {
+      auto it = offsets.find(target);
+      if (it == offsets.end())
+      {
+        throw std::logic_error(fmt::format(
+          "Invalid jump target {:#x} at {:#x}",
+          target,
+          function.body[index].address));
+      }
+      function.body[index].target = &function.body[it->second];
+    }
+
+    for (auto [index, first] : prints)
+    {
+      function.body[index].registers = function.registers.data() + first;
+    }
+  }
+}
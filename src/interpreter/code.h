@@ -5,8 +5,13 @@
 #include "interpreter/bytecode.h"
 #include "interpreter/object.h"
 
+#include <atomic>
+#include <deque>
 #include <fmt/ostream.h>
+#include <limits>
 #include <optional>
+#include <type_traits>
+#include <unordered_map>
 #include <verona.h>
 
 namespace verona::interpreter
@@ -15,8 +20,185 @@ namespace verona::interpreter
   using bytecode::DescriptorIdx;
   using bytecode::FunctionHeader;
   using bytecode::Opcode;
+  using bytecode::Register;
   using bytecode::SelectorIdx;
 
+  template<typename Operands>
+  struct operand_tuple;
+
+  template<typename... Args>
+  struct operand_tuple<bytecode::OpcodeOperands<Args...>>
+  {
+    using type = std::tuple<Args...>;
+  };
+
+  /**
+   * Tuple of the operands of an opcode, as returned by `Code::load_operands`.
+   */
+  template<Opcode opcode>
+  using OperandTuple = typename operand_tuple<
+    typename bytecode::OpcodeSpec<opcode>::Operands>::type;
+
+  struct Function;
+
+  /**
+   * Inline cache of a Call, Load or Store instruction.
+   *
+   * Maps the descriptors of the receivers seen by the instruction to the result
+   * of looking up its selector in them: the method for a Call, or the field
+   * index for a Load or Store. It holds up to SIZE descriptors, after which
+   * lookups for new ones always miss.
+   *
+   * The code is shared by all the VMs running a program, so entries are
+   * claimed by a CAS on the descriptor, and their value is written only once,
+   * by the VM which claimed it. A VM which finds its descriptor before the
+   * value is written treats it as a miss. Since the result of a lookup only
+   * depends on the descriptor, entries never need to be invalidated.
+   */
+  template<typename T, T EMPTY>
+  struct InlineCache
+  {
+    static constexpr size_t SIZE = 4;
+    static constexpr T Empty = EMPTY;
+
+    struct Entry
+    {
+      std::atomic<const VMDescriptor*> descriptor = nullptr;
+      std::atomic<T> value = EMPTY;
+    };
+
+    Entry entries[SIZE];
+
+    /**
+     * Returns the cached value for `descriptor`, or EMPTY if there is none.
+     */
+    T find(const VMDescriptor* descriptor) const
+    {
+      for (const Entry& entry : entries)
+      {
+        const VMDescriptor* d =
+          entry.descriptor.load(std::memory_order_acquire);
+        if (d == descriptor)
+          return entry.value.load(std::memory_order_acquire);
+        if (d == nullptr)
+          break;
+      }
+      return EMPTY;
+    }
+
+    /**
+     * Adds the value for `descriptor`, if there is room for it.
+     */
+    void insert(const VMDescriptor* descriptor, T value)
+    {
+      for (Entry& entry : entries)
+      {
+        const VMDescriptor* d = nullptr;
+        if (entry.descriptor.compare_exchange_strong(
+              d, descriptor, std::memory_order_acq_rel))
+        {
+          entry.value.store(value, std::memory_order_release);
+          return;
+        }
+
+        if (d == descriptor)
+          return;
+      }
+    }
+  };
+
+  using MethodCache = InlineCache<const Function*, nullptr>;
+  using FieldCache =
+    InlineCache<uint32_t, std::numeric_limits<uint32_t>::max()>;
+
+  /**
+   * An instruction, decoded when the program is loaded.
+   *
+   * Unlike the bytecode, instructions have a fixed size, so the VM can step
+   * through a function's body without decoding anything. The operands are
+   * stored as the tuple returned by `Code::load_operands`, and the operands
+   * which refer to other parts of the program are resolved to pointers.
+   */
+  struct Instruction
+  {
+    static constexpr size_t OPERANDS_SIZE = 24;
+
+    Opcode opcode;
+
+    /**
+     * Offset of the instruction in the bytecode, used for tracing and error
+     * messages.
+     */
+    CodePtr address;
+
+    union
+    {
+      // Target of Jump and JumpIf.
+      const Instruction* target = nullptr;
+      // Body of the When closure.
+      const Function* function;
+      // Registers of the arguments of Print.
+      const Register* registers;
+      // Inline cache of Call.
+      MethodCache* method_cache;
+      // Inline cache of Load and Store.
+      FieldCache* field_cache;
+    };
+
+    template<Opcode opcode>
+    const OperandTuple<opcode>& operands() const
+    {
+      return *reinterpret_cast<const OperandTuple<opcode>*>(&storage);
+    }
+
+    template<Opcode opcode>
+    void set_operands(OperandTuple<opcode> operands)
+    {
+      static_assert(sizeof(OperandTuple<opcode>) <= OPERANDS_SIZE);
+      static_assert(std::is_trivially_destructible_v<OperandTuple<opcode>>);
+      new (&storage) OperandTuple<opcode>(std::move(operands));
+    }
+
+  private:
+    std::aligned_storage_t<OPERANDS_SIZE, alignof(uint64_t)> storage;
+  };
+
+  /**
+   * A function, decoded when the program is loaded.
+   */
+  struct Function
+  {
+    std::string_view name;
+
+    /**
+     * Offset of the function header in the bytecode.
+     */
+    CodePtr address;
+
+    uint8_t argc;
+    uint8_t retc;
+    uint8_t locals;
+
+    /**
+     * The instructions of the function. The last one is an Unreachable
+     * instruction which is not part of the bytecode, so that execution never
+     * runs off the end of the body.
+     */
+    std::vector<Instruction> body;
+
+    /**
+     * Storage for the registers of Print instructions.
+     */
+    std::vector<Register> registers;
+
+    /**
+     * Storage for the inline caches of Call, Load and Store instructions.
+     * These never move, since instructions point to them.
+     */
+    std::deque<MethodCache> method_caches;
+    std::deque<FieldCache> field_caches;
+  };
+
   /**
    * Programs have a few special descriptors and selectors which the VM needs to
    * be aware of. Their value is encoded in the program's header, and is be
@@ -147,8 +329,22 @@ namespace verona::interpreter
       special_descriptors_.main_selector = load<SelectorIdx>(ip);
       special_descriptors_.u64 =
         get_optional_descriptor(load<DescriptorIdx>(ip));
+
+      if (entrypoint() == nullptr)
+        throw std::logic_error("Main class has no main method");
+
+      while (!pending_.empty())
+      {
+        Function* function = pending_.back();
+        pending_.pop_back();
+        translate(*function);
+      }
     }
 
+    // Decoded instructions point into the bytecode and into each other.
+    Code(const Code&) = delete;
+    Code& operator=(const Code&) = delete;
+
     const std::vector<std::unique_ptr<const VMDescriptor>>& descriptors()
     {
       return descriptors_;
@@ -159,7 +355,7 @@ namespace verona::interpreter
       return special_descriptors_;
     }
 
-    size_t entrypoint() const
+    const Function* entrypoint() const
     {
       SelectorIdx selector = special_descriptors_.main_selector;
       return special_descriptors_.main->methods[selector];
@@ -190,6 +386,44 @@ namespace verona::interpreter
 
     SpecialDescriptors special_descriptors_;
 
+    std::unordered_map<CodePtr, std::unique_ptr<Function>> functions_;
+
+    /**
+     * Functions which have been referred to, but not translated yet.
+     */
+    std::vector<Function*> pending_;
+
+    /**
+     * Get the function whose header is at `address`, queueing it for
+     * translation if it hasn't been seen before.
+     */
+    Function* function(CodePtr address)
+    {
+      auto& function = functions_[address];
+      if (function == nullptr)
+      {
+        function = std::make_unique<Function>();
+        function->address = address;
+        pending_.push_back(function.get());
+      }
+      return function.get();
+    }
+
+    /**
+     * Decode the body of `function` into its instructions.
+     *
+     * This uses the same decoder as the rest of the Code class, so malformed
+     * bytecode is rejected when the program is loaded rather than when it is
+     * executed.
+     */
+    void translate(Function& function);
+
+    template<Opcode opcode>
+    void decode(Instruction& instruction, size_t& ip)
+    {
+      instruction.set_operands<opcode>(load_operands<opcode>(ip));
+    }
+
     std::unique_ptr<VMDescriptor> load_descriptor(size_t& ip)
     {
       std::string_view name = str(ip);
@@ -200,14 +434,17 @@ namespace verona::interpreter
       uint32_t finaliser_ip = u32(ip);
 
       auto descriptor = std::make_unique<VMDescriptor>(
-        name, method_slots, field_slots, field_count, finaliser_ip);
+        name, method_slots, field_slots, field_count);
+
+      if (finaliser_ip != 0)
+        descriptor->finaliser = function(finaliser_ip);
 
       for (uint32_t i = 0; i < method_count; i++)
       {
         SelectorIdx index = selector(ip);
         uint32_t offset = u32(ip);
         assert(index < method_slots);
-        descriptor->methods[index] = offset;
+        descriptor->methods[index] = function(offset);
       }
       for (uint32_t i = 0; i < field_count; i++)
       {
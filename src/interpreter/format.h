@@ -45,7 +45,7 @@ struct fmt::formatter<verona::interpreter::Value>
   template<typename FormatContext>
   auto format(const verona::interpreter::Value& value, FormatContext& ctx)
   {
-    return format_value(value.tag, value.inner, ctx.out());
+    return format_value(value.tag(), value.inner(), ctx.out());
   }
 
 private:
@@ -119,7 +119,7 @@ private:
         if (i > 0)
           it = fmt::format_to(it, ", ");
 
-        const verona::interpreter::FieldValue& v = object->fields[i];
+        const verona::interpreter::FieldValue& v = object->fields()[i];
         it = format_value(v.tag, v.inner, it);
       }
       it = fmt::format_to(it, " }}");
@@ -166,3 +166,40 @@ struct fmt::formatter<verona::interpreter::Value::Tag>
     }
   }
 };
+
+template<>
+struct fmt::formatter<verona::interpreter::Value::TagSet>
+{
+  template<typename ParseContext>
+  constexpr auto parse(ParseContext& ctx)
+  {
+    return ctx.begin();
+  }
+
+  template<typename FormatContext>
+  auto format(
+    const verona::interpreter::Value::TagSet& tags, FormatContext& ctx)
+  {
+    using Tag = verona::interpreter::Value::Tag;
+
+    // A single tag is printed on its own, and a set of them in braces.
+    bool braces = tags.size() != 1;
+    auto it = ctx.out();
+    if (braces)
+      it = fmt::format_to(it, "{{");
+
+    const char* separator = "";
+    for (int i = 0; i <= static_cast<int>(Tag::STRING); i++)
+    {
+      Tag tag = static_cast<Tag>(i);
+      if (tags.contains(tag))
+      {
+        it = fmt::format_to(it, "{}{}", separator, tag);
+        separator = ", ";
+      }
+    }
+    if (braces)
+      it = fmt::format_to(it, "}}");
+    return it;
+  }
+};
@@ -4,6 +4,7 @@
 #include "interpreter/vm.h"
 #include "options.h"
 
+#include <chrono>
 #include <iterator>
 #include <verona.h>
 
@@ -28,8 +29,26 @@ namespace verona::interpreter
     EmptyCown() {}
   };
 
-  void
-  instantiate(size_t cores, const Code& code, bool verbose, size_t seed = 1234)
+  void print_cache_stats(
+    std::string_view name, const CacheStats<std::atomic<uint64_t>>& stats)
+  {
+    uint64_t hits = stats.hits;
+    uint64_t total = hits + stats.misses;
+    fmt::print(
+      std::cerr,
+      "{} inline caches: {} hits in {} lookups ({:.2f}%)\n",
+      name,
+      hits,
+      total,
+      (total > 0) ? 100.0 * static_cast<double>(hits) / total : 0.0);
+  }
+
+  void instantiate(
+    size_t cores,
+    const Code& code,
+    bool verbose,
+    bool stats,
+    size_t seed = 1234)
   {
     rt::Scheduler& sched = rt::Scheduler::get();
     sched.init(cores);
@@ -37,7 +56,7 @@ namespace verona::interpreter
     sched.set_seed(seed);
 #endif
 
-    size_t ip = code.entrypoint();
+    const Function* entrypoint = code.entrypoint();
 
     rt::Cown* cown = new EmptyCown();
 
@@ -48,13 +67,44 @@ namespace verona::interpreter
     std::vector<Value> args;
     args.push_back(Value::descriptor(code.special_descriptors().main));
 
-    rt::Cown::schedule<ExecuteMessage>(cown, ip, std::move(args), 0);
+    rt::Cown::schedule<ExecuteMessage>(cown, entrypoint, std::move(args), 0);
 
     rt::Alloc* alloc = rt::ThreadAlloc::get();
     rt::Cown::release(alloc, cown);
 
+    VM::instruction_count = 0;
+#ifdef USE_ALLOCATION_STATS
+    VM::allocation_count = 0;
+#endif
+    VM::method_cache_stats.hits = VM::method_cache_stats.misses = 0;
+    VM::field_cache_stats.hits = VM::field_cache_stats.misses = 0;
+    auto start = std::chrono::steady_clock::now();
+
     sched.run_with_startup<const Code*, bool>(VM::init_vm, &code, verbose);
 
+    if (stats)
+    {
+      std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+      uint64_t count = VM::instruction_count;
+      fmt::print(
+        std::cerr,
+        "Executed {} instructions in {:.3f}s ({:.2f}M instructions/s)\n",
+        count,
+        elapsed.count(),
+        static_cast<double>(count) / elapsed.count() / 1e6);
+#ifdef USE_ALLOCATION_STATS
+      uint64_t allocations = VM::allocation_count;
+      fmt::print(
+        std::cerr,
+        "Made {} heap allocations ({:.4f} per instruction)\n",
+        allocations,
+        (count > 0) ? static_cast<double>(allocations) / count : 0.0);
+#endif
+      print_cache_stats("Call", VM::method_cache_stats);
+      print_cache_stats("Load/Store", VM::field_cache_stats);
+    }
+
     snmalloc::current_alloc_pool()->debug_check_empty();
   }
 
@@ -72,21 +122,28 @@ namespace verona::interpreter
              i++)
         {
           std::cout << "Seed: " << i << std::endl;
-          interpreter::instantiate(options.cores, code, options.verbose, i);
+          interpreter::instantiate(
+            options.cores, code, options.verbose, options.stats, i);
         }
       }
       else
       {
         interpreter::instantiate(
-          options.cores, code, options.verbose, options.run_seed.value());
+          options.cores,
+          code,
+          options.verbose,
+          options.stats,
+          options.run_seed.value());
       }
     }
     else
     {
-      interpreter::instantiate(options.cores, code, options.verbose);
+      interpreter::instantiate(
+        options.cores, code, options.verbose, options.stats);
     }
 #else
-    interpreter::instantiate(options.cores, code, options.verbose);
+    interpreter::instantiate(
+      options.cores, code, options.verbose, options.stats);
 #endif
   }
 }
@@ -12,24 +12,34 @@ namespace verona::interpreter
     std::string_view name,
     size_t method_slots,
     size_t field_slots,
-    size_t field_count,
-    uint32_t finaliser_ip)
+    size_t field_count)
   : name(name),
-    methods(std::make_unique<uint32_t[]>(method_slots)),
+    methods(std::make_unique<const Function*[]>(method_slots)),
     fields(std::make_unique<uint32_t[]>(field_slots)),
-    field_count(field_count),
-    finaliser_ip(finaliser_ip)
+    field_count(field_count)
   {
-    rt::Descriptor::size = sizeof(VMObject);
+    static_assert(sizeof(VMObject) % alignof(FieldValue) == 0);
+    rt::Descriptor::size = sizeof(VMObject) + field_count * sizeof(FieldValue);
     rt::Descriptor::trace = VMObject::trace_fn;
     rt::Descriptor::trace_possibly_iso = VMObject::trace_fn;
     rt::Descriptor::finaliser = VMObject::finaliser_fn;
   }
 
-  VMObject::VMObject(VMObject* region)
-  : fields(std::make_unique<FieldValue[]>(descriptor()->field_count)),
-    parent_(region)
-  {}
+  VMObject::VMObject(VMObject* region) : parent_(region)
+  {
+    for (size_t i = 0; i < descriptor()->field_count; i++)
+    {
+      new (&fields()[i]) FieldValue();
+    }
+  }
+
+  VMObject::~VMObject()
+  {
+    for (size_t i = 0; i < descriptor()->field_count; i++)
+    {
+      fields()[i].~FieldValue();
+    }
+  }
 
   VMObject* VMObject::region()
   {
@@ -51,7 +61,7 @@ namespace verona::interpreter
 
     for (size_t i = 0; i < descriptor->field_count; i++)
     {
-      object->fields[i].trace(stack);
+      object->fields()[i].trace(stack);
     }
   }
 
@@ -9,20 +9,21 @@
 
 namespace verona::interpreter
 {
+  struct Function;
+
   struct VMDescriptor : public rt::Descriptor
   {
     VMDescriptor(
       std::string_view name,
       size_t method_slots,
       size_t field_slots,
-      size_t field_count,
-      uint32_t finaliser_ip);
+      size_t field_count);
 
     const std::string name;
     const size_t field_count;
     std::unique_ptr<uint32_t[]> fields;
-    std::unique_ptr<uint32_t[]> methods;
-    const uint32_t finaliser_ip;
+    std::unique_ptr<const Function*[]> methods;
+    const Function* finaliser = nullptr;
   };
 
   struct VMObject : public rt::Object
@@ -33,8 +34,21 @@ namespace verona::interpreter
      * If the object is in a new region, nullptr should be passed instead.
      */
     explicit VMObject(VMObject* region);
+    ~VMObject();
+
+    /**
+     * The fields of the object are stored inline, right after the VMObject
+     * itself, and are included in the size of its descriptor.
+     */
+    FieldValue* fields()
+    {
+      return reinterpret_cast<FieldValue*>(this + 1);
+    }
 
-    std::unique_ptr<FieldValue[]> fields;
+    const FieldValue* fields() const
+    {
+      return reinterpret_cast<const FieldValue*>(this + 1);
+    }
 
     const VMDescriptor* descriptor() const
     {
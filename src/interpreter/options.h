@@ -10,6 +10,7 @@ namespace verona::interpreter
   {
     uint8_t cores = 4;
     bool verbose = false;
+    bool stats = false;
     bool run = false;
 #ifdef USE_SYSTEMATIC_TESTING
     std::optional<size_t> run_seed;
@@ -33,6 +34,10 @@ namespace verona::interpreter
 
     app.add_option("--" + tag + "cores", options.cores);
     app.add_flag("--" + tag + "verbose", options.verbose);
+    app.add_flag(
+      "--" + tag + "stats",
+      options.stats,
+      "Print execution statistics, such as instructions per second");
 #ifdef USE_SYSTEMATIC_TESTING
     app.add_option("--" + tag + "seed", options.run_seed);
     app.add_option("--" + tag + "seed_upper", options.run_seed_upper);
@@ -7,19 +7,27 @@
 
 namespace verona::interpreter
 {
+  uint64_t Value::encode(Bits bits, const void* pointer)
+  {
+    uint64_t address = reinterpret_cast<uintptr_t>(pointer);
+    assert((address & TAG_MASK) == 0);
+    return address | bits;
+  }
+
   Value Value::u64(uint64_t value)
   {
     Value v;
-    v.tag = U64;
-    v.inner.u64 = value;
+    if ((value >> 63) == 0)
+      v.bits_ = (value << 1) | SMALL_U64_BIT;
+    else
+      v.bits_ = encode(BOXED_U64_BITS, new uint64_t(value));
     return v;
   }
 
   Value Value::string(std::string value)
   {
     Value v;
-    v.tag = STRING;
-    v.inner.string_ptr = new std::string(std::move(value));
+    v.bits_ = encode(STRING_BITS, new std::string(std::move(value)));
     return v;
   }
 
@@ -32,8 +40,7 @@ namespace verona::interpreter
   {
     assert(object->debug_is_iso());
     Value v;
-    v.tag = ISO;
-    v.inner.object = object;
+    v.bits_ = encode(ISO_BITS, object);
     return v;
   }
 
@@ -41,8 +48,7 @@ namespace verona::interpreter
   {
     assert(object->debug_is_iso() || object->debug_is_mutable());
     Value v;
-    v.tag = MUT;
-    v.inner.object = object;
+    v.bits_ = encode(MUT_BITS, object);
     return v;
   }
 
@@ -50,150 +56,214 @@ namespace verona::interpreter
   {
     assert(object->debug_is_immutable());
     Value v;
-    v.tag = IMM;
-    v.inner.object = object;
+    v.bits_ = encode(IMM_BITS, object);
     return v;
   }
 
   Value Value::cown(VMCown* cown)
   {
     Value v;
-    v.tag = COWN;
-    v.inner.cown = cown;
+    v.bits_ = encode(COWN_BITS, cown);
     return v;
   }
 
   Value Value::descriptor(const VMDescriptor* descriptor)
+  {
+    assert(descriptor != nullptr);
+    Value v;
+    v.bits_ = encode(DESCRIPTOR_BITS, descriptor);
+    return v;
+  }
+
+  Value Value::from_inner(Tag tag, Inner inner)
   {
     Value v;
-    v.tag = DESCRIPTOR;
-    v.inner.descriptor = descriptor;
+    switch (tag)
+    {
+      case UNINIT:
+        break;
+
+      case U64:
+        return Value::u64(inner.u64);
+
+      case STRING:
+        v.bits_ = encode(STRING_BITS, inner.string_ptr);
+        break;
+
+      case DESCRIPTOR:
+        return Value::descriptor(inner.descriptor);
+
+      case COWN:
+        return Value::cown(inner.cown);
+
+      case COWN_UNOWNED:
+        v.bits_ = encode(COWN_UNOWNED_BITS, inner.cown);
+        break;
+
+      case ISO:
+        return Value::iso(inner.object);
+
+      case MUT:
+        return Value::mut(inner.object);
+
+      case IMM:
+        return Value::imm(inner.object);
+
+        EXHAUSTIVE_SWITCH
+    }
     return v;
   }
 
-  Value::Value(Value&& other)
+  Value::Inner Value::inner() const
   {
-    this->tag = other.tag;
-    this->inner = other.inner;
-    other.tag = UNINIT;
+    Inner inner;
+    if (bits_ & SMALL_U64_BIT)
+    {
+      inner.u64 = bits_ >> 1;
+      return inner;
+    }
+
+    switch (bits_ & TAG_MASK)
+    {
+      case DESCRIPTOR_BITS:
+        inner.descriptor = pointer<const VMDescriptor>();
+        break;
+
+      case ISO_BITS:
+      case MUT_BITS:
+      case IMM_BITS:
+        inner.object = pointer<VMObject>();
+        break;
+
+      case COWN_BITS:
+      case COWN_UNOWNED_BITS:
+        inner.cown = pointer<VMCown>();
+        break;
+
+      case STRING_BITS:
+        inner.string_ptr = pointer<std::string>();
+        break;
+
+      case BOXED_U64_BITS:
+        inner.u64 = *pointer<uint64_t>();
+        break;
+    }
+    return inner;
   }
 
-  void Value::overwrite(rt::Alloc* alloc, Value&& other)
+  Value::Inner Value::take_inner()
   {
-    std::swap(this->tag, other.tag);
-    std::swap(this->inner, other.inner);
-    other.clear(alloc);
+    Inner inner = this->inner();
+    if ((bits_ & TAG_MASK) == BOXED_U64_BITS)
+      delete pointer<uint64_t>();
+    bits_ = 0;
+    return inner;
   }
 
   Value::~Value()
   {
-    if (tag != UNINIT)
+    if (bits_ != 0)
     {
       std::cerr << "Dropped an initialized Value" << std::endl;
       abort();
     }
   }
 
-  void Value::clear(rt::Alloc* alloc)
+  void Value::release_contents(rt::Alloc* alloc)
   {
-    switch (tag)
+    switch (bits_ & TAG_MASK)
     {
-      case COWN:
-        rt::Cown::release(alloc, inner.cown);
+      case COWN_BITS:
+        rt::Cown::release(alloc, pointer<VMCown>());
         break;
 
-      case ISO:
-        rt::Region::release(alloc, inner.object);
+      case ISO_BITS:
+        rt::Region::release(alloc, pointer<VMObject>());
         break;
 
-      case IMM:
-        rt::Immutable::release(alloc, inner.object);
+      case IMM_BITS:
+        rt::Immutable::release(alloc, pointer<VMObject>());
         break;
 
-      case STRING:
-        delete inner.string_ptr;
+      case STRING_BITS:
+        delete pointer<std::string>();
         break;
 
-      case MUT:
-      case UNINIT:
-      case U64:
-      case DESCRIPTOR:
-      case COWN_UNOWNED:
+      case BOXED_U64_BITS:
+        delete pointer<uint64_t>();
+        break;
+
+      default:
         break;
     }
-    tag = UNINIT;
   }
 
   void Value::consume_cown()
   {
-    switch (tag)
-    {
-      case COWN:
-        tag = COWN_UNOWNED;
-        return;
-      default:
-        abort();
-    }
+    if (tag() != COWN)
+      abort();
+
+    bits_ = (bits_ & ~TAG_MASK) | COWN_UNOWNED_BITS;
   }
 
   void Value::switch_to_cown_body()
   {
-    switch (tag)
-    {
-      case COWN_UNOWNED:
-        tag = MUT;
-        inner.object = inner.cown->contents;
-        return;
-      default:
-        abort();
-    }
+    if (tag() != COWN_UNOWNED)
+      abort();
+
+    bits_ = encode(MUT_BITS, pointer<VMCown>()->contents);
   }
 
   Value Value::maybe_consume()
   {
-    switch (tag)
+    // Values which do not own their contents, such as integers, MUT and
+    // DESCRIPTOR values, are copied as they are.
+    if (!owns_contents())
     {
-      case UNINIT:
-        return Value();
+      if (tag() == COWN_UNOWNED)
+        abort();
 
+      Value v;
+      v.bits_ = bits_;
+      return v;
+    }
+
+    switch (tag())
+    {
       case U64:
-        return Value::u64(inner.u64);
+        return Value::u64(inner().u64);
 
       case STRING:
-        return Value::string(inner.string());
-
-      case DESCRIPTOR:
-        return Value::descriptor(inner.descriptor);
+        return Value::string(inner().string());
 
       case COWN:
-        rt::Cown::acquire(inner.cown);
-        return Value::cown(inner.cown);
-
-      case COWN_UNOWNED:
-        abort();
+        rt::Cown::acquire(pointer<VMCown>());
+        return Value::cown(pointer<VMCown>());
 
       case ISO:
+      {
         // Mark the Value as empty, since we are transferring ownership of the
         // region out of it.
-        tag = UNINIT;
-        return Value::iso(inner.object);
-
-      case MUT:
-        return Value::mut(inner.object);
+        VMObject* object = pointer<VMObject>();
+        bits_ = 0;
+        return Value::iso(object);
+      }
 
       case IMM:
-        rt::Immutable::acquire(inner.object);
-        return Value::imm(inner.object);
+        rt::Immutable::acquire(pointer<VMObject>());
+        return Value::imm(pointer<VMObject>());
 
-        EXHAUSTIVE_SWITCH
+      default:
+        abort();
     }
   }
 
   VMObject* Value::consume_iso()
   {
-    assert(tag == ISO);
-    tag = UNINIT;
-    return inner.object;
+    assert(tag() == ISO);
+    VMObject* object = pointer<VMObject>();
+    bits_ = 0;
+    return object;
   }
 
   Value FieldValue::read(Value::Tag parent)
@@ -253,20 +323,18 @@ namespace verona::interpreter
   Value
   FieldValue::exchange(rt::Alloc* alloc, rt::Object* region, Value&& value)
   {
-    switch (value.tag)
+    switch (value.tag())
     {
       case Value::IMM:
-        assert(value.inner.object->debug_is_immutable());
+        assert(value->object->debug_is_immutable());
         // TODO(region): For now, only allow inserting into trace regions.
         assert(rt::RegionTrace::is_trace_region(rt::Region::get(region)));
-        rt::RegionTrace::insert<rt::YesTransfer>(
-          alloc, region, value.inner.object);
+        rt::RegionTrace::insert<rt::YesTransfer>(alloc, region, value->object);
         break;
       case Value::COWN:
         // TODO(region): For now, only allow inserting into trace regions.
         assert(rt::RegionTrace::is_trace_region(rt::Region::get(region)));
-        rt::RegionTrace::insert<rt::YesTransfer>(
-          alloc, region, value.inner.cown);
+        rt::RegionTrace::insert<rt::YesTransfer>(alloc, region, value->cown);
         break;
       default:
         break;
@@ -276,23 +344,28 @@ namespace verona::interpreter
     {
       case Value::IMM:
         assert(inner.object->debug_is_immutable());
+        rt::RegionTrace::write_barrier(alloc, region, inner.object);
         rt::Immutable::acquire(inner.object);
         break;
 
       case Value::COWN:
+        rt::RegionTrace::write_barrier(alloc, region, inner.cown);
         rt::Cown::acquire(inner.cown);
         break;
 
+      case Value::MUT:
+        rt::RegionTrace::write_barrier(alloc, region, inner.object);
+        break;
+
       default:
         break;
     }
 
-    Value result;
-    result.tag = this->tag;
-    result.inner = this->inner;
-    this->tag = value.tag;
-    this->inner = value.inner;
-    value.tag = Value::UNINIT;
+    Value::Tag new_tag = value.tag();
+    Value::Inner new_inner = value.take_inner();
+    Value result = Value::from_inner(this->tag, this->inner);
+    this->tag = new_tag;
+    this->inner = new_inner;
 
     return result;
   }
@@ -5,6 +5,7 @@
 #include "interpreter/bytecode.h"
 
 #include <fmt/format.h>
+#include <initializer_list>
 #include <verona.h>
 
 namespace verona::interpreter
@@ -23,6 +24,14 @@ namespace verona::interpreter
    * Because releasing ownership may require access to the local allocator, a
    * Value must explicitly be cleared before destruction, by calling
    * `clear(Alloc*)`. Failing to do so will result in an abort.
+   *
+   * A Value is a single 64-bit word:
+   * - 0 is UNINIT.
+   * - An odd word is a U64 below 2^63, shifted left by one bit.
+   * - Otherwise the low bits are a tag on a pointer aligned to
+   *   `rt::Object::ALIGNMENT`, and a zero tag is a DESCRIPTOR.
+   *   Objects and cowns are pointed to directly. Strings, and U64s which are
+   *   too large to be stored inline, are boxed on the heap.
    */
   struct Value
   {
@@ -42,6 +51,45 @@ namespace verona::interpreter
       STRING,
     };
 
+    /**
+     * A set of tags, used to check the type of a Value without allocating.
+     */
+    class TagSet
+    {
+    public:
+      constexpr TagSet(Tag tag) : bits_(bit(tag)) {}
+
+      constexpr TagSet(std::initializer_list<Tag> tags) : bits_(0)
+      {
+        for (Tag tag : tags)
+          bits_ |= bit(tag);
+      }
+
+      constexpr bool contains(Tag tag) const
+      {
+        return (bits_ & bit(tag)) != 0;
+      }
+
+      constexpr size_t size() const
+      {
+        size_t count = 0;
+        for (uint32_t bits = bits_; bits != 0; bits &= bits - 1)
+          count++;
+        return count;
+      }
+
+    private:
+      static constexpr uint32_t bit(Tag tag)
+      {
+        return uint32_t(1) << static_cast<uint32_t>(tag);
+      }
+
+      uint32_t bits_;
+    };
+
+    /**
+     * Contents of a Value, decoded according to its tag.
+     */
     union Inner
     {
       // Used by the ISO, MUT and IMM variants.
@@ -60,12 +108,14 @@ namespace verona::interpreter
       {
         return *string_ptr;
       }
-    };
 
-    Tag tag;
-    Inner inner;
+      const Inner* operator->() const
+      {
+        return this;
+      }
+    };
 
-    Value() : tag(Tag::UNINIT) {}
+    Value() : bits_(0) {}
 
     static Value u64(uint64_t value);
     static Value string(std::string value);
@@ -85,15 +135,33 @@ namespace verona::interpreter
     Value& operator=(const Value&) = delete;
     Value& operator=(Value&& other) = delete;
 
-    Value(Value&& other);
+    Value(Value&& other) : bits_(other.bits_)
+    {
+      other.bits_ = 0;
+    }
+
     ~Value();
 
+    Tag tag() const
+    {
+      if (bits_ == 0)
+        return Tag::UNINIT;
+      return TAGS[bits_ & TAG_MASK];
+    }
+
+    Inner inner() const;
+
     /**
      * Clear the Value, making it UNINIT.
      *
      * It will release any ownership of regions or reference counts it may have.
      */
-    void clear(rt::Alloc* alloc);
+    void clear(rt::Alloc* alloc)
+    {
+      if (owns_contents())
+        release_contents(alloc);
+      bits_ = 0;
+    }
 
     /**
      * Replace the contents of the Value.
@@ -102,7 +170,11 @@ namespace verona::interpreter
      * one. It's essentially a move assignment operator, but with access to the
      * memory allocator.
      */
-    void overwrite(rt::Alloc* alloc, Value&& other);
+    void overwrite(rt::Alloc* alloc, Value&& other)
+    {
+      std::swap(bits_, other.bits_);
+      other.clear(alloc);
+    }
 
     /**
      * Get a copy of this Value, by maybe consuming it.
@@ -136,13 +208,9 @@ namespace verona::interpreter
      */
     void switch_to_cown_body();
 
-    Inner* operator->()
+    Inner operator->() const
     {
-      return &inner;
-    }
-    const Inner* operator->() const
-    {
-      return &inner;
+      return inner();
     }
 
     void trace(rt::ObjectStack* stack) const;
@@ -156,13 +224,83 @@ namespace verona::interpreter
     static constexpr Tag COWN = Tag::COWN;
     static constexpr Tag COWN_UNOWNED = Tag::COWN_UNOWNED;
     static constexpr Tag STRING = Tag::STRING;
+
+  private:
+    friend struct FieldValue;
+
+    /**
+     * Values of the low bits of the word, for each kind of pointer.
+     */
+    enum Bits : uint64_t
+    {
+      DESCRIPTOR_BITS = 0x0,
+      SMALL_U64_BIT = 0x1,
+      ISO_BITS = 0x2,
+      MUT_BITS = 0x4,
+      IMM_BITS = 0x6,
+      COWN_BITS = 0x8,
+      COWN_UNOWNED_BITS = 0xa,
+      STRING_BITS = 0xc,
+      BOXED_U64_BITS = 0xe,
+    };
+
+    static constexpr uint64_t TAG_MASK = 0xf;
+    static_assert(rt::Object::ALIGNMENT > TAG_MASK);
+    static_assert(__STDCPP_DEFAULT_NEW_ALIGNMENT__ > TAG_MASK);
+
+    static constexpr Tag TAGS[TAG_MASK + 1] = {
+      DESCRIPTOR, U64, ISO, U64, MUT, U64, IMM, U64,
+      COWN, U64, COWN_UNOWNED, U64, STRING, U64, U64, U64,
+    };
+
+    /**
+     * Bit `n` is set if a value whose low bits are `n` owns its contents,
+     * and needs to release them when cleared.
+     */
+    static constexpr uint64_t OWNING = (1 << ISO_BITS) | (1 << IMM_BITS) |
+      (1 << COWN_BITS) | (1 << STRING_BITS) | (1 << BOXED_U64_BITS);
+
+    uint64_t bits_;
+
+    static uint64_t encode(Bits bits, const void* pointer);
+
+    /**
+     * Build a Value out of its decoded contents, taking ownership of them.
+     */
+    static Value from_inner(Tag tag, Inner inner);
+
+    /**
+     * Take the contents out of this Value, which becomes UNINIT. Ownership
+     * of the contents goes to the caller.
+     */
+    Inner take_inner();
+
+    bool owns_contents() const
+    {
+      return (OWNING >> (bits_ & TAG_MASK)) & 1;
+    }
+
+    template<typename T>
+    T* pointer() const
+    {
+      return reinterpret_cast<T*>(static_cast<uintptr_t>(bits_ & ~TAG_MASK));
+    }
+
+    void release_contents(rt::Alloc* alloc);
   };
 
+  static_assert(sizeof(Value) == sizeof(uint64_t));
+
   /**
    * Alternative to Value used for fields.
    *
    * Unlike FieldValue, it doesn't directly own a reference count for immutables
    * and cowns, but instead uses the region's remembered set.
+   *
+   * Fields keep their contents decoded, as a tag and a union, rather than in
+   * Value's packed form. `VMDescriptor` does not report where these hold
+   * references, so `rt::RegionTrace::compact` leaves interpreter regions as
+   * they are.
    */
   struct FieldValue
   {
@@ -187,6 +325,8 @@ namespace verona::interpreter
      *
      * `region` should be the region of the object containing this field.
      * If `value` is an immutable, it is added to the region's RememberedSet.
+     * The old contents go through the region's write barrier, so that a
+     * collection of the region in progress does not lose them.
      */
     Value exchange(rt::Alloc* alloc, rt::Object* region, Value&& value);
 
@@ -2,30 +2,33 @@
 // Licensed under the MIT License.
 #include "interpreter/vm.h"
 
+#ifdef USE_ALLOCATION_STATS
+#  include "interpreter/allocations.h"
+#endif
 #include "interpreter/format.h"
 
-#include <fmt/ranges.h>
-
 namespace verona::interpreter
 {
-  void VM::run(std::vector<Value> args, size_t cown_count, size_t start)
+  void
+  VM::run(std::vector<Value> args, size_t cown_count, const Function* function)
   {
-    halt_ = false;
-    start_ip_ = ip_ = start;
+#ifdef USE_ALLOCATION_STATS
+    uint64_t allocations = heap_allocations();
+#endif
 
-    std::string_view name = code_.str(ip_);
+    halt_ = false;
+    current_ = ip_ = function->body.data();
 
     frame_ = Frame::initial();
-    frame_.argc = code_.u8(ip_);
-    frame_.retc = code_.u8(ip_);
-    frame_.locals = code_.u8(ip_);
-    code_.u32(ip_); // size
+    frame_.argc = function->argc;
+    frame_.retc = function->retc;
+    frame_.locals = function->locals;
 
     assert(static_cast<size_t>(frame_.argc) == args.size());
 
     trace(
       "Entering function {}, argc={:d} retc={:d} locals={:d}",
-      name,
+      function->name,
       frame_.argc,
       frame_.retc,
       frame_.locals);
@@ -52,33 +55,47 @@ namespace verona::interpreter
     }
 
     dispatch_loop();
+
+#ifdef USE_ALLOCATION_STATS
+    allocations_ += heap_allocations() - allocations;
+#endif
+    flush_stats();
   }
 
-  void VM::dispatch_loop()
+  void VM::flush_stats()
   {
-    while (!halt_)
-    {
-      start_ip_ = ip_;
-      Opcode op = code_.opcode(ip_);
-      dispatch_opcode(op);
-    }
+    auto flush = [](auto& total, auto& local) {
+      total.hits.fetch_add(local.hits, std::memory_order_relaxed);
+      total.misses.fetch_add(local.misses, std::memory_order_relaxed);
+      local = {};
+    };
+
+    instruction_count.fetch_add(instructions_, std::memory_order_relaxed);
+    instructions_ = 0;
+#ifdef USE_ALLOCATION_STATS
+    allocation_count.fetch_add(allocations_, std::memory_order_relaxed);
+    allocations_ = 0;
+#endif
+    flush(method_cache_stats, method_cache_stats_);
+    flush(field_cache_stats, field_cache_stats_);
   }
 
   void VM::execute_finaliser(VMObject* object)
   {
     const VMDescriptor* descriptor = object->descriptor();
-    uint32_t finaliser_ip = descriptor->finaliser_ip;
-    if (finaliser_ip != 0)
+    const Function* finaliser = descriptor->finaliser;
+    if (finaliser != nullptr)
     {
       auto vm = VM::local_vm;
       vm->trace("Finaliser for: {}", descriptor->name);
 
       auto old_halt = vm->halt_;
+      auto old_current = vm->current_;
       vm->halt_ = false;
 
       // Set up a new frame for finaliser
       vm->write(Register(vm->frame_.locals - 1), Value::mut(object));
-      vm->call(finaliser_ip, (uint8_t)1);
+      vm->call(finaliser, (uint8_t)1);
 
       // Save call stack, so we can jump back into normal execution.
       auto backup = std::move(vm->cfstack_);
@@ -90,6 +107,7 @@ namespace verona::interpreter
       vm->cfstack_ = std::move(backup);
       vm->opcode_return();
       vm->halt_ = old_halt;
+      vm->current_ = old_current;
     }
   }
 
@@ -125,7 +143,7 @@ namespace verona::interpreter
   const VMDescriptor* VM::find_dispatch_descriptor(Register receiver) const
   {
     const Value& value = read(receiver);
-    switch (value.tag)
+    switch (value.tag())
     {
       case Value::MUT:
       case Value::IMM:
@@ -143,21 +161,21 @@ namespace verona::interpreter
     }
   }
 
-  void VM::check_type(const Value& value, Value::Tag expected)
+  void VM::type_error(const Value& value, Value::TagSet expected) const
   {
-    if (value.tag != expected)
+    if (expected.size() == 1)
+    {
       fatal(
-        "Invalid tag {} for value {}, expected {}", value.tag, value, expected);
-  }
-
-  void VM::check_type(const Value& value, std::vector<Value::Tag> expected)
-  {
-    if (
-      std::find(expected.begin(), expected.end(), value.tag) == expected.end())
+        "Invalid tag {} for value {}, expected {}",
+        value.tag(),
+        value,
+        expected);
+    }
+    else
     {
       fatal(
         "Invalid tag {} for value {}, expected one of {}",
-        value.tag,
+        value.tag(),
         value,
         expected);
     }
@@ -224,21 +242,54 @@ namespace verona::interpreter
     const VMDescriptor* descriptor =
       find_dispatch_descriptor(Register(frame_.locals - callspace));
 
-    size_t addr = descriptor->methods[selector];
-    VM::call(addr, callspace);
+    VM::call(lookup_method(descriptor, selector), callspace);
+  }
+
+  const Function*
+  VM::lookup_method(const VMDescriptor* descriptor, SelectorIdx selector)
+  {
+    MethodCache* cache = current_->method_cache;
+    const Function* function = cache->find(descriptor);
+    if (function != nullptr)
+    {
+      method_cache_stats_.hits++;
+      return function;
+    }
+
+    method_cache_stats_.misses++;
+    function = descriptor->methods[selector];
+    if (function == nullptr)
+      fatal("No method {} in {}", selector, descriptor->name);
+
+    cache->insert(descriptor, function);
+    return function;
   }
 
-  void VM::call(size_t addr, uint8_t callspace)
+  size_t VM::lookup_field(const VMDescriptor* descriptor, SelectorIdx selector)
   {
-    FunctionHeader header = code_.function_header(addr);
+    FieldCache* cache = current_->field_cache;
+    uint32_t index = cache->find(descriptor);
+    if (index != FieldCache::Empty)
+    {
+      field_cache_stats_.hits++;
+      return index;
+    }
+
+    field_cache_stats_.misses++;
+    index = descriptor->fields[selector];
+    cache->insert(descriptor, index);
+    return index;
+  }
 
-    if (callspace < header.argc || callspace < header.retc)
+  void VM::call(const Function* function, uint8_t callspace)
+  {
+    if (callspace < function->argc || callspace < function->retc)
     {
       fatal(
         "Call space is too small: callspace={:d}, argc={:d}, retc={:d}",
         callspace,
-        header.argc,
-        header.retc);
+        function->argc,
+        function->retc);
     }
 
     // End of current frame
@@ -247,20 +298,20 @@ namespace verona::interpreter
     cfstack_.push_back(frame_);
     indent_++;
 
-    frame_.argc = header.argc;
-    frame_.retc = header.retc;
-    frame_.locals = header.locals;
+    frame_.argc = function->argc;
+    frame_.retc = function->retc;
+    frame_.locals = function->locals;
     frame_.base = top - callspace;
     frame_.return_address = ip_;
 
     // Ensure the stack is large enough.
     grow_stack(frame_.base + frame_.locals);
 
-    ip_ = addr;
+    ip_ = function->body.data();
 
     trace(
       "Calling function {}, base=r{:d} argc={:d} retc={:d} locals={:d}",
-      header.name,
+      function->name,
       frame_.base,
       frame_.argc,
       frame_.retc,
@@ -306,17 +357,18 @@ namespace verona::interpreter
     write(dst, Value::string(imm));
   }
 
-  void VM::opcode_jump(int16_t offset)
+  void VM::opcode_jump(int16_t)
   {
-    ip_ = start_ip_ + offset;
+    // The target was resolved when the program was loaded.
+    ip_ = current_->target;
   }
 
-  void VM::opcode_jump_if(const Value& src, int16_t offset)
+  void VM::opcode_jump_if(const Value& src, int16_t)
   {
     check_type(src, Value::Tag::U64);
 
     if (src->u64 > 0)
-      ip_ = start_ip_ + offset;
+      ip_ = current_->target;
   }
 
   void VM::opcode_load(Register dst, const Value& base, SelectorIdx selector)
@@ -324,10 +376,9 @@ namespace verona::interpreter
     check_type(base, {Value::Tag::ISO, Value::Tag::MUT, Value::Tag::IMM});
 
     VMObject* object = base->object;
-    const VMDescriptor* descriptor = object->descriptor();
-    size_t index = descriptor->fields[selector];
+    size_t index = lookup_field(object->descriptor(), selector);
 
-    Value value = object->fields[index].read(base.tag);
+    Value value = object->fields()[index].read(base.tag());
     write(dst, std::move(value));
   }
 
@@ -341,7 +392,7 @@ namespace verona::interpreter
     Register dst, const Value& src, const VMDescriptor* descriptor)
   {
     uint64_t result;
-    switch (src.tag)
+    switch (src.tag())
     {
       case Value::UNINIT:
       case Value::U64:
@@ -427,10 +478,14 @@ namespace verona::interpreter
     check_type(src, Value::Tag::STRING);
     std::string_view format = src->string();
 
-    std::vector<const Value*> values;
+    static constexpr uint8_t MAX_ARGS = 5;
+    if (argc > MAX_ARGS)
+      fatal("{} is more arguments than opcode_print can handle", argc);
+
+    const Value* values[MAX_ARGS];
     for (uint8_t i = 0; i < argc; i++)
     {
-      values.push_back(&read(code_.load<Register>(ip_)));
+      values[i] = &read(current_->registers[i]);
     }
 
     // Sadly fmt doesn't have any public API for dynamic sized lists of
@@ -456,8 +511,8 @@ namespace verona::interpreter
         fmt::print(
           format, *values[0], *values[1], *values[2], *values[3], *values[4]);
         break;
-      default:
-        fatal("{} is more arguments than opcode_print can handle", argc);
+
+        EXHAUSTIVE_SWITCH;
     };
   }
 
@@ -468,7 +523,7 @@ namespace verona::interpreter
     for (int i = frame_.retc; i < frame_.locals; i++)
     {
       Value& value = read(Register(i));
-      switch (value.tag)
+      switch (value.tag())
       {
         case Value::UNINIT:
           break;
@@ -512,11 +567,10 @@ namespace verona::interpreter
     check_type(base, {Value::Tag::ISO, Value::Tag::MUT, Value::Tag::IMM});
 
     VMObject* object = base->object;
-    const VMDescriptor* desc = object->descriptor();
-    size_t index = desc->fields[selector];
+    size_t index = lookup_field(object->descriptor(), selector);
 
-    Value old_value =
-      object->fields[index].exchange(alloc_, object->region(), std::move(src));
+    Value old_value = object->fields()[index].exchange(
+      alloc_, object->region(), std::move(src));
     write(dst, std::move(old_value));
   }
 
@@ -529,26 +583,28 @@ namespace verona::interpreter
     if (callspace > frame_.locals)
       fatal("Call space does not fit in current frame");
 
-    size_t entry_addr = closure_body;
-    size_t addr = entry_addr;
-    FunctionHeader header = code_.function_header(addr);
+    // The closure body was resolved when the program was loaded.
+    const Function* function = current_->function;
+    assert(function->address == closure_body);
 
-    if (callspace > header.argc)
+    if (callspace > function->argc)
     {
       fatal(
         "Incorrect ABI for `when`: callspace={:d}, argc={:d}",
         callspace,
-        header.argc);
+        function->argc);
     }
 
     size_t top = frame_.base + frame_.locals;
     Value* values = &stack_[top - callspace + 1];
 
-    // Prepare the cowns and the arguments for the method invocation.
+    // Prepare the cowns and the arguments for the method invocation. The
+    // arguments are handed over to the message, but the list of cowns is only
+    // needed until it is scheduled, so it can reuse the same storage.
     std::vector<Value> args;
-    std::vector<rt::Cown*> cowns;
-    args.reserve(header.argc);
-    cowns.reserve(cown_count);
+    std::vector<rt::Cown*>& cowns = cowns_;
+    args.reserve(function->argc);
+    cowns.clear();
 
     // First argument is a placeholder for the receiver.
     args.push_back(Value());
@@ -578,7 +634,9 @@ namespace verona::interpreter
     }
 
     trace(
-      "Dispatching when to function {}, argc={:d}", header.name, frame_.argc);
+      "Dispatching when to function {}, argc={:d}",
+      function->name,
+      frame_.argc);
 
     // If no cowns create a fake one to run the code on.
     if (cowns.size() == 0)
@@ -587,7 +645,7 @@ namespace verona::interpreter
     }
 
     rt::Cown::schedule<ExecuteMessage, rt::YesTransfer>(
-      cowns.size(), cowns.data(), entry_addr, std::move(args), cown_count);
+      cowns.size(), cowns.data(), function, std::move(args), cown_count);
   }
 
   void VM::opcode_unreachable()
@@ -595,54 +653,134 @@ namespace verona::interpreter
     fatal("Reached unreachable opcode");
   }
 
+#define OPCODES(OP, INVALID) \
+  OP(BinOp, opcode_binop) \
+  OP(Call, opcode_call) \
+  OP(Clear, opcode_clear) \
+  OP(Copy, opcode_copy) \
+  OP(FulfillSleepingCown, opcode_fulfill_sleeping_cown) \
+  OP(Freeze, opcode_freeze) \
+  OP(Int64, opcode_int64) \
+  OP(String, opcode_string) \
+  OP(Jump, opcode_jump) \
+  OP(JumpIf, opcode_jump_if) \
+  OP(Load, opcode_load) \
+  OP(LoadDescriptor, opcode_load_descriptor) \
+  OP(Match, opcode_match) \
+  INVALID(Merge) \
+  OP(Move, opcode_move) \
+  OP(MutView, opcode_mut_view) \
+  OP(New, opcode_new) \
+  OP(NewCown, opcode_new_cown) \
+  OP(NewRegion, opcode_new_region) \
+  OP(NewSleepingCown, opcode_new_sleeping_cown) \
+  OP(Print, opcode_print) \
+  OP(Return, opcode_return) \
+  OP(Store, opcode_store) \
+  OP(TraceRegion, opcode_trace_region) \
+  OP(Unreachable, opcode_unreachable) \
+  OP(When, opcode_when)
+
+  /**
+   * Checks that OPCODES lists every opcode, in the order of their values, so
+   * it can be used to build a table indexed by opcode.
+   */
+  static constexpr bool opcodes_in_order()
+  {
+#define ENTRY(NAME, ...) Opcode::NAME,
+    constexpr Opcode order[] = {OPCODES(ENTRY, ENTRY)};
+#undef ENTRY
+
+    size_t count = sizeof(order) / sizeof(order[0]);
+    if (count != static_cast<size_t>(Opcode::maximum_value) + 1)
+      return false;
+
+    for (size_t i = 0; i < count; i++)
+    {
+      if (static_cast<size_t>(order[i]) != i)
+        return false;
+    }
+    return true;
+  }
+  static_assert(opcodes_in_order());
+
   void VM::dispatch_opcode(Opcode op)
   {
     switch (op)
     {
 #define OP(NAME, FN) \
   case Opcode::NAME: \
-    execute_opcode<Opcode::NAME, &VM::FN>(ip_); \
+    execute_opcode<Opcode::NAME, &VM::FN>(*current_); \
     break;
+#define INVALID(NAME)
 
-      OP(BinOp, opcode_binop);
-      OP(Call, opcode_call);
-      OP(Clear, opcode_clear);
-      OP(Copy, opcode_copy);
-      OP(FulfillSleepingCown, opcode_fulfill_sleeping_cown);
-      OP(Freeze, opcode_freeze);
-      OP(Int64, opcode_int64);
-      OP(Jump, opcode_jump);
-      OP(JumpIf, opcode_jump_if);
-      OP(Load, opcode_load);
-      OP(LoadDescriptor, opcode_load_descriptor);
-      OP(Match, opcode_match);
-      OP(Move, opcode_move);
-      OP(MutView, opcode_mut_view);
-      OP(New, opcode_new);
-      OP(NewRegion, opcode_new_region);
-      OP(NewSleepingCown, opcode_new_sleeping_cown);
-      OP(NewCown, opcode_new_cown);
-      OP(Print, opcode_print);
-      OP(Return, opcode_return);
-      OP(Store, opcode_store);
-      OP(String, opcode_string);
-      OP(TraceRegion, opcode_trace_region);
-      OP(When, opcode_when);
-      OP(Unreachable, opcode_unreachable);
+      OPCODES(OP, INVALID)
 
 #undef OP
+#undef INVALID
 
       default:
         fatal("Invalid opcode {:#x}", static_cast<int>(op));
     }
   }
 
+  void VM::dispatch_loop()
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    // Threaded dispatch, using the "labels as values" extension. Every handler
+    // has its own indirect jump to the next one, which makes the jumps much
+    // easier to predict than a single one in a switch.
+    static void* const handlers[] = {
+#  define OP(NAME, FN) &&handle_##NAME,
+#  define INVALID(NAME) &&invalid,
+      OPCODES(OP, INVALID)
+#  undef OP
+#  undef INVALID
+    };
+
+#  define DISPATCH() \
+    current_ = ip_++; \
+    instructions_++; \
+    goto* handlers[static_cast<size_t>(current_->opcode)];
+
+    if (halt_)
+      return;
+
+    DISPATCH();
+
+#  define OP(NAME, FN) \
+    handle_##NAME : execute_opcode<Opcode::NAME, &VM::FN>(*current_); \
+    if ((Opcode::NAME == Opcode::Return) && halt_) \
+      return; \
+    DISPATCH();
+#  define INVALID(NAME)
+
+    OPCODES(OP, INVALID)
+
+#  undef OP
+#  undef INVALID
+#  undef DISPATCH
+
+  invalid:
+    fatal("Invalid opcode {:#x}", static_cast<int>(current_->opcode));
+#else
+    while (!halt_)
+    {
+      current_ = ip_++;
+      instructions_++;
+      dispatch_opcode(current_->opcode);
+    }
+#endif
+  }
+
+#undef OPCODES
+
   template<Opcode opcode, auto Fn>
-  void VM::execute_opcode(size_t& ip)
+  void VM::execute_opcode(const Instruction& instruction)
   {
     static_assert(std::is_member_function_pointer_v<decltype(Fn)>);
 
-    auto operands = code_.load_operands<opcode>(ip);
+    const auto& operands = instruction.operands<opcode>();
     std::apply(
       [&](const auto&... args) {
         this->trace(bytecode::OpcodeSpec<opcode>::format, args...);
@@ -11,6 +11,16 @@ namespace verona::interpreter
 {
   using bytecode::Register;
 
+  /**
+   * Number of lookups which hit and missed an inline cache.
+   */
+  template<typename Counter>
+  struct CacheStats
+  {
+    Counter hits = 0;
+    Counter misses = 0;
+  };
+
   class VM
   {
   public:
@@ -32,13 +42,14 @@ namespace verona::interpreter
     }
 
     /**
-     * Run the VM from the given address.
+     * Run the VM from the start of the given function.
      *
      * Puts args on the stack.
      *
      * Keeps fetching and executing instructions until the VM halts.
      */
-    void run(std::vector<Value> args, size_t cown_count, size_t start);
+    void
+    run(std::vector<Value> args, size_t cown_count, const Function* function);
 
     /**
      * Run finaliser for this VM object.
@@ -49,6 +60,27 @@ namespace verona::interpreter
      **/
     static void execute_finaliser(VMObject* object);
 
+    /**
+     * Total number of instructions executed by all VMs, updated whenever a VM
+     * finishes running a behaviour.
+     */
+    static inline std::atomic<uint64_t> instruction_count = 0;
+
+#ifdef USE_ALLOCATION_STATS
+    /**
+     * Total number of heap allocations made while running behaviours, updated
+     * along with `instruction_count`.
+     */
+    static inline std::atomic<uint64_t> allocation_count = 0;
+#endif
+
+    /**
+     * Hits and misses of the inline caches of Call, and of Load and Store, by
+     * all VMs. These are updated along with `instruction_count`.
+     */
+    static inline CacheStats<std::atomic<uint64_t>> method_cache_stats;
+    static inline CacheStats<std::atomic<uint64_t>> field_cache_stats;
+
   private:
     void opcode_binop(
       Register dst,
@@ -56,7 +88,7 @@ namespace verona::interpreter
       const Value& left,
       const Value& right);
     void opcode_call(SelectorIdx selector, uint8_t callspace);
-    void call(size_t addr, uint8_t callspace);
+    void call(const Function* function, uint8_t callspace);
     void opcode_clear(Register dst);
     void opcode_copy(Register dst, Value src);
     void opcode_fulfill_sleeping_cown(const Value& cown, Value result);
@@ -93,22 +125,31 @@ namespace verona::interpreter
 
     /**
      * Executes the VMs IP until the it returns from outer most stack frame.
+     *
+     * Where the compiler supports it, each handler jumps directly to the
+     * handler of the next instruction, rather than going back through a
+     * single switch.
      **/
     void dispatch_loop();
 
     /**
-     * Wrapper around opcode handlers. Takes care of parsing and tracing the
-     * operands.
+     * Wrapper around opcode handlers. Takes care of converting and tracing the
+     * operands, which were decoded when the program was loaded.
      *
      * Fn is the actual handler implementation, which will be called with the
      * operands as arguments. It should be a member function pointer of the VM
      * class.
      */
     template<Opcode opcode, auto Fn>
-    void execute_opcode(size_t& ip);
+    void execute_opcode(const Instruction& instruction);
 
     void grow_stack(size_t size);
 
+    /**
+     * Add the statistics of this VM to the totals of all VMs.
+     */
+    void flush_stats();
+
     /**
      * Read the value of a register, relative to the current frame.
      *
@@ -126,12 +167,21 @@ namespace verona::interpreter
 
     const VMDescriptor* find_dispatch_descriptor(Register receiver) const;
 
+    /**
+     * Look up a method or a field of a descriptor, for the current
+     * instruction. The inline cache of the instruction is tried first, and is
+     * updated on a miss.
+     */
+    const Function*
+    lookup_method(const VMDescriptor* descriptor, SelectorIdx selector);
+    size_t lookup_field(const VMDescriptor* descriptor, SelectorIdx selector);
+
     template<typename... Args>
     void trace(std::string_view fmt, Args&&... args) const
     {
       if (verbose_)
       {
-        fmt::print(std::cerr, "[{:4x}]: {:<{}}", start_ip_, "", indent_);
+        fmt::print(std::cerr, "[{:4x}]: {:<{}}", address(), "", indent_);
         fmt::print(std::cerr, fmt, std::forward<Args>(args)...);
         fmt::print(std::cerr, "\n");
       }
@@ -139,14 +189,23 @@ namespace verona::interpreter
 
     template<typename... Args>
     [[noreturn]] void fatal(std::string_view fmt, Args&&... args) const {
-      fmt::print(std::cerr, "[{:4x}]: {:<{}}FATAL: ", start_ip_, "", indent_);
+      fmt::print(std::cerr, "[{:4x}]: {:<{}}FATAL: ", address(), "", indent_);
       fmt::print(std::cerr, fmt, std::forward<Args>(args)...);
       fmt::print(std::cerr, "\n");
       abort();
     }
 
-    void check_type(const Value& value, Value::Tag expected);
-    void check_type(const Value& value, std::vector<Value::Tag> expected);
+    /**
+     * Aborts the VM if the tag of `value` is not one of `expected`.
+     */
+    void check_type(const Value& value, Value::TagSet expected) const
+    {
+      if (!expected.contains(value.tag()))
+        type_error(value, expected);
+    }
+
+    [[noreturn]] void
+    type_error(const Value& value, Value::TagSet expected) const;
 
     const Code& code_;
     rt::Alloc* alloc_;
@@ -155,16 +214,37 @@ namespace verona::interpreter
     /**
      * Instruction Pointer
      */
-    size_t ip_;
+    const Instruction* ip_;
 
     /**
-     * Address of the currently executing instruction.
+     * The currently executing instruction.
      *
-     * After an instruction is parsed, ip_ points to the start of the next
-     * instruction. start_ip_ is used for tracing, and to resolve relative
-     * offsets.
+     * Once an instruction is fetched, ip_ points to the next instruction.
+     * current_ is used for tracing, and to find the resolved operands of the
+     * instruction.
+     */
+    const Instruction* current_ = nullptr;
+
+    /**
+     * Number of instructions executed by this VM, since it was last added to
+     * `instruction_count`.
+     */
+    uint64_t instructions_ = 0;
+
+#ifdef USE_ALLOCATION_STATS
+    /**
+     * Number of heap allocations made by this VM, since it was last added to
+     * `allocation_count`.
      */
-    size_t start_ip_;
+    uint64_t allocations_ = 0;
+#endif
+
+    /**
+     * Hits and misses of inline caches by this VM, since they were last added
+     * to `method_cache_stats` and `field_cache_stats`.
+     */
+    CacheStats<uint64_t> method_cache_stats_;
+    CacheStats<uint64_t> field_cache_stats_;
 
     /**
      * Flag to halt VM execution.
@@ -189,7 +269,7 @@ namespace verona::interpreter
        *
        * This is unused in the lowest frame, as exiting that frame halts the VM.
        */
-      size_t return_address;
+      const Instruction* return_address;
 
       /**
        * Base offset into the value stack.
@@ -211,7 +291,7 @@ namespace verona::interpreter
 
       static Frame initial()
       {
-        return Frame{0, 0, 0, 0, 0};
+        return Frame{nullptr, 0, 0, 0, 0};
       }
     };
 
@@ -228,11 +308,25 @@ namespace verona::interpreter
      */
     std::vector<Frame> cfstack_;
 
+    /**
+     * Cowns of the `when` being dispatched, kept here so that their storage
+     * is reused from one `when` to the next.
+     */
+    std::vector<rt::Cown*> cowns_;
+
     /**
      * Ident level for tracing
      **/
     size_t indent_ = 0;
 
+    /**
+     * Offset in the bytecode of the current instruction, for tracing.
+     */
+    size_t address() const
+    {
+      return (current_ != nullptr) ? current_->address : 0;
+    }
+
     /**
      * Helper type used to convert a single operand.
      *
@@ -343,12 +437,13 @@ namespace verona::interpreter
    */
   class ExecuteMessage : public rt::VAction<ExecuteMessage>
   {
-    size_t start;
+    const Function* start;
     std::vector<Value> args;
     size_t cown_count;
 
   public:
-    ExecuteMessage(size_t start, std::vector<Value> args, size_t cown_count)
+    ExecuteMessage(
+      const Function* start, std::vector<Value> args, size_t cown_count)
     : start(start), args(std::move(args)), cown_count(cown_count)
     {}
 
@@ -42,6 +42,52 @@ namespace verona::rt
       std::is_same_v<std::true_type, decltype(test<A>(nullptr))>;
   };
 
+  template<typename A>
+  struct has_trace_fields
+  {
+  private:
+    template<typename B>
+    static auto test(FieldStack* st)
+      -> decltype(std::declval<B>().trace_fields(st), std::true_type());
+
+    template<typename>
+    static std::false_type test(...);
+
+  public:
+    static constexpr bool value =
+      std::is_same_v<std::true_type, decltype(test<A>(nullptr))>;
+  };
+
+  template<typename A>
+  struct has_batch_policy
+  {
+  private:
+    template<typename B>
+    static auto test(int) -> decltype(B::batch_policy(), std::true_type());
+
+    template<typename>
+    static std::false_type test(...);
+
+  public:
+    static constexpr bool value =
+      std::is_same_v<std::true_type, decltype(test<A>(0))>;
+  };
+
+  template<typename A>
+  struct has_arena_sizes
+  {
+  private:
+    template<typename B>
+    static auto test(int) -> decltype(B::arena_sizes(), std::true_type());
+
+    template<typename>
+    static std::false_type test(...);
+
+  public:
+    static constexpr bool value =
+      std::is_same_v<std::true_type, decltype(test<A>(0))>;
+  };
+
   template<
     class T,
     RegionType region_type = RegionType::Trace,
@@ -74,6 +120,11 @@ namespace verona::rt
       ((T*)o)->notified(o);
     }
 
+    static void gc_trace_fields(Object* o, FieldStack* st)
+    {
+      ((T*)o)->trace_fields(st);
+    }
+
     static void gc_final(Object* o)
     {
       ((T*)o)->~T();
@@ -86,7 +137,8 @@ namespace verona::rt
         gc_trace,
         has_trace_possibly_iso<T>::value ? gc_trace_possibly_iso : nullptr,
         std::is_trivially_destructible_v<T> ? nullptr : gc_final,
-        has_notified<T>::value ? gc_notified : nullptr};
+        has_notified<T>::value ? gc_notified : nullptr,
+        has_trace_fields<T>::value ? gc_trace_fields : nullptr};
 
       return &desc;
     }
@@ -104,28 +156,64 @@ namespace verona::rt
       abort();
     }
 
+    void trace_fields(FieldStack*)
+    {
+      abort();
+    }
+
     static EpochMark get_alloc_epoch()
     {
       return Scheduler::alloc_epoch();
     }
 
+    /**
+     * A cown type can select how its messages are batched by providing
+     *
+     *   static BatchPolicy batch_policy();
+     *
+     * The policy can also be changed per cown with `Cown::set_batch_policy`.
+     **/
+    static BatchPolicy default_batch_policy()
+    {
+      if constexpr (has_batch_policy<T>::value)
+        return T::batch_policy();
+      else
+        return BatchPolicy::fixed();
+    }
+
+    /**
+     * An arena region type can select the sizes of the arenas of the regions
+     * it creates by providing
+     *
+     *   static RegionArena::ArenaSizes arena_sizes();
+     **/
+    static Object* create_region(Alloc* alloc)
+    {
+      if constexpr (
+        region_type == RegionType::Arena && has_arena_sizes<T>::value)
+        return RegionClass::template create<sizeof(T)>(
+          alloc, desc(), T::arena_sizes());
+      else
+        return RegionClass::template create<sizeof(T)>(alloc, desc());
+    }
+
   public:
     void* operator new(size_t)
     {
       if constexpr (std::is_same_v<Base, Object>)
-        return RegionClass::template create<sizeof(T)>(
-          ThreadAlloc::get(), desc());
+        return create_region(ThreadAlloc::get());
       else
         return Cown::alloc<sizeof(T)>(
-          ThreadAlloc::get(), desc(), get_alloc_epoch());
+          ThreadAlloc::get(), desc(), get_alloc_epoch(), default_batch_policy());
     }
 
     void* operator new(size_t, Alloc* alloc)
     {
       if constexpr (std::is_same_v<Base, Object>)
-        return RegionClass::template create<sizeof(T)>(alloc, desc());
+        return create_region(alloc);
       else
-        return Cown::alloc<sizeof(T)>(alloc, desc(), get_alloc_epoch());
+        return Cown::alloc<sizeof(T)>(
+          alloc, desc(), get_alloc_epoch(), default_batch_policy());
     }
 
     void* operator new(size_t, Object* region)
@@ -135,7 +223,7 @@ namespace verona::rt
           ThreadAlloc::get(), region, desc());
       else
         return Cown::alloc<sizeof(T)>(
-          ThreadAlloc::get(), desc(), get_alloc_epoch());
+          ThreadAlloc::get(), desc(), get_alloc_epoch(), default_batch_policy());
     }
 
     void* operator new(size_t, Alloc* alloc, Object* region)
@@ -143,7 +231,53 @@ namespace verona::rt
       if constexpr (std::is_same_v<Base, Object>)
         return RegionClass::template alloc<sizeof(T)>(alloc, region, desc());
       else
-        return Cown::alloc<sizeof(T)>(alloc, desc(), get_alloc_epoch());
+        return Cown::alloc<sizeof(T)>(
+          alloc, desc(), get_alloc_epoch(), default_batch_policy());
+    }
+
+    /**
+     * Allocates and default constructs a `T` in the region represented by
+     * the iso object `region`, unless that would take the region over its
+     * quota, in which case this returns nullptr.  See `Region::try_alloc`.
+     **/
+    static T* try_alloc_in(Alloc* alloc, Object* region, bool collect = false)
+    {
+      static_assert(std::is_same_v<Base, Object>);
+      void* p = Region::try_alloc<sizeof(T)>(alloc, region, desc(), collect);
+
+      if (p == nullptr)
+        return nullptr;
+
+      return ::new (p) T;
+    }
+
+    /**
+     * Stores `value` in `field`, a field of an object in the region
+     * represented by the iso object `region`.  Fields that refer to objects
+     * in a trace region must be overwritten through this while the region
+     * may be collected incrementally.  See `RegionTrace::write_barrier`.
+     **/
+    template<typename F>
+    static void store(Alloc* alloc, Object* region, F*& field, F* value)
+    {
+      static_assert(std::is_base_of_v<Object, F>);
+      if constexpr (region_type == RegionType::Trace)
+      {
+        if (field != nullptr)
+          RegionTrace::write_barrier(alloc, region, field);
+      }
+      else
+      {
+        UNUSED(alloc);
+        UNUSED(region);
+      }
+      field = value;
+    }
+
+    template<typename F>
+    static void store(Object* region, F*& field, F* value)
+    {
+      store(ThreadAlloc::get(), region, field, value);
     }
 
     void operator delete(void*)
@@ -2,8 +2,26 @@
 // Licensed under the MIT License.
 #pragma once
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
 namespace verona::rt
 {
+  /**
+   * Probing scheme of a PtrKeyHashMap.
+   *
+   * RobinHood keeps the distance-to-initial-bucket in the key and shifts
+   * entries on insert, erase and sweep.  Swiss keeps a separate byte of
+   * control data per slot and probes a group of slots at a time, which makes
+   * misses and sweeps of large maps cheaper.
+   */
+  enum class HashMapProbe : uint8_t
+  {
+    RobinHood,
+    Swiss,
+  };
+
   /**
    * Robinhood hashmap from Key(Object*) to Value. The Entry is either Object*,
    * using hashmap as a set, or pair{Object*, Value}.
@@ -12,7 +30,10 @@ namespace verona::rt
    * bits (normally zero due pointer alignment) are used to encode marking
    * status (MARK) and distance-to-initial-bucket (DIB).
    */
-  template<typename Entry, size_t& key_of(Entry*)>
+  template<
+    typename Entry,
+    size_t& key_of(Entry*),
+    HashMapProbe probe = HashMapProbe::RobinHood>
   class PtrKeyHashMap
   {
   private:
@@ -42,14 +63,15 @@ namespace verona::rt
       return (Object*)(p & ~(size_t)DIB_MAX);
     }
 
-    void grow(Alloc* alloc)
+    // Returns true if the set was reallocated.
+    bool grow(Alloc* alloc)
     {
       // Decide if we should grow or not. Grow at 75% capacity.
       size_t size = get_size();
       size_t grow_threshold = (size * 3) / 4;
 
       if (count < grow_threshold)
-        return;
+        return false;
 
       Entry* old_set = set;
       size_t old_size = size;
@@ -69,14 +91,19 @@ namespace verona::rt
           auto& key = key_of(entry);
           if (key != 0)
           {
+            // Growing may happen while marking, so keep the mark.
+            size_t mark = key & MARK;
             key = (size_t)get_unmarked_pointer(key);
-            size_t dummy;
-            insert(alloc, *entry, dummy);
+            size_t location;
+            insert(alloc, *entry, location);
+            key_of(&set[location]) |= mark;
           }
         }
 
-        alloc->dealloc(old_set, old_size * sizeof(size_t*));
+        alloc->dealloc(old_set, old_size * sizeof(Entry));
       }
+
+      return true;
     }
 
     void shrink(Alloc* alloc, size_t marked)
@@ -145,6 +172,31 @@ namespace verona::rt
       set[index] = std::move(entry);
     }
 
+    // Removes the entry at `index`, shifting the following entries back.
+    void remove(size_t index)
+    {
+      auto size = get_size();
+      auto mask = size - 1;
+      auto cur_index = index;
+      set[index].~Entry();
+      auto next_index = (cur_index + 1) & mask;
+
+      size_t key = 0;
+      size_t dib = 0;
+      while ((key = key_of(&set[next_index])) != 0 &&
+             (dib = get_dib(size, next_index, key)) != 0)
+      {
+        key_of(&set[next_index]) = (size_t)get_pointer(key);
+        set_entry(cur_index, set[next_index], dib - 1);
+
+        cur_index = next_index;
+        next_index = (next_index + 1) & mask;
+      }
+
+      key_of(&set[cur_index]) = 0;
+      count--;
+    }
+
     inline size_t get_size()
     {
       return (size_t)1 << size_bits;
@@ -307,7 +359,10 @@ namespace verona::rt
           set_entry(index, entry, dib_entry);
 
           count++;
-          grow(alloc);
+
+          // Growing rehashes every entry, including the one just inserted.
+          if (grow(alloc))
+            location = find(orig_key).get_index();
           return true;
         }
 
@@ -379,101 +434,23 @@ namespace verona::rt
         }
       }
 
-      size_t empty_dib = 0;
-      size_t fill_dib = 0;
-      count = marked;
-
+      // Remove the unmarked entries first, as removing an entry shifts the
+      // following ones back, possibly wrapping around to the end.
       for (size_t index = 0; index < size; index++)
       {
-        auto entry = &set[index];
-        auto& key = key_of(entry);
-
-        if (key == 0)
-        {
-          if (fill_dib > 0)
-          {
-            empty_dib++;
-          }
-          else
-          {
-            empty_dib = 1;
-            fill_dib = 0;
-          }
-        }
-        else if ((key & MARK) != 0)
-        {
-          key = (size_t)get_unmarked_pointer(key);
-          size_t dib = get_dib(size, index, key);
-
-          if (dib == 0)
-          {
-            set[index] = std::move(*entry);
-            empty_dib = 0;
-            fill_dib = 0;
-          }
-          else if (empty_dib == 0)
-          {
-            set_entry(index, *entry, dib);
-            empty_dib = 0;
-            fill_dib = 0;
-          }
-          else
-          {
-            set_entry(
-              index - empty_dib + fill_dib, *entry, dib - empty_dib + fill_dib);
-
-            key_of(&set[index]) = 0;
-            empty_dib++;
-            fill_dib++;
-          }
-        }
-        else
+        size_t key;
+        while (((key = key_of(&set[index])) != 0) && ((key & MARK) == 0))
         {
-          set[index].~Entry();
-
-          key_of(&set[index]) = 0;
-
-          if (fill_dib > 0)
-          {
-            empty_dib++;
-          }
-          else
-          {
-            empty_dib = 1;
-            fill_dib = 0;
-          }
+          remove(index);
         }
       }
 
-      if (empty_dib > 0)
-      {
-        size_t mask = size - 1;
+      assert(count == marked);
 
-        for (size_t index = 0; index < size; index++)
-        {
-          auto entry = &set[index];
-          auto& key = key_of(entry);
-
-          size_t dib = get_dib(size, index, key);
-
-          if (dib > 0)
-          {
-            key = (size_t)get_unmarked_pointer(key);
-
-            set_entry(
-              (index - empty_dib + fill_dib + size) & mask,
-              *entry,
-              dib - empty_dib + fill_dib);
-
-            key_of(&set[index]) = 0;
-            empty_dib++;
-            fill_dib++;
-          }
-          else
-          {
-            break;
-          }
-        }
+      for (size_t index = 0; index < size; index++)
+      {
+        auto& key = key_of(&set[index]);
+        key = key & ~(size_t)MARK;
       }
     }
 
@@ -512,7 +489,7 @@ namespace verona::rt
         {
           // This entry is already present. This should only happen for the
           // original o, not for any swapped pointer.
-          if ((key == orig_key) && (key == (size_t)get_unmarked_pointer(key)))
+          if ((size_t)get_unmarked_pointer(key) == orig_key)
           {
             return {this, index};
           }
@@ -543,25 +520,541 @@ namespace verona::rt
         return;
       }
 
-      auto size = get_size();
-      auto mask = size - 1;
-      auto cur_index = i.get_index();
-      i->~Entry();
-      auto next_index = (cur_index + 1) & mask;
+      remove(i.get_index());
+    }
+  };
 
-      size_t key = 0;
-      size_t dib = 0;
-      while ((key = key_of(&set[next_index])) != 0 &&
-             (dib = get_dib(size, next_index, key)) != 0)
+  /**
+   * SwissTable-style hashmap from Key(Object*) to Value, with the same
+   * interface as the Robinhood hashmap above.
+   *
+   * Each slot has a control byte, kept in an array in front of the entries:
+   * EMPTY, DELETED, or the low 7 bits of the key's hash when the slot is full.
+   * Lookups probe aligned groups of GROUP_SIZE slots, comparing the control
+   * bytes of a whole group at once, and only read the entries whose control
+   * byte matches.  Groups are visited in triangular order, which visits every
+   * group of a power-of-two table.
+   *
+   * The MARK bit is still kept in the key, so entries stay put when marked and
+   * swept.
+   */
+  template<typename Entry, size_t& key_of(Entry*)>
+  class PtrKeyHashMap<Entry, key_of, HashMapProbe::Swiss>
+  {
+  private:
+    using Ctrl = int8_t;
+
+    static constexpr size_t GROUP_SIZE = 16;
+    static constexpr Ctrl EMPTY = -128;
+    static constexpr Ctrl DELETED = -2;
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+    // One group.
+    static constexpr uint8_t INITIAL_SIZE_BITS = 4;
+    static constexpr size_t MARK = 1 << (MIN_ALLOC_BITS - 1);
+    static constexpr size_t POINTER_MASK = ~(((size_t)1 << MIN_ALLOC_BITS) - 1);
+
+    static_assert(~(POINTER_MASK | Object::MASK) == 0);
+    static_assert(((size_t)1 << INITIAL_SIZE_BITS) == GROUP_SIZE);
+    static_assert(alignof(Entry) <= GROUP_SIZE);
+
+    // Number of elements present, and number of DELETED slots.
+    size_t count = 0;
+    size_t deleted = 0;
+
+    // The control bytes, followed by the entries, in one allocation.
+    Ctrl* ctrl = nullptr;
+    Entry* set = nullptr;
+
+    // Compact representation of the allocated size of the set as a bit count.
+    uint8_t size_bits = 0;
+
+    /**
+     * Bitmasks of the slots of a group whose control byte satisfies a query.
+     */
+    class Group
+    {
+    private:
+#if defined(__SSE2__)
+      __m128i bytes;
+
+    public:
+      explicit Group(const Ctrl* p)
+      : bytes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)))
+      {}
+
+      uint32_t match(Ctrl c) const
       {
-        set_entry(cur_index, set[next_index], dib - 1);
+        return (uint32_t)_mm_movemask_epi8(
+          _mm_cmpeq_epi8(_mm_set1_epi8(c), bytes));
+      }
 
-        cur_index = next_index;
-        next_index = (next_index + 1) & mask;
+      // EMPTY and DELETED are the only control bytes with the top bit set.
+      uint32_t match_free() const
+      {
+        return (uint32_t)_mm_movemask_epi8(bytes);
       }
+#else
+      const Ctrl* bytes;
 
-      key_of(&set[cur_index]) = 0;
+    public:
+      explicit Group(const Ctrl* p) : bytes(p) {}
+
+      uint32_t match(Ctrl c) const
+      {
+        uint32_t m = 0;
+        for (size_t i = 0; i < GROUP_SIZE; i++)
+          m |= (uint32_t)(bytes[i] == c) << i;
+        return m;
+      }
+
+      uint32_t match_free() const
+      {
+        uint32_t m = 0;
+        for (size_t i = 0; i < GROUP_SIZE; i++)
+          m |= (uint32_t)(bytes[i] < 0) << i;
+        return m;
+      }
+#endif
+
+      uint32_t match_empty() const
+      {
+        return match(EMPTY);
+      }
+    };
+
+    static inline size_t next_bit(uint32_t& m)
+    {
+      size_t i = snmalloc::bits::ctz(m);
+      m &= m - 1;
+      return i;
+    }
+
+    static inline size_t hash(size_t key)
+    {
+      return verona::rt::bits::hash((void*)key);
+    }
+
+    static inline Ctrl h2(size_t h)
+    {
+      return (Ctrl)(h & 0x7f);
+    }
+
+    inline size_t get_size()
+    {
+      return (size_t)1 << size_bits;
+    }
+
+    inline size_t group_mask()
+    {
+      return (get_size() / GROUP_SIZE) - 1;
+    }
+
+    static inline size_t alloc_size(uint8_t bits)
+    {
+      return ((size_t)1 << bits) * (sizeof(Ctrl) + sizeof(Entry));
+    }
+
+    inline bool is_full(size_t index)
+    {
+      return ctrl[index] >= 0;
+    }
+
+    size_t find_index(size_t orig_key)
+    {
+      size_t h = hash(orig_key);
+      Ctrl c = h2(h);
+      size_t mask = group_mask();
+      size_t g = (h >> 7) & mask;
+
+      // There is always an EMPTY slot, so this terminates.
+      for (size_t step = 1;; step++)
+      {
+        Group group(&ctrl[g * GROUP_SIZE]);
+
+        for (uint32_t m = group.match(c); m != 0;)
+        {
+          size_t index = g * GROUP_SIZE + next_bit(m);
+          if ((size_t)get_unmarked_pointer(key_of(&set[index])) == orig_key)
+            return index;
+        }
+
+        if (group.match_empty() != 0)
+          return NOT_FOUND;
+
+        g = (g + step) & mask;
+      }
+    }
+
+    // Returns the first EMPTY or DELETED slot on the probe sequence of `h`.
+    size_t find_free(size_t h)
+    {
+      size_t mask = group_mask();
+      size_t g = (h >> 7) & mask;
+
+      for (size_t step = 1;; step++)
+      {
+        uint32_t m = Group(&ctrl[g * GROUP_SIZE]).match_free();
+        if (m != 0)
+          return g * GROUP_SIZE + next_bit(m);
+
+        g = (g + step) & mask;
+      }
+    }
+
+    // Moves `entry` into a free slot, keeping its mark, and returns the slot.
+    size_t place(Entry& entry)
+    {
+      size_t key = key_of(&entry);
+      size_t h = hash((size_t)get_unmarked_pointer(key));
+      size_t index = find_free(h);
+
+      if (ctrl[index] == DELETED)
+        deleted--;
+
+      ctrl[index] = h2(h);
+      new (&set[index]) Entry(std::move(entry));
+      count++;
+      return index;
+    }
+
+    /**
+     * Reallocates the set with 2^`bits` slots.  If `sweep` is true, only the
+     * marked entries are kept, and they are unmarked; otherwise every entry
+     * is kept as it is.
+     */
+    void resize(Alloc* alloc, uint8_t bits, bool sweep)
+    {
+      Ctrl* old_ctrl = ctrl;
+      Entry* old_set = set;
+      uint8_t old_bits = size_bits;
+
+      size_bits = bits;
+      count = 0;
+      deleted = 0;
+      size_t size = get_size();
+      ctrl = (Ctrl*)alloc->alloc(alloc_size(bits));
+      set = (Entry*)(ctrl + size);
+      memset(ctrl, (uint8_t)EMPTY, size);
+
+      if (old_bits == 0)
+        return;
+
+      size_t old_size = (size_t)1 << old_bits;
+      for (size_t index = 0; index < old_size; index++)
+      {
+        if (old_ctrl[index] < 0)
+          continue;
+
+        auto entry = &old_set[index];
+        auto& key = key_of(entry);
+
+        if (sweep)
+        {
+          if ((key & MARK) == 0)
+          {
+            entry->~Entry();
+            continue;
+          }
+          key = (size_t)get_unmarked_pointer(key);
+        }
+
+        place(*entry);
+        entry->~Entry();
+      }
+
+      alloc->dealloc(old_ctrl, alloc_size(old_bits));
+    }
+
+    // Makes room for one more entry, keeping at least one EMPTY slot.
+    void reserve(Alloc* alloc)
+    {
+      if (size_bits == 0)
+      {
+        resize(alloc, INITIAL_SIZE_BITS, false);
+        return;
+      }
+
+      size_t size = get_size();
+      if ((count + deleted + 1) * 8 <= size * 7)
+        return;
+
+      // Mostly tombstones: rehash in place rather than grow.
+      if ((count + 1) * 16 <= size * 7)
+        resize(alloc, size_bits, false);
+      else
+        resize(alloc, (uint8_t)(size_bits + 1), false);
+    }
+
+    // Empties slot `index`, which must be full.
+    void remove(size_t index)
+    {
+      // No probe sequence has gone past a group with an EMPTY slot, so the
+      // slot can become EMPTY rather than DELETED.
+      size_t g = index & ~(GROUP_SIZE - 1);
+      if (Group(&ctrl[g]).match_empty() != 0)
+      {
+        ctrl[index] = EMPTY;
+      }
+      else
+      {
+        ctrl[index] = DELETED;
+        deleted++;
+      }
+      set[index].~Entry();
       count--;
     }
+
+    /**
+     * This iterator enables range-based for-loop, traversing each non-empty
+     * Entry in the map.
+     */
+    class Iterator
+    {
+    private:
+      PtrKeyHashMap* map;
+      size_t i;
+
+    public:
+      Iterator(PtrKeyHashMap* map_, size_t i_) : map{map_}, i{i_} {}
+
+      Entry& operator*()
+      {
+        return map->set[i];
+      }
+
+      Entry* operator->()
+      {
+        return &map->set[i];
+      }
+
+      Iterator& operator++()
+      {
+        assert(map->count > 0);
+
+        auto size = map->get_size();
+        while (true)
+        {
+          i++;
+          if (i == size)
+            break;
+          if (map->is_full(i))
+            break;
+        }
+
+        return *this;
+      }
+
+      size_t get_index()
+      {
+        return i;
+      }
+
+      bool operator!=(const Iterator& it) const
+      {
+        return i != it.i;
+      }
+
+      bool operator==(const Iterator& it) const
+      {
+        return i == it.i;
+      }
+    };
+
+  public:
+    static PtrKeyHashMap* create()
+    {
+      auto r = ThreadAlloc::get()->alloc<sizeof(PtrKeyHashMap)>();
+      return new (r) PtrKeyHashMap();
+    }
+
+    static Object* get_unmarked_pointer(size_t p)
+    {
+      assert(p != 0);
+      // The Object* returned has no mark bit.
+      return (Object*)(p & POINTER_MASK);
+    }
+
+    Iterator begin()
+    {
+      Iterator i{this, 0};
+      if (count == 0)
+      {
+        return i;
+      }
+      if (is_full(0))
+      {
+        return i;
+      }
+      ++i;
+      return i;
+    }
+
+    Iterator end()
+    {
+      if (count == 0)
+      {
+        return {this, 0};
+      }
+      size_t size = get_size();
+      return {this, size};
+    }
+
+    void mark_slot(size_t index, size_t& marked)
+    {
+      assert(index < get_size());
+      assert(is_full(index));
+      auto& key = key_of(&set[index]);
+
+      if ((key & MARK) == 0)
+      {
+        key = key | MARK;
+        marked++;
+      }
+    }
+
+    template<bool require_destructor = true>
+    inline void dealloc(Alloc* alloc)
+    {
+      if (size_bits > 0)
+      {
+        if (require_destructor)
+        {
+          auto size = get_size();
+          for (size_t i = 0; i < size; ++i)
+          {
+            if (is_full(i))
+            {
+              set[i].~Entry();
+            }
+          }
+        }
+        alloc->dealloc(ctrl, alloc_size(size_bits));
+      }
+    }
+
+    // Returns true if newly added, false if previously present.
+    bool insert(Alloc* alloc, Entry& entry, size_t& location)
+    {
+      auto orig_key = key_of(&entry);
+      assert(orig_key == (size_t)get_unmarked_pointer(orig_key));
+
+      if (count > 0)
+      {
+        size_t index = find_index(orig_key);
+        if (index != NOT_FOUND)
+        {
+          location = index;
+          return false;
+        }
+      }
+
+      // Make room first, so that `location` is not invalidated.
+      reserve(alloc);
+      location = place(entry);
+      return true;
+    }
+
+    void insert_unique(Alloc* alloc, Entry& entry)
+    {
+      size_t dummy;
+      auto unique = insert(alloc, entry, dummy);
+      assert(unique);
+      UNUSED(unique);
+    }
+
+    void sweep_set(Alloc* alloc, size_t marked)
+    {
+      if (size_bits == 0)
+        return;
+
+      size_t size = get_size();
+
+      // If our marked object count is low, build a new set instead.
+      if (size_bits > INITIAL_SIZE_BITS && marked <= (size >> 3))
+      {
+        // Pick a size that can hold twice the marked count.
+        uint8_t bits = marked > (GROUP_SIZE / 2) ?
+          (uint8_t)snmalloc::bits::next_pow2_bits(marked << 1) :
+          INITIAL_SIZE_BITS;
+        resize(alloc, bits, true);
+        return;
+      }
+
+      for (size_t g = 0; g < size; g += GROUP_SIZE)
+      {
+        Group group(&ctrl[g]);
+        bool has_empty = group.match_empty() != 0;
+
+        for (size_t index = g; index < g + GROUP_SIZE; index++)
+        {
+          if (ctrl[index] == DELETED)
+          {
+            // See `remove`.
+            if (has_empty)
+            {
+              ctrl[index] = EMPTY;
+              deleted--;
+            }
+            continue;
+          }
+
+          if (ctrl[index] < 0)
+            continue;
+
+          auto& key = key_of(&set[index]);
+          if ((key & MARK) != 0)
+          {
+            key = (size_t)get_unmarked_pointer(key);
+          }
+          else
+          {
+            set[index].~Entry();
+            ctrl[index] = has_empty ? EMPTY : DELETED;
+            deleted += has_empty ? 0 : 1;
+            count--;
+          }
+        }
+      }
+
+      assert(count == marked);
+    }
+
+    void clear(Alloc* alloc)
+    {
+      sweep_set(alloc, 0);
+    }
+
+    Iterator find(size_t orig_key)
+    {
+      if (count == 0)
+      {
+        return end();
+      }
+
+      assert(orig_key == (size_t)get_unmarked_pointer(orig_key));
+
+      size_t index = find_index(orig_key);
+      if (index == NOT_FOUND)
+        return end();
+
+      return {this, index};
+    }
+
+    void erase(void* p)
+    {
+      if (count == 0)
+      {
+        return;
+      }
+
+      size_t index = find_index((size_t)p);
+      if (index == NOT_FOUND)
+      {
+        return;
+      }
+
+      remove(index);
+    }
   };
 } // namespace verona::rt
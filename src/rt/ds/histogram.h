@@ -0,0 +1,150 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <snmalloc.h>
+
+namespace verona::rt
+{
+  using namespace snmalloc;
+
+  /**
+   * A histogram with log-linear buckets.  Values below 2^SUB_BITS each have
+   * their own bucket.  Above that, every power of two range is split into
+   * 2^SUB_BITS equal buckets, so the relative error of a bucket is at most
+   * 2^-SUB_BITS.  Values of 2^MAGNITUDES or more all go in the last bucket.
+   *
+   * With SUB_BITS of zero there is one bucket per power of two, which is
+   * enough for timings where only the order of magnitude is of interest.
+   *
+   * A histogram has a single writer, but may be read by any thread while it
+   * is being updated, for instance to take a snapshot of a running system.
+   * Such a reader sees every bucket at some point between two updates, but
+   * not necessarily all of them at the same point.
+   **/
+  template<size_t SUB_BITS = 0, size_t MAGNITUDES = 32>
+  class LogLinearHistogram
+  {
+    static_assert(SUB_BITS < MAGNITUDES);
+    static_assert(MAGNITUDES <= snmalloc::bits::BITS);
+
+  public:
+    static constexpr size_t BUCKETS = (MAGNITUDES - SUB_BITS + 1) << SUB_BITS;
+
+  private:
+    static constexpr size_t SUB_MASK = ((size_t)1 << SUB_BITS) - 1;
+
+    std::atomic<size_t> counts[BUCKETS] = {};
+    std::atomic<uint64_t> max_value = 0;
+
+    static void bump(std::atomic<size_t>& c, size_t n)
+    {
+      c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+  public:
+    static size_t bucket(uint64_t v)
+    {
+      if (v <= SUB_MASK)
+        return (size_t)v;
+
+      size_t m = snmalloc::bits::BITS - 1 - snmalloc::bits::clz((size_t)v);
+      if (m >= MAGNITUDES)
+        return BUCKETS - 1;
+
+      size_t shift = m - SUB_BITS;
+      return ((shift + 1) << SUB_BITS) | (((size_t)v >> shift) & SUB_MASK);
+    }
+
+    /**
+     * The smallest value that goes in bucket `b`.
+     **/
+    static uint64_t lower_bound(size_t b)
+    {
+      if (b <= SUB_MASK)
+        return b;
+
+      size_t shift = (b >> SUB_BITS) - 1;
+      return (uint64_t)((SUB_MASK + 1) | (b & SUB_MASK)) << shift;
+    }
+
+    void add(uint64_t v)
+    {
+      bump(counts[bucket(v)], 1);
+      if (v > max_value.load(std::memory_order_relaxed))
+        max_value.store(v, std::memory_order_relaxed);
+    }
+
+    void add(const LogLinearHistogram& that)
+    {
+      for (size_t i = 0; i < BUCKETS; i++)
+        bump(counts[i], that.counts[i].load(std::memory_order_relaxed));
+
+      uint64_t m = that.max_value.load(std::memory_order_relaxed);
+      if (m > max_value.load(std::memory_order_relaxed))
+        max_value.store(m, std::memory_order_relaxed);
+    }
+
+    size_t count() const
+    {
+      size_t total = 0;
+      for (size_t i = 0; i < BUCKETS; i++)
+        total += counts[i].load(std::memory_order_relaxed);
+      return total;
+    }
+
+    size_t count(size_t b) const
+    {
+      return counts[b].load(std::memory_order_relaxed);
+    }
+
+    uint64_t max() const
+    {
+      return max_value.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns an upper bound on the value below which a fraction `q` of the
+     * values fall.
+     **/
+    uint64_t quantile(double q) const
+    {
+      size_t total = count();
+      if (total == 0)
+        return 0;
+
+      size_t target = (size_t)(q * (double)total);
+      size_t seen = 0;
+
+      for (size_t i = 0; i < BUCKETS - 1; i++)
+      {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen > target)
+          return std::min(lower_bound(i + 1) - 1, max());
+      }
+
+      return max();
+    }
+
+    /**
+     * Writes a CSV row with `name`, the number of values, the maximum, and
+     * the count in each bucket.
+     **/
+    void print(CSVStream& csv, const char* name, uint64_t dumpid) const
+    {
+      csv << name << dumpid << count() << max();
+      for (size_t i = 0; i < BUCKETS; i++)
+        csv << counts[i].load(std::memory_order_relaxed);
+      csv << csv.endl;
+    }
+  };
+
+  /**
+   * A histogram with one bucket per power of two.  Bucket `i` holds the
+   * values in [2^(i-1), 2^i), except for bucket 0, which holds zero.
+   **/
+  template<size_t MAGNITUDES = 32>
+  using Log2Histogram = LogLinearHistogram<0, MAGNITUDES>;
+} // namespace verona::rt
@@ -181,7 +181,8 @@ namespace verona::rt
      * If it returns a message, will delete the previous message.
      *
      * Messages are deallocated after the next message is dequeued. This ensures
-     * that there is always a message in the queue.
+     * that there is always a message in the queue. Deallocation is delegated
+     * to `T::dealloc`, as messages need not be individual allocations.
      **/
     T* dequeue(snmalloc::Alloc* alloc, bool& notify)
     {
@@ -202,7 +203,7 @@ namespace verona::rt
       assert(front);
       std::atomic_thread_fence(std::memory_order_acquire);
 
-      alloc->dealloc(fnt, fnt->size());
+      fnt->dealloc(alloc);
       invariant();
 
       if (has_state(next, NOTIFY))
@@ -214,6 +215,30 @@ namespace verona::rt
       return next;
     }
 
+    /**
+     * Counts the elements in the queue up to and including `until`, which
+     * must have come from `peek_back`, stopping after `limit`.  Elements
+     * whose enqueue has not finished linking them in are not counted.  Only
+     * safe to use in the consumer.
+     **/
+    size_t length(T* until, size_t limit)
+    {
+      size_t n = 0;
+      T* curr = front;
+
+      while ((curr != until) && (n < limit))
+      {
+        curr = clear_state(curr->next.load(std::memory_order_relaxed));
+        if (curr == nullptr)
+          break;
+        // As in `dequeue`, so the next element's link is visible.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        n++;
+      }
+
+      return n;
+    }
+
     /**
      * Used to find the first element in the queue. Only safe to use in the
      * consumer.
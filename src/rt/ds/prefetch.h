@@ -0,0 +1,104 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include "stack.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  include <xmmintrin.h>
+#endif
+
+namespace verona::rt
+{
+  /**
+   * Asks for the cache line containing `p` to be loaded, without waiting for
+   * it.
+   **/
+  inline void prefetch(const void* p)
+  {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch((const char*)p, _MM_HINT_T0);
+#elif defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p);
+#else
+    snmalloc::UNUSED(p);
+#endif
+  }
+
+  /**
+   * Visits the items of a stack of pointers, prefetching each item some time
+   * before it is returned.
+   *
+   * Items are taken off `stack` into a FIFO of `DEPTH` items, and prefetched
+   * as they go in, so by the time an item comes out of the FIFO its memory
+   * has had `DEPTH - 1` visits to arrive.  Items pushed on `stack` while
+   * visiting are picked up by later calls to `pop`, so this can be used in
+   * place of the stack in a traversal:
+   *
+   *   PrefetchQueue queue(stack);
+   *   while (!queue.empty())
+   *   {
+   *     T* item = queue.pop();
+   *     ... push the successors of item on stack ...
+   *   }
+   *
+   * The items are visited in a different order from the stack on its own.
+   * Any items still in the FIFO are put back on `stack` when the queue is
+   * destroyed, so a traversal can stop early and be resumed from `stack`.
+   **/
+  template<class T, class Alloc, size_t DEPTH = 8>
+  class PrefetchQueue
+  {
+  private:
+    static_assert(DEPTH > 0);
+
+    Stack<T*, Alloc>& stack;
+    T* items[DEPTH];
+    size_t head = 0;
+    size_t count = 0;
+
+  public:
+    PrefetchQueue(Stack<T*, Alloc>& stack) : stack(stack) {}
+
+    PrefetchQueue(const PrefetchQueue&) = delete;
+    PrefetchQueue& operator=(const PrefetchQueue&) = delete;
+
+    ~PrefetchQueue()
+    {
+      while (count > 0)
+        stack.push(take());
+    }
+
+    ALWAYSINLINE bool empty()
+    {
+      return (count == 0) && stack.empty();
+    }
+
+    ALWAYSINLINE T* pop()
+    {
+      fill();
+      return take();
+    }
+
+  private:
+    ALWAYSINLINE void fill()
+    {
+      while ((count < DEPTH) && !stack.empty())
+      {
+        T* item = stack.pop();
+        prefetch(item);
+        items[(head + count) % DEPTH] = item;
+        count++;
+      }
+    }
+
+    ALWAYSINLINE T* take()
+    {
+      assert(count > 0);
+      T* item = items[head];
+      head = (head + 1) % DEPTH;
+      count--;
+      return item;
+    }
+  };
+} // namespace verona::rt
@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 #pragma once
 
+#include "../ds/prefetch.h"
 #include "../ds/stack.h"
 #include "../test/systematic.h"
 
@@ -78,6 +79,8 @@ namespace verona::rt
   class RegionBase;
 
   using ObjectStack = Stack<Object*, Alloc>;
+  using FieldStack = Stack<Object**, Alloc>;
+  using ObjectPrefetchQueue = PrefetchQueue<Object, Alloc>;
   static constexpr size_t descriptor_alignment =
     snmalloc::bits::min<size_t>(8, alignof(void*));
 
@@ -89,12 +92,19 @@ namespace verona::rt
     using TraceIsoFunction = void (*)(const Object* o, ObjectStack* st);
     using FinalFunction = void (*)(Object* o);
     using NotifiedFunction = void (*)(Object* o);
+    // for field in o do
+    //  st.push(&o.field)
+    using TraceFieldsFunction = void (*)(Object* o, FieldStack* st);
 
     size_t size;
     TraceFunction trace;
     TraceIsoFunction trace_possibly_iso;
     FinalFunction finaliser;
     NotifiedFunction notified = nullptr;
+    // Optional.  The addresses of the fields that `trace` reports, so that
+    // the objects they refer to can be moved.  A trace region can only be
+    // compacted if all of its objects provide this.
+    TraceFieldsFunction trace_fields = nullptr;
     // TODO: virtual dispatch, pattern matching on type, reflection
   };
 
@@ -137,6 +147,9 @@ namespace verona::rt
     YesTransfer
   };
 
+  // Defined in ds/hashmap.h.
+  enum class HashMapProbe : uint8_t;
+
   class Object
   {
   public:
@@ -282,10 +295,11 @@ namespace verona::rt
     friend class RegionArena;
     friend class RememberedSet;
     friend class ExternalReferenceTable;
-    template<typename Entry, size_t& key_of(Entry*)>
+    template<typename Entry, size_t& key_of(Entry*), HashMapProbe probe>
     friend class PtrKeyHashMap;
     friend class Message;
     friend class LocalEpoch;
+    friend class DeferredRC;
 
     friend class LinkedObjectStack;
 
@@ -614,6 +628,19 @@ namespace verona::rt
       return true;
     }
 
+    /**
+     * Removes `n` references to an immutable root, which must not include
+     * the last one.
+     **/
+    inline void decref_many(size_t n)
+    {
+      assert(get_class() == RegionMD::RC);
+
+      size_t prev_rc = rc.fetch_sub(n * ONE_RC);
+      assert((prev_rc >> SHIFT) > n);
+      UNUSED(prev_rc);
+    }
+
     /**
      * Larger reference count than is possible to indicate that the cown's
      * reference count can no longer have new strong references taken out.
@@ -679,6 +706,11 @@ namespace verona::rt
       return get_descriptor()->notified != nullptr;
     }
 
+    inline bool has_trace_fields()
+    {
+      return get_descriptor()->trace_fields != nullptr;
+    }
+
     inline bool has_possibly_iso_fields()
     {
       return get_descriptor()->trace_possibly_iso != nullptr;
@@ -708,6 +740,11 @@ namespace verona::rt
       get_descriptor()->trace_possibly_iso(this, &f);
     }
 
+    inline void trace_fields(FieldStack& f)
+    {
+      get_descriptor()->trace_fields(this, &f);
+    }
+
     inline void finalise()
     {
       if (has_finaliser())
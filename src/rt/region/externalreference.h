@@ -210,6 +210,11 @@ namespace verona::rt
     {
       external_map->erase(p);
     }
+
+    bool empty()
+    {
+      return external_map->begin() == external_map->end();
+    }
   };
 
   using ExternalRef = ExternalReferenceTable::ExternalRef;
@@ -116,9 +116,32 @@ namespace verona::rt
    * region. Rather than copy the set up front, we lazily construct it using the
    * ring in the isolated regions. Every time we break the ring, we keep track
    * of that point in the objects stack.
+   *
+   * Arena regions
+   * -------------
+   *
+   * The objects in an arena cannot be freed one at a time, so an arena region
+   * is not split into SCCs. Instead, every object reachable from its entry
+   * point is made to point at the region metadata object, which becomes the
+   * root of a single SCC with a reference count of one. References out of
+   * the region are counted on the objects they refer to, as above. The
+   * arenas are freed together when the SCC is.
+   *
+   * Nested regions
+   * --------------
+   *
+   * A region only refers to the regions nested in it through their entry
+   * points, and each of those has exactly one incoming reference, so each
+   * region is frozen on its own, and the entry point of a nested region
+   * becomes an SCC root with a reference count of one. References from a
+   * region into immutable state are counted atomically, so different regions
+   * of the same graph can be frozen at the same time. `ParallelFreeze` uses
+   * this to freeze large nested regions on scheduler threads.
    */
   class Freeze
   {
+    friend class ParallelFreeze;
+
   private:
     static Object* post_order_mark(Object* o)
     {
@@ -130,200 +153,239 @@ namespace verona::rt
       return (Object*)(((uintptr_t)o) & ~(uintptr_t)1);
     }
 
-  public:
-    static void apply(Alloc* alloc, Object* o)
+    /**
+     * Returns an estimate of the bytes in the region whose entry point is
+     * `p`, used to decide whether it is worth freezing on its own thread.
+     **/
+    static size_t region_bytes(Object* p)
     {
-      assert(o->debug_is_iso());
+      if (RegionArena::is_arena_region(p->get_region()))
+        return RegionArena::memory_reserved(p);
 
-      ObjectStack objects(alloc);
-      ObjectStack dfs(alloc);
-      ObjectStack iso(alloc);
-      ObjectStack pending(alloc);
+      return RegionTrace::get(p)->usage.bytes;
+    }
 
-      iso.push(o);
+    /**
+     * Freezes the region whose entry point is `p`, pushing the entry points
+     * of the regions nested in it onto `iso`.  The other stacks are scratch
+     * space, and must be empty.
+     **/
+    static void freeze_region(
+      Alloc* alloc,
+      Object* p,
+      ObjectStack& iso,
+      ObjectStack& objects,
+      ObjectStack& dfs,
+      ObjectStack& pending)
+    {
+      assert(objects.empty());
+      assert(dfs.empty());
+      assert(p->debug_is_iso());
 
-      while (!iso.empty())
+      // An arena region is frozen in place, into a single SCC.
+      if (RegionArena::is_arena_region(p->get_region()))
       {
-        assert(objects.empty());
-        assert(dfs.empty());
+        RegionArena::get(p)->freeze_internal(alloc, p, iso);
+        return;
+      }
+
+      assert(RegionTrace::is_trace_region(p->get_region()));
+      RegionTrace* reg = RegionTrace::get(p);
 
-        Object* p = iso.pop();
-        assert(p->debug_is_iso());
+      // Freezing uses the mark bits of the objects.
+      reg->finish_incremental_gc(alloc, p);
 
-        // TODO(region): Right now we can only freeze trace regions. We'll
-        // probably need different strategies if we want to freeze other kinds
-        // of regions, e.g. copying objects out of an arena region.
-        assert(RegionTrace::is_trace_region(p->get_region()));
-        RegionTrace* reg = RegionTrace::get(p);
+      // The objects in a compacted block cannot be freed one at a time, so a
+      // compacted region is frozen in place, into a single SCC.
+      if (reg->blocks != nullptr)
+      {
+        reg->freeze_internal(alloc, p, iso);
+        return;
+      }
 
-        // Drop the ISO mark on the entry point.
-        p->init_next(reg);
+      // Drop the ISO mark on the entry point.
+      p->init_next(reg);
 
-        // Start with the graph entry point.
-        dfs.push(p);
+      // Start with the graph entry point.
+      dfs.push(p);
 
-        // Add the finaliser, and non-finaliser rings to objects.
-        objects.push(reg->next_not_root);
-        objects.push(reg->get_next());
+      // Add the finaliser, and non-finaliser rings to objects.
+      objects.push(reg->next_not_root);
+      objects.push(reg->get_next());
 
-        // Mark region metadata object, so sweeping does not travel through it.
-        reg->Object::mark();
+      // Mark region metadata object, so sweeping does not travel through it.
+      reg->Object::mark();
 
-        while (!dfs.empty())
-        {
-          Object::RegionMD c;
+      while (!dfs.empty())
+      {
+        Object::RegionMD c;
 
-          // Depth-first search has reached vertex q.
-          // This may be either a pre-order and post-order visit
-          Object* q_mark = dfs.pop();
-          Object* q = remove_post_order_mark(q_mark);
+        // Depth-first search has reached vertex q.
+        // This may be either a pre-order and post-order visit
+        Object* q_mark = dfs.pop();
+        Object* q = remove_post_order_mark(q_mark);
 
-          if (q != q_mark)
+        if (q != q_mark)
+        {
+          // Finished this part of the spanning tree
+          // If this is the head of the pending list, this means we have
+          // processed all children in the spanning tree and this should now
+          // be turned into a complete SCC with ref count 1.
+          if (q == pending.peek())
           {
-            // Finished this part of the spanning tree
-            // If this is the head of the pending list, this means we have
-            // processed all children in the spanning tree and this should now
-            // be turned into a complete SCC with ref count 1.
-            if (q == pending.peek())
-            {
-              pending.pop();
-              q->root_and_class(c)->make_nonatomic_scc();
-              assert(c == Object::PENDING);
-            }
-            continue;
+            pending.pop();
+            q->root_and_class(c)->make_nonatomic_scc();
+            assert(c == Object::PENDING);
           }
+          continue;
+        }
 
-          auto r = q->root_and_class(c);
+        auto r = q->root_and_class(c);
 
-          switch (c)
+        switch (c)
+        {
+          case Object::PENDING:
           {
-            case Object::PENDING:
+            // We have found a reference back into one of the SCCs
+            // on the current path.  Collapse the path by unioning
+            // all the nodes up to that SCC.
+            auto rank = r->pending_rank();
+            while (r != (p = pending.peek()->root_and_class(c)))
             {
-              // We have found a reference back into one of the SCCs
-              // on the current path.  Collapse the path by unioning
-              // all the nodes up to that SCC.
-              auto rank = r->pending_rank();
-              while (r != (p = pending.peek()->root_and_class(c)))
+              assert(c == Object::PENDING);
+              // Rank used to keep the union/find data structure balanced
+              auto p_rank = p->pending_rank();
+              if (p_rank <= rank)
               {
-                assert(c == Object::PENDING);
-                // Rank used to keep the union/find data structure balanced
-                auto p_rank = p->pending_rank();
-                if (p_rank <= rank)
-                {
-                  p->set_scc(r);
-                  if (p_rank == rank)
-                    r->set_pending_rank(++rank);
-                }
-                else
-                {
-                  r->set_scc(p);
-                  rank = p_rank;
-                  r = p;
-                }
-                pending.pop();
+                p->set_scc(r);
+                if (p_rank == rank)
+                  r->set_pending_rank(++rank);
               }
-              break;
-            }
-
-            case Object::ISO:
-            {
-              // External Iso, process that later.
-              iso.push(q);
-              break;
+              else
+              {
+                r->set_scc(p);
+                rank = p_rank;
+                r = p;
+              }
+              pending.pop();
             }
+            break;
+          }
 
-            case Object::RC:
-            case Object::COWN:
-            {
-              // External reference
-              r->incref();
-              break;
-            }
+          case Object::ISO:
+          {
+            // External Iso, process that later.
+            iso.push(q);
+            break;
+          }
 
-            case Object::NONATOMIC_RC:
-            {
-              // Reference to an already complete SCC, so incref it.
-              r->incref_nonatomic();
-              break;
-            }
+          case Object::RC:
+          case Object::COWN:
+          {
+            // External reference
+            r->incref();
+            break;
+          }
 
-            case Object::UNMARKED:
-            {
-              // Lazily construct stack of sublists for gcing
-              objects.push(q->get_next());
-              // Clear the `has_ext_ref` bit.
-              q->clear_has_ext_ref();
-              // Add this to the current path we are exploring
-              q->set_pending();
-              pending.push(q);
-              // Push post-order mark, so we can revisit once subtree complete
-              dfs.push(post_order_mark(q));
-              // Add all the fields to the dfs
-              q->trace(dfs);
-              break;
-            }
+          case Object::NONATOMIC_RC:
+          {
+            // Reference to an already complete SCC, so incref it.
+            r->incref_nonatomic();
+            break;
+          }
 
-            default:
-              assert(0);
+          case Object::UNMARKED:
+          {
+            // Lazily construct stack of sublists for gcing
+            objects.push(q->get_next());
+            // Clear the `has_ext_ref` bit.
+            q->clear_has_ext_ref();
+            // Add this to the current path we are exploring
+            q->set_pending();
+            pending.push(q);
+            // Push post-order mark, so we can revisit once subtree complete
+            dfs.push(post_order_mark(q));
+            // Add all the fields to the dfs
+            q->trace(dfs);
+            break;
           }
+
+          default:
+            assert(0);
         }
+      }
 
-        // Finalise all the objects
-        // Move non-atomics to atomics
-        // Calculate list of things to be deallocated
-        LinkedObjectStack to_dealloc;
-        p = objects.pop();
-        while (true)
+      // Finalise all the objects
+      // Move non-atomics to atomics
+      // Calculate list of things to be deallocated
+      LinkedObjectStack to_dealloc;
+      p = objects.pop();
+      while (true)
+      {
+        switch (p->get_class())
         {
-          switch (p->get_class())
+          case Object::UNMARKED:
           {
-            case Object::UNMARKED:
-            {
-              // Node was unreachable deallocate it
-              auto next = p->get_next();
-
-              assert(p != reg);
-
-              p->finalise();
-              to_dealloc.push(p);
-              p = next;
-              continue;
-            }
+            // Node was unreachable deallocate it
+            auto next = p->get_next();
 
-            case Object::NONATOMIC_RC:
-            {
-              // Convert to atomic rc to allow sharing.
-              p->make_atomic();
-              break;
-            }
-
-            case Object::MARKED:
-              assert(p == reg);
+            assert(p != reg);
 
-            case Object::RC:
-            case Object::SCC_PTR:
-              break;
+            p->finalise();
+            to_dealloc.push(p);
+            p = next;
+            continue;
+          }
 
-            default:
-              assert(0);
+          case Object::NONATOMIC_RC:
+          {
+            // Convert to atomic rc to allow sharing.
+            p->make_atomic();
+            break;
           }
 
-          if (objects.empty())
+          case Object::MARKED:
+            assert(p == reg);
+
+          case Object::RC:
+          case Object::SCC_PTR:
             break;
 
-          p = objects.pop();
+          default:
+            assert(0);
         }
 
-        // Finally deallocate objects.
-        while (!to_dealloc.empty())
-        {
-          to_dealloc.pop()->dealloc(alloc);
-        }
+        if (objects.empty())
+          break;
+
+        p = objects.pop();
+      }
 
-        reg->discard(alloc);
-        reg->dealloc(alloc);
+      // Finally deallocate objects.
+      while (!to_dealloc.empty())
+      {
+        to_dealloc.pop()->dealloc(alloc);
       }
 
+      reg->discard(alloc);
+      reg->dealloc(alloc);
+    }
+
+  public:
+    static void apply(Alloc* alloc, Object* o)
+    {
+      assert(o->debug_is_iso());
+
+      ObjectStack objects(alloc);
+      ObjectStack dfs(alloc);
+      ObjectStack iso(alloc);
+      ObjectStack pending(alloc);
+
+      iso.push(o);
+
+      while (!iso.empty())
+        freeze_region(alloc, iso.pop(), iso, objects, dfs, pending);
+
       assert(objects.empty());
       assert(dfs.empty());
       assert(iso.empty());
@@ -12,6 +12,7 @@ namespace verona::rt
     // This is used only to break a dependency cycle.
     inline void release(Alloc* alloc, Cown* o);
     inline void mark_for_scan(Object* o, EpochMark epoch);
+    inline void scan_skipped_immutable();
   } // namespace cown
 
   class Immutable
@@ -40,11 +41,12 @@ namespace verona::rt
       auto root = o->immutable();
 
       ObjectStack dfs(alloc);
+      ObjectPrefetchQueue queue(dfs);
       dfs.push(root);
 
-      while (!dfs.empty())
+      while (!queue.empty())
       {
-        o = dfs.pop();
+        o = queue.pop();
 
         switch (o->get_class())
         {
@@ -54,7 +56,10 @@ namespace verona::rt
             Systematic::cout()
               << "Immutable Scan: reaches immutable: " << o << std::endl;
             if (o->in_epoch(epoch))
+            {
+              cown::scan_skipped_immutable();
               continue;
+            }
 
             // This may trace an immutable that has already been traced, as it
             // races over the epoch mark. This is ok.
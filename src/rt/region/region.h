@@ -126,6 +126,112 @@ namespace verona::rt
       }
     }
 
+    /**
+     * Allocates an Object `o` of type `desc` in the region represented by the
+     * Iso object `in`, unless that would take the region over its quota, in
+     * which case this returns nullptr.
+     *
+     * If `collect` is true, a trace region that would go over its quota is
+     * collected first, and the allocation only fails if that does not free
+     * enough memory.  Any object not reachable from `in` is freed, so the
+     * caller must not hold the only reference to any object in the region.
+     **/
+    template<size_t size = 0>
+    static Object* try_alloc(
+      Alloc* alloc, Object* in, const Descriptor* desc, bool collect = false)
+    {
+      assert(in->debug_is_iso());
+      RegionBase* r = in->get_region();
+
+      if (!r->fits_quota(desc->size))
+      {
+        if (collect && (get_type(r) == RegionType::Trace))
+          RegionTrace::gc(alloc, in);
+
+        if (!r->fits_quota(desc->size))
+        {
+          Systematic::cout() << "Region quota exceeded: " << in << " ("
+                             << r->usage.bytes << " of " << r->quota
+                             << " bytes)" << std::endl;
+          return nullptr;
+        }
+      }
+
+      return Region::alloc<size>(alloc, in, desc);
+    }
+
+    /**
+     * Returns the memory owned by the region represented by the Iso object
+     * `o`, not counting its subregions.
+     **/
+    static RegionBase::MemoryUsage memory_used(Object* o)
+    {
+      assert(o->debug_is_iso());
+      return o->get_region()->usage;
+    }
+
+    /**
+     * Returns the memory owned by the region represented by the Iso object
+     * `o`, and by all of the regions nested in it.  This visits every object
+     * that may refer to a subregion.
+     **/
+    static RegionBase::MemoryUsage
+    memory_used_with_subregions(Alloc* alloc, Object* o)
+    {
+      RegionBase::MemoryUsage total;
+      ObjectStack f(alloc);
+      ObjectStack recurse(alloc);
+      recurse.push(o);
+
+      while (!recurse.empty())
+      {
+        o = recurse.pop();
+        total += memory_used(o);
+
+        switch (Region::get_type(o->get_region()))
+        {
+          case RegionType::Trace:
+            Region::find_subregions<RegionTrace>(o, f, recurse);
+            break;
+          case RegionType::Arena:
+            Region::find_subregions<RegionArena>(o, f, recurse);
+            break;
+          default:
+            abort();
+        }
+      }
+
+      return total;
+    }
+
+    /**
+     * Limits the region represented by the Iso object `o` to `bytes` bytes
+     * of objects, or removes its limit if `bytes` is zero.
+     *
+     * `try_alloc` fails rather than go over the quota.  Other allocations
+     * still succeed, but when a trace region goes over its quota during a
+     * behaviour, a collection of it is deferred to the end of the behaviour,
+     * as if `RegionTrace::set_gc_growth` had been used.  If that leaves the
+     * region over its quota, the next collection waits until the region has
+     * doubled in size.  The quota is kept when another region is merged into
+     * this one.
+     **/
+    static void set_quota(Object* o, size_t bytes)
+    {
+      assert(o->debug_is_iso());
+      o->get_region()->quota = bytes;
+    }
+
+    /**
+     * Returns the quota of the region represented by the Iso object `o`, or
+     * zero if it has none.
+     **/
+    static size_t get_quota(Object* o)
+    {
+      assert(o->debug_is_iso());
+      return o->get_region()->quota;
+    }
+
     /**
      * Scan the region to find all cowns, following pointers to immutables and
      * subregions. This is used to keep reachable cowns alive and prevent them
@@ -298,6 +404,30 @@ namespace verona::rt
       }
     }
 
+    /**
+     * Pushes the Iso objects of the regions directly nested in the region
+     * represented by the Iso object `o` onto `recurse`.  Only objects
+     * "needing finalisation" can refer to other regions.
+     **/
+    template<class RegionType>
+    static void find_subregions(Object* o, ObjectStack& f, ObjectStack& recurse)
+    {
+      auto reg = RegionType::get(o);
+      for (auto b_it = reg->template begin<RegionBase::NeedsFinaliser>();
+           b_it != reg->template end<RegionBase::NeedsFinaliser>();
+           ++b_it)
+      {
+        (*b_it)->trace(f);
+      }
+
+      while (!f.empty())
+      {
+        Object* p = f.pop();
+        if ((p->get_class() == Object::ISO) && (p != o))
+          recurse.push(p);
+      }
+    }
+
     /**
      * Internal method for releasing and deallocating regions, that takes
      * a worklist (represented by `f` and `collect`).
@@ -5,6 +5,7 @@
 #include "../object/object.h"
 #include "region_base.h"
 
+#include <algorithm>
 #include <cstddef>
 
 namespace verona::rt
@@ -27,6 +28,11 @@ namespace verona::rt
    * then allocate the object within the new arena. Note that we do not do
    * first fit or best fit.
    *
+   * The size of the arenas is chosen when the region is created, see
+   * `ArenaSizes`. The first arena may be small, so that a region holding a
+   * few objects stays cheap, and each arena after that is twice the size of
+   * the one before, up to a maximum.
+   *
    * Note that if the Iso is allocated within an arena, it will still point to
    * the arena region object.
    *
@@ -49,11 +55,13 @@ namespace verona::rt
   private:
     friend class Region;
     friend class RegionTrace;
+    friend class Freeze;
 
     /**
-     * An Arena is a large block of pre-allocated memory. It has an overhead of
-     * four pointers: the next Arena in the linked list, and three pointers to
-     * keep track of where objects are allocated. The next pointers of all
+     * An Arena is a block of pre-allocated memory, of between `MIN_ARENA_SIZE`
+     * and `MAX_ARENA_SIZE` bytes. It has an overhead of four pointers: the
+     * next Arena in the linked list, and three pointers to keep track of where
+     * objects are allocated. The next pointers of all
      * objects inside an arena are set to nullptr. An initialized arena is
      * guaranteed to have at least one object.
      *
@@ -69,7 +77,8 @@ namespace verona::rt
      * Note that certain operations require the bottom `MIN_ALLOC_BITS` to be
      * free, so we need to ensure all objects allocated within an arena are
      * properly aligned. This may involve extra padding in the "header" of an
-     * Arena object, and also rounding up object sizes.
+     * Arena object, and also rounding up object sizes. The objects start
+     * straight after the header.
      *
      *                       +------------------+
      *                       | next arena --------> ...
@@ -106,14 +115,12 @@ namespace verona::rt
      * We can calculate the remaining free space by taking the difference of
      * `finalisers_begin` and `objects_end`.
      **/
-    class Arena
+    class alignas(Object::ALIGNMENT) Arena
     {
       template<IteratorType type>
       friend class RegionArena::iterator;
 
     public:
-      static constexpr size_t SIZE = 1024 * 1024 - 4 * sizeof(uintptr_t);
-
       /**
        * Pointer to next arena in the linked list.
        **/
@@ -132,25 +139,37 @@ namespace verona::rt
       std::byte* finalisers_begin;
 
       /**
-       * Pointer to the byte after the Arena. We technically don't need to
-       * store this pointer, but we have some space because `objects_begin`
-       * needs to be aligned.
+       * Pointer to the byte after the Arena, which also gives its size.
        **/
       std::byte* finalisers_end;
 
       /**
        * Where objects will actually be allocated.
        **/
-      alignas(Object::ALIGNMENT) std::byte objects_begin[SIZE];
+      std::byte* objects_begin() const
+      {
+        return (std::byte*)(this + 1);
+      }
 
     public:
-      Arena()
+      /**
+       * Initialises an arena of `size` bytes, including this header.
+       **/
+      explicit Arena(size_t size)
       : next(nullptr),
-        objects_end(objects_begin),
-        finalisers_begin(objects_begin + SIZE),
+        objects_end(objects_begin()),
+        finalisers_begin((std::byte*)this + size),
         finalisers_end(finalisers_begin)
       {
-        assert(free_space() == SIZE);
+        assert(free_space() == size - sizeof(Arena));
+      }
+
+      /**
+       * The size of this arena, including the header.
+       **/
+      size_t size() const
+      {
+        return (size_t)(finalisers_end - (std::byte*)this);
       }
 
       inline size_t free_space() const
@@ -196,13 +215,32 @@ namespace verona::rt
         return o;
       }
 
+      /**
+       * Calls `f` on each object in the arena, including those that need a
+       * finaliser.
+       **/
+      template<typename F>
+      void for_each(F f)
+      {
+        auto step = [](std::byte* q) {
+          Object* o = (Object*)q;
+          return q + snmalloc::bits::align_up(o->size(), Object::ALIGNMENT);
+        };
+
+        for (std::byte* q = objects_begin(); q != objects_end; q = step(q))
+          f((Object*)q);
+
+        for (std::byte* q = finalisers_begin; q != finalisers_end; q = step(q))
+          f((Object*)q);
+      }
+
     private:
       bool debug_invariant() const
       {
-        bool objects_ptrs = objects_begin <= objects_end;
+        bool objects_ptrs = objects_begin() <= objects_end;
         bool finalisers_ptrs = finalisers_begin <= finalisers_end;
         bool no_overlap = (finalisers_begin - objects_end) >= 0;
-        auto alignment1 = Object::debug_is_aligned(objects_begin);
+        auto alignment1 = Object::debug_is_aligned(objects_begin());
         auto alignment2 = Object::debug_is_aligned(objects_end);
         auto alignment3 = Object::debug_is_aligned(finalisers_begin);
         auto alignment4 = Object::debug_is_aligned(finalisers_end);
@@ -210,7 +248,39 @@ namespace verona::rt
           alignment2 && alignment3 && alignment4;
       }
     };
-    static_assert(sizeof(Arena) == 1024 * 1024 * sizeof(std::byte));
+    static_assert(sizeof(Arena) % Object::ALIGNMENT == 0);
+
+  public:
+    static constexpr size_t MIN_ARENA_SIZE = 4 * 1024;
+    static constexpr size_t MAX_ARENA_SIZE = 64 * 1024 * 1024;
+    static constexpr size_t DEFAULT_ARENA_SIZE = 1024 * 1024;
+
+    /**
+     * Objects larger than this are allocated in the large object ring rather
+     * than in an arena, whatever the sizes of the region's arenas, so that
+     * where an object lives only depends on its size.  An object that does
+     * not fit in the next arena of the usual size is given an arena of its
+     * own.
+     **/
+    static constexpr size_t LARGE_OBJECT_SIZE =
+      DEFAULT_ARENA_SIZE - sizeof(Arena);
+
+    /**
+     * The sizes of the arenas of a region, in bytes, including their headers.
+     * The first arena is `initial` bytes, and each one after that is twice
+     * the size of the one before, up to `max`.  Both are rounded up to a
+     * power of two between `MIN_ARENA_SIZE` and `MAX_ARENA_SIZE`.
+     *
+     * The default gives every arena 1 MiB.  A region that usually holds a few
+     * small objects should start with a small arena.
+     **/
+    struct ArenaSizes
+    {
+      size_t initial = DEFAULT_ARENA_SIZE;
+      size_t max = DEFAULT_ARENA_SIZE;
+    };
+
+  private:
 
     /**
      * Pointer to the linked list of arenas where objects are allocated in.
@@ -232,9 +302,37 @@ namespace verona::rt
      **/
     Object* last_large;
 
-    RegionArena()
-    : first_arena(nullptr), last_arena(nullptr), last_large(nullptr)
+    /**
+     * Once the region is frozen, the headers of its large objects are no
+     * longer free to link them into a ring, so they are kept in this array.
+     * Entries for objects that were unreachable, and so freed, are null.
+     **/
+    Object** frozen_large = nullptr;
+    size_t frozen_large_count = 0;
+
+    /**
+     * Log2 of the size of the next arena, and of the largest arena, that this
+     * region will allocate.
+     **/
+    uint8_t next_arena_bits;
+    uint8_t max_arena_bits;
+
+    static uint8_t arena_bits(size_t size)
     {
+      size = std::clamp(size, MIN_ARENA_SIZE, MAX_ARENA_SIZE);
+      return (uint8_t)snmalloc::bits::next_pow2_bits(size);
+    }
+
+    RegionArena(ArenaSizes sizes)
+    : first_arena(nullptr),
+      last_arena(nullptr),
+      last_large(nullptr),
+      next_arena_bits(arena_bits(sizes.initial)),
+      max_arena_bits(arena_bits(sizes.max))
+    {
+      if (next_arena_bits > max_arena_bits)
+        max_arena_bits = next_arena_bits;
+
       set_descriptor(desc());
       init_next(this);
     }
@@ -247,6 +345,18 @@ namespace verona::rt
       return &desc;
     }
 
+    /**
+     * The descriptor of a frozen arena region, which is the root of the single
+     * SCC that all of its reachable objects were frozen into.
+     **/
+    static const Descriptor* frozen_desc()
+    {
+      static constexpr Descriptor desc = {
+        sizeof(RegionArena), frozen_trace, nullptr, frozen_finalise};
+
+      return &desc;
+    }
+
   public:
     inline static RegionArena* get(Object* o)
     {
@@ -265,15 +375,18 @@ namespace verona::rt
      * object is initialised as the Iso object for that region, and points to a
      * newly created Region metadata object. Returns a pointer to `o`.
      *
+     * The region's arenas have the given `sizes`.
+     *
      * The default template parameter `size = 0` is to avoid writing two
      * definitions which differ only in one line. This overload works because
      * every object must contain a descriptor, so 0 is not a valid size.
      **/
     template<size_t size = 0>
-    static Object* create(Alloc* alloc, const Descriptor* desc)
+    static Object*
+    create(Alloc* alloc, const Descriptor* desc, ArenaSizes sizes = {})
     {
       void* p = alloc->alloc<sizeof(RegionArena)>();
-      RegionArena* reg = new (p) RegionArena();
+      RegionArena* reg = new (p) RegionArena(sizes);
 
       // o might be allocated in the arena or the large object ring.
       Object* o = reg->alloc_internal<size>(alloc, desc);
@@ -308,6 +421,24 @@ namespace verona::rt
       return o;
     }
 
+    /**
+     * Returns the bytes allocated for the region whose iso object is `o`:
+     * its arenas, however full they are, and its large objects.
+     **/
+    static size_t memory_reserved(Object* o)
+    {
+      RegionArena* reg = get(o);
+      size_t bytes = 0;
+
+      for (Arena* a = reg->first_arena; a != nullptr; a = a->next)
+        bytes += a->size();
+
+      for (Object* p = reg->get_next(); p != reg; p = p->get_next_any_mark())
+        bytes += p->size();
+
+      return bytes;
+    }
+
     /**
      * Insert the Object `o` into the RememberedSet of `into`'s region.
      *
@@ -351,7 +482,7 @@ namespace verona::rt
       // Clear the iso bit on `o`, if it's inside an arena. Otherwise, it's in
       // the large object ring and pointing to some other object.
       size_t sz = snmalloc::bits::align_up(o->size(), Object::ALIGNMENT);
-      if (sz <= Arena::SIZE)
+      if (sz <= LARGE_OBJECT_SIZE)
         o->init_next(nullptr);
 
       // Merge the ExternalRefTable and RememberedSet.
@@ -414,8 +545,10 @@ namespace verona::rt
     template<size_t size = 0>
     Object* alloc_internal(Alloc* alloc, const Descriptor* desc)
     {
+      use_memory(desc->size);
+
       size_t sz = snmalloc::bits::align_up(desc->size, Object::ALIGNMENT);
-      if (sz > Arena::SIZE)
+      if (sz > LARGE_OBJECT_SIZE)
       {
         // Allocate object.
         Object* o = nullptr;
@@ -435,8 +568,7 @@ namespace verona::rt
       // allocate a new arena.
       if (last_arena == nullptr || last_arena->free_space() < sz)
       {
-        void* p = alloc->alloc<sizeof(Arena)>();
-        Arena* a = new (p) Arena();
+        Arena* a = alloc_arena(alloc, sz);
 
         if (last_arena == nullptr)
         {
@@ -455,8 +587,32 @@ namespace verona::rt
       return last_arena->alloc_obj(desc, sz);
     }
 
+    /**
+     * Allocates the next arena, which has room for an object of `sz` bytes,
+     * and doubles the size of the arena after it, up to the maximum.
+     **/
+    Arena* alloc_arena(Alloc* alloc, size_t sz)
+    {
+      size_t size = (size_t)1 << next_arena_bits;
+
+      if (next_arena_bits < max_arena_bits)
+        next_arena_bits++;
+
+      // An object too large for the usual arena gets one of its own.
+      if (sz > size - sizeof(Arena))
+        size = snmalloc::bits::align_up(sz + sizeof(Arena), MIN_ARENA_SIZE);
+
+      Systematic::cout() << "Arena region: new arena of " << size << " bytes"
+                         << std::endl;
+
+      void* p = alloc->alloc(size);
+      return new (p) Arena(size);
+    }
+
     void merge_internal(RegionArena* other)
     {
+      merge_usage(other);
+
       // Merge arena linked lists.
       if (last_arena == nullptr)
       {
@@ -492,7 +648,7 @@ namespace verona::rt
       size_t nroot_size =
         snmalloc::bits::align_up(nroot->size(), Object::ALIGNMENT);
 
-      if (oroot_size <= Arena::SIZE)
+      if (oroot_size <= LARGE_OBJECT_SIZE)
       {
         // Old root is inside an arena, so we set its next to nullptr.
         oroot->init_next(nullptr);
@@ -501,7 +657,7 @@ namespace verona::rt
       {
         // Old root is in the large object ring.
         assert(oroot == last_large);
-        if (nroot_size <= Arena::SIZE)
+        if (nroot_size <= LARGE_OBJECT_SIZE)
         {
           // Clear the iso bit on the old root.
           oroot->init_next(this);
@@ -510,7 +666,7 @@ namespace verona::rt
 
       // New root is in the large object ring, need to move it to the last
       // position in the ring. Don't do anything if it's already last.
-      if (nroot != last_large && nroot_size > Arena::SIZE)
+      if (nroot != last_large && nroot_size > LARGE_OBJECT_SIZE)
       {
         Object* x = get_next();
         Object* y = nroot->get_next();
@@ -566,7 +722,7 @@ namespace verona::rt
       while (arena != nullptr)
       {
         Arena* q = arena->next;
-        alloc->dealloc<sizeof(Arena)>(arena);
+        alloc->dealloc(arena, arena->size());
         arena = q;
       }
 
@@ -578,6 +734,204 @@ namespace verona::rt
       dealloc(alloc);
     }
 
+    /**
+     * Freezes the region whose iso object is `o`, in place. Every object
+     * reachable from `o` is made part of a single SCC, whose root is the
+     * region metadata object, with a reference count of one. The arenas are
+     * freed, all at once, when that reference count drops to zero, so
+     * objects that were unreachable when the region was frozen are only
+     * finalised, and their memory stays in use until then.
+     *
+     * Isos of other regions that are reachable from `o` are pushed on to
+     * `iso`, to be frozen by the caller.
+     **/
+    void freeze_internal(Alloc* alloc, Object* o, ObjectStack& iso)
+    {
+      assert(o->debug_is_iso());
+      Systematic::cout() << "Freeze: arena region: " << o << std::endl;
+
+      // Freezing overwrites the headers that link the large object ring, so
+      // move its objects to an array first.
+      size_t large_count = 0;
+      for (Object* p = get_next(); p != this; p = p->get_next_any_mark())
+        large_count++;
+
+      Object** large = nullptr;
+      if (large_count > 0)
+      {
+        large = (Object**)alloc->alloc(large_count * sizeof(Object*));
+        size_t i = 0;
+        for (Object* p = get_next(); p != this; p = p->get_next_any_mark())
+          large[i++] = p;
+      }
+
+      // Find the reachable objects, pointing each at the region metadata
+      // object, and count the references out of the region.
+      ObjectStack dfs(alloc);
+      dfs.push(o);
+
+      while (!dfs.empty())
+      {
+        Object* q = dfs.pop();
+
+        switch (q->get_class())
+        {
+          case Object::ISO:
+          {
+            if (q != o)
+            {
+              iso.push(q);
+              break;
+            }
+            [[fallthrough]];
+          }
+
+          case Object::UNMARKED:
+          {
+            q->clear_has_ext_ref();
+            q->set_scc(this);
+            q->trace(dfs);
+            break;
+          }
+
+          case Object::SCC_PTR:
+          {
+            if (q->get_scc() != this)
+              q->immutable()->incref();
+            break;
+          }
+
+          case Object::RC:
+          case Object::COWN:
+          {
+            q->incref();
+            break;
+          }
+
+          default:
+            assert(0);
+        }
+      }
+
+      // Finalise the unreachable objects, and free the large ones.
+      for (Arena* a = first_arena; a != nullptr; a = a->next)
+      {
+        a->for_each([this](Object* p) {
+          if (!is_frozen(p))
+            p->finalise();
+        });
+      }
+
+      for (size_t i = 0; i < large_count; i++)
+      {
+        if (!is_frozen(large[i]))
+          large[i]->finalise();
+      }
+
+      for (size_t i = 0; i < large_count; i++)
+      {
+        if (!is_frozen(large[i]))
+        {
+          large[i]->dealloc(alloc);
+          large[i] = nullptr;
+        }
+      }
+
+      frozen_large = large;
+      frozen_large_count = large_count;
+
+      // The references out of the region are now counted by the SCC, so the
+      // remembered set can drop its own.
+      RememberedSet::discard(alloc);
+      RememberedSet::dealloc(alloc);
+      ExternalReferenceTable::dealloc(alloc);
+
+      set_descriptor(frozen_desc());
+      make_scc();
+    }
+
+  private:
+    /**
+     * Returns true if `p` is one of the objects that were reachable when this
+     * region was frozen.
+     **/
+    bool is_frozen(Object* p)
+    {
+      return (p->get_class() == Object::SCC_PTR) && (p->get_scc() == this);
+    }
+
+    /**
+     * Traces the references out of a frozen arena region, i.e. all the
+     * fields of its objects that do not refer to another of its objects.
+     **/
+    static void frozen_trace(const Object* o, ObjectStack* st)
+    {
+      auto reg = (RegionArena*)o;
+      ObjectStack f(ThreadAlloc::get());
+
+      reg->for_each_frozen([reg, st, &f](Object* p) {
+        p->trace(f);
+        while (!f.empty())
+        {
+          Object* q = f.pop();
+          if (!reg->is_frozen(q))
+            st->push(q);
+        }
+      });
+    }
+
+    /**
+     * Finalises the objects of a frozen arena region and frees its memory,
+     * apart from the region metadata object itself.
+     **/
+    static void frozen_finalise(Object* o)
+    {
+      auto reg = (RegionArena*)o;
+      auto* alloc = ThreadAlloc::get();
+
+      reg->for_each_frozen([](Object* p) { p->finalise(); });
+
+      for (size_t i = 0; i < reg->frozen_large_count; i++)
+      {
+        if (reg->frozen_large[i] != nullptr)
+          reg->frozen_large[i]->dealloc(alloc);
+      }
+
+      if (reg->frozen_large != nullptr)
+        alloc->dealloc(
+          reg->frozen_large, reg->frozen_large_count * sizeof(Object*));
+
+      Arena* arena = reg->first_arena;
+      while (arena != nullptr)
+      {
+        Arena* q = arena->next;
+        alloc->dealloc(arena, arena->size());
+        arena = q;
+      }
+    }
+
+    /**
+     * Calls `f` on each object that was reachable when this region was
+     * frozen.
+     **/
+    template<typename F>
+    void for_each_frozen(F f)
+    {
+      for (Arena* a = first_arena; a != nullptr; a = a->next)
+      {
+        a->for_each([this, &f](Object* p) {
+          if (is_frozen(p))
+            f(p);
+        });
+      }
+
+      for (size_t i = 0; i < frozen_large_count; i++)
+      {
+        if (frozen_large[i] != nullptr)
+          f(frozen_large[i]);
+      }
+    }
+
   public:
     template<IteratorType type = Both>
     class iterator
@@ -644,7 +998,7 @@ namespace verona::rt
         std::byte* q = (std::byte*)ptr + sz;
         if constexpr (type == NoFinaliser)
         {
-          assert(q > arena->objects_begin && q <= arena->objects_end);
+          assert(q > arena->objects_begin() && q <= arena->objects_end);
 
           // We have not yet reached the end, so q is valid.
           if (q != arena->objects_end)
@@ -661,7 +1015,7 @@ namespace verona::rt
         else if constexpr (type == Both)
         {
           assert(
-            (q > arena->objects_begin && q <= arena->objects_end) ||
+            (q > arena->objects_begin() && q <= arena->objects_end) ||
             (q > arena->finalisers_begin && q <= arena->finalisers_end));
 
           // We have not yet reached either end, so q is valid.
@@ -714,13 +1068,13 @@ namespace verona::rt
         while (arena != nullptr)
         {
           assert(
-            arena->objects_begin < arena->objects_end ||
+            arena->objects_begin() < arena->objects_end ||
             arena->finalisers_begin < arena->finalisers_end);
           assert(arena->debug_invariant());
           if constexpr (type == NoFinaliser || type == Both)
           {
-            if (arena->objects_begin != arena->objects_end)
-              return (Object*)arena->objects_begin;
+            if (arena->objects_begin() != arena->objects_end)
+              return (Object*)arena->objects_begin();
           }
           if constexpr (type == NeedsFinaliser || type == Both)
           {
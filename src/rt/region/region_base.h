@@ -32,6 +32,7 @@ namespace verona::rt
                      public RememberedSet
   {
     friend class Freeze;
+    friend class Region;
     friend class RegionTrace;
     friend class RegionArena;
 
@@ -43,7 +44,60 @@ namespace verona::rt
       Both
     };
 
+    /**
+     * The memory owned by a region: the number of objects in it, and the sum
+     * of their sizes.  This is kept up to date as objects are allocated,
+     * regions are merged, and trace regions are collected.  The objects of
+     * an arena region are only freed with the region, so its count only
+     * grows.
+     **/
+    struct MemoryUsage
+    {
+      size_t bytes = 0;
+      size_t objects = 0;
+
+      MemoryUsage& operator+=(const MemoryUsage& other)
+      {
+        bytes += other.bytes;
+        objects += other.objects;
+        return *this;
+      }
+    };
+
   private:
+    MemoryUsage usage;
+
+    // The most bytes the region's objects should take up, or zero if there
+    // is no limit.
+    size_t quota = 0;
+
+    void use_memory(size_t size)
+    {
+      usage.bytes += size;
+      usage.objects++;
+    }
+
+    void free_memory(size_t size)
+    {
+      assert((usage.bytes >= size) && (usage.objects > 0));
+      usage.bytes -= size;
+      usage.objects--;
+    }
+
+    void merge_usage(RegionBase* other)
+    {
+      usage += other->usage;
+    }
+
+    /**
+     * Returns true if allocating `size` more bytes would keep the region
+     * within its quota.
+     **/
+    bool fits_quota(size_t size) const
+    {
+      return (quota == 0) || (usage.bytes + size <= quota);
+    }
+
     inline void dealloc(Alloc* alloc)
     {
       ExternalReferenceTable::dealloc(alloc);
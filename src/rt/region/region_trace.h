@@ -6,6 +6,9 @@
 #include "region_arena.h"
 #include "region_base.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace verona::rt
 {
   using namespace snmalloc;
@@ -62,11 +65,195 @@ namespace verona::rt
     Object* next_not_root;
     Object* last_not_root;
 
-    // Memory usage in the region.
-    size_t current_memory_used = 0;
+    // Memory used by the region after its last collection.
+    size_t previous_memory_used = 0;
+
+    // If a collection of this region has been deferred, this is its iso
+    // object, and the region is on a thread's list of deferred collections.
+    // `deferred_prev` points at the link to this region, so it can be taken
+    // off the list without walking it.
+    Object* deferred_iso = nullptr;
+    RegionTrace* deferred_next = nullptr;
+    RegionTrace** deferred_prev = nullptr;
+
+    /**
+     * A block of memory that a compacting collection has moved objects into.
+     * The objects in a block are not freed individually: the block is freed
+     * when the last of them is.
+     **/
+    struct CompactBlock
+    {
+      CompactBlock* next;
+      size_t size;
+      size_t live;
+
+      static size_t header_size()
+      {
+        return snmalloc::bits::align_up(
+          sizeof(CompactBlock), Object::ALIGNMENT);
+      }
+
+      static CompactBlock* make(Alloc* alloc, size_t bytes, size_t count)
+      {
+        size_t size = header_size() + bytes;
+        auto b = (CompactBlock*)alloc->alloc(size);
+        b->next = nullptr;
+        b->size = size;
+        b->live = count;
+        return b;
+      }
+
+      uintptr_t begin()
+      {
+        return (uintptr_t)this + header_size();
+      }
+
+      uintptr_t end()
+      {
+        return (uintptr_t)this + size;
+      }
 
-    // Compact representation of previous memory used as a sizeclass.
-    snmalloc::sizeclass_t previous_memory_used = 0;
+      bool contains(Object* o)
+      {
+        return ((uintptr_t)o >= begin()) && ((uintptr_t)o < end());
+      }
+
+      void dealloc(Alloc* alloc)
+      {
+        alloc->dealloc(this, size);
+      }
+    };
+
+    // Blocks that objects in this region were compacted into.
+    CompactBlock* blocks = nullptr;
+
+    // Once a compacted region is frozen, the headers of its objects no
+    // longer link the rings, so they are kept here.
+    Object** frozen = nullptr;
+    size_t frozen_count = 0;
+
+    /**
+     * A stack of objects that an incremental collection keeps between its
+     * slices.  Unlike ObjectStack, this does not hold on to an allocator, as
+     * the slices may run on different threads.
+     **/
+    class PendingStack
+    {
+    private:
+      Object** items = nullptr;
+      size_t count = 0;
+      size_t capacity = 0;
+
+    public:
+      void push(Alloc* alloc, Object* o)
+      {
+        if (count == capacity)
+        {
+          size_t grown = std::max<size_t>(capacity * 2, 64);
+          auto p = (Object**)alloc->alloc(grown * sizeof(Object*));
+          if (items != nullptr)
+          {
+            memcpy(p, items, count * sizeof(Object*));
+            alloc->dealloc(items, capacity * sizeof(Object*));
+          }
+          items = p;
+          capacity = grown;
+        }
+
+        items[count++] = o;
+      }
+
+      void move_to(ObjectStack& st)
+      {
+        while (count > 0)
+          st.push(items[--count]);
+      }
+
+      void move_from(Alloc* alloc, ObjectStack& st)
+      {
+        while (!st.empty())
+          push(alloc, st.pop());
+      }
+
+      void dealloc(Alloc* alloc)
+      {
+        if (items != nullptr)
+          alloc->dealloc(items, capacity * sizeof(Object*));
+      }
+    };
+
+    /**
+     * Where the sweep of a ring has got to.
+     **/
+    struct SweepCursor
+    {
+      // The last object kept, or the region metadata object.
+      Object* prev;
+      // The next object to visit.
+      Object* p;
+      // Unreachable objects with finalisers.  They are deallocated once the
+      // whole ring has been swept, as their finalisers may refer to each
+      // other.
+      Object* finalised = nullptr;
+    };
+
+    /**
+     * The state of an incremental collection, kept between its slices.
+     **/
+    struct IncrementalGC
+    {
+      enum Phase
+      {
+        Mark,
+        Sweep
+      };
+
+      Phase phase = Mark;
+      // Objects that marking has reached, or that the write barrier has seen
+      // unlinked, and that have yet to be traced.
+      PendingStack gray;
+      // Iso objects of unreachable subregions, to release once the sweep has
+      // finished.
+      PendingStack collect;
+      // Remembered set entries marked so far.
+      size_t marked = 0;
+      // Bytes freed so far.
+      size_t reclaimed = 0;
+      RingKind ring = FinaliserRing;
+      SweepCursor cursor = {nullptr, nullptr};
+    };
+
+    // The incremental collection of this region, if one is in progress.
+    IncrementalGC* incremental = nullptr;
+
+    struct GCPolicy
+    {
+      size_t growth_factor = 0;
+      size_t min_bytes = DEFAULT_GC_MIN_BYTES;
+      // Objects marked or swept per slice of an incremental collection, or
+      // zero if collections are not incremental.
+      size_t slice_budget = 0;
+      size_t incremental_min_bytes = DEFAULT_INCREMENTAL_MIN_BYTES;
+    };
+
+    static GCPolicy& gc_policy()
+    {
+      static GCPolicy policy;
+      return policy;
+    }
+
+    struct DeferredGC
+    {
+      // True between `begin_deferred_gc` and `end_deferred_gc`.
+      bool enabled = false;
+      RegionTrace* head = nullptr;
+    };
+
+    static DeferredGC& deferred()
+    {
+      static thread_local DeferredGC d;
+      return d;
+    }
 
     explicit RegionTrace(Object* o) : next_not_root(this), last_not_root(this)
     {
@@ -82,7 +269,247 @@ namespace verona::rt
       return &desc;
     }
 
+    /**
+     * The descriptor of a frozen compacted region, which is the root of the
+     * single SCC that all of its objects were frozen into.
+     **/
+    static const Descriptor* frozen_desc()
+    {
+      static constexpr Descriptor desc = {
+        sizeof(RegionTrace), frozen_trace, nullptr, frozen_finalise};
+
+      return &desc;
+    }
+
   public:
+    static constexpr size_t DEFAULT_GC_MIN_BYTES = 1 << 16;
+    static constexpr size_t DEFAULT_INCREMENTAL_MIN_BYTES = 1 << 24;
+
+    // How much a region that is still over its quota after a collection has
+    // to grow before going over the quota triggers another.
+    static constexpr size_t OVER_QUOTA_GROWTH_FACTOR = 2;
+
+    /**
+     * Counts of the collections started by allocation, across all regions.
+     **/
+    struct AutoGCStats
+    {
+      // Regions that grew past their threshold, and had a collection
+      // deferred.
+      std::atomic<size_t> triggered = 0;
+      // Deferred collections that ran.  A deferred collection does not run if
+      // the region is collected explicitly, or released, first.
+      std::atomic<size_t> collections = 0;
+      // Bytes freed by the deferred collections.
+      std::atomic<size_t> reclaimed_bytes = 0;
+      // Slices of incremental collections that ran.  An incremental
+      // collection counts towards `collections` once its last slice has run.
+      std::atomic<size_t> slices = 0;
+    };
+
+    static AutoGCStats& auto_gc_stats()
+    {
+      static AutoGCStats stats;
+      return stats;
+    }
+
+    /**
+     * Makes allocation trigger garbage collection.  When an allocation takes
+     * a region to more than `growth_factor` times the memory it used after
+     * its last collection, and to more than `min_bytes`, a collection of that
+     * region is deferred until the end of the current behaviour.  At that
+     * point nothing on the stack can refer into the region, so only objects
+     * reachable from the iso object are kept.
+     *
+     * The regions that a behaviour sends to other cowns, and those nested in
+     * them, are not collected at its end, as the collection would race with
+     * their new owner.  See `cancel_deferred_gc_from`.  Allocation outside a
+     * behaviour does not trigger collections, unless it is between calls to
+     * `begin_deferred_gc` and `end_deferred_gc`.
+     *
+     * A `growth_factor` of zero, the default, turns this off.  This must be
+     * called before any regions are allocated in.
+     **/
+    static void
+    set_gc_growth(size_t growth_factor, size_t min_bytes = DEFAULT_GC_MIN_BYTES)
+    {
+      auto& policy = gc_policy();
+      policy.growth_factor = growth_factor;
+      policy.min_bytes = min_bytes;
+    }
+
+    /**
+     * Makes the deferred collections of regions using at least `min_bytes`
+     * incremental.  Instead of collecting the whole region at the end of the
+     * behaviour, it marks or sweeps at most `slice_budget` objects, and the
+     * collection carries on at the end of the next behaviour that allocates
+     * in the region, or overwrites one of its fields through `write_barrier`,
+     * until it finishes.  This bounds the pause that collecting a large
+     * region adds to a behaviour.  See `gc_step`.
+     *
+     * A `slice_budget` of zero, the default, turns this off.
+     **/
+    static void set_incremental_gc(
+      size_t slice_budget,
+      size_t min_bytes = DEFAULT_INCREMENTAL_MIN_BYTES)
+    {
+      auto& policy = gc_policy();
+      policy.slice_budget = slice_budget;
+      policy.incremental_min_bytes = min_bytes;
+    }
+
+    /**
+     * Lets allocation on this thread defer collections, until the matching
+     * call to `end_deferred_gc`.  The scheduler calls these around every
+     * behaviour.
+     **/
+    static void begin_deferred_gc()
+    {
+      deferred().enabled = true;
+    }
+
+    /**
+     * Runs the collections deferred since `begin_deferred_gc`, and stops
+     * deferring new ones.
+     **/
+    static void end_deferred_gc(Alloc* alloc)
+    {
+      collect_deferred(alloc);
+      deferred().enabled = false;
+    }
+
+    /**
+     * Runs the collections that allocation on this thread has deferred.
+     **/
+    static void collect_deferred(Alloc* alloc)
+    {
+      RegionTrace*& head = deferred().head;
+      auto& stats = auto_gc_stats();
+      auto& policy = gc_policy();
+
+      // Collecting a region can release unreachable subregions, which
+      // removes them from the list, so take each region off before
+      // collecting it.
+      while (head != nullptr)
+      {
+        RegionTrace* reg = head;
+        Object* o = reg->deferred_iso;
+        reg->cancel_deferred_gc();
+
+        if (
+          (reg->incremental != nullptr) ||
+          ((policy.slice_budget != 0) &&
+           (reg->usage.bytes >= policy.incremental_min_bytes)))
+        {
+          size_t reclaimed;
+          stats.slices++;
+          if (reg->gc_slice(alloc, o, policy.slice_budget, reclaimed))
+          {
+            stats.collections++;
+            stats.reclaimed_bytes += reclaimed;
+          }
+          continue;
+        }
+
+        size_t before = reg->usage.bytes;
+        gc(alloc, o);
+
+        stats.collections++;
+        stats.reclaimed_bytes += before - reg->usage.bytes;
+      }
+    }
+
+    /**
+     * Returns true if allocation on this thread has deferred any collections
+     * that have not run yet.
+     **/
+    static bool has_deferred_gc()
+    {
+      return deferred().head != nullptr;
+    }
+
+    /**
+     * Cancels the deferred collections of the regions whose iso objects are
+     * on `st`, and of the regions nested in them, which are being handed
+     * over to another behaviour.  The scheduler calls this with the objects
+     * that a behaviour captures when it is scheduled, as they may be in use
+     * on another thread by the time the current behaviour ends.  Any other
+     * objects on `st` are ignored, and `st` is left empty.
+     **/
+    static void cancel_deferred_gc_from(Alloc* alloc, ObjectStack& st)
+    {
+      ObjectStack f(alloc);
+
+      // Finding the nested regions means looking through the fields of the
+      // objects in each region, so stop once there is nothing left to
+      // cancel.
+      while (!st.empty() && has_deferred_gc())
+      {
+        Object* o = st.pop();
+        if (o->get_class() != Object::ISO)
+          continue;
+
+        RegionBase* r = o->get_region();
+        if (is_trace_region(r))
+        {
+          auto reg = (RegionTrace*)r;
+          reg->cancel_deferred_gc();
+
+          for (auto it = reg->begin<NeedsFinaliser>();
+               it != reg->end<NeedsFinaliser>();
+               ++it)
+            (*it)->find_iso_fields(o, f, st);
+        }
+        else if (RegionArena::is_arena_region(r))
+        {
+          for (auto p : *(RegionArena*)r)
+            p->find_iso_fields(o, f, st);
+        }
+        else
+          abort();
+      }
+
+      while (!st.empty())
+        st.pop();
+    }
+
+    /**
+     * Returns true if a collection of the region represented by the iso
+     * object `o` has been deferred.
+     **/
+    static bool is_gc_deferred(Object* o)
+    {
+      return get(o)->deferred_iso != nullptr;
+    }
+
+    /**
+     * Returns true if an incremental collection of the region represented by
+     * the iso object `o` is in progress.
+     **/
+    static bool is_gc_in_progress(Object* o)
+    {
+      return get(o)->incremental != nullptr;
+    }
+
+    /**
+     * Must be called with the value of a field of an object in the region
+     * represented by the iso object `region`, if it refers to an object,
+     * before the field is overwritten.
+     *
+     * An incremental collection keeps what was reachable when it started, as
+     * well as what has been allocated since.  While it is marking, this
+     * remembers `old`, so that it is still marked even if the field was the
+     * only path to it that marking had yet to follow.  The iso object of a
+     * subregion is ignored, as marking does not follow it, and it may be
+     * sent away or released before the collection carries on.
+     **/
+    static void write_barrier(Alloc* alloc, Object* region, Object* old)
+    {
+      RegionTrace* reg = get(region);
+      if (reg->incremental != nullptr)
+        reg->shade(alloc, region, old);
+    }
+
     inline static RegionTrace* get(Object* o)
     {
       assert(o->debug_is_iso());
@@ -150,8 +577,12 @@ namespace verona::rt
       // Add to the ring.
       reg->append(o);
 
+      if (reg->incremental != nullptr)
+        reg->allocated_during_gc(o);
+
       // GC heuristics.
       reg->use_memory(desc->size);
+      reg->check_gc_trigger(in);
 
       return o;
     }
@@ -170,7 +601,11 @@ namespace verona::rt
 
       Object::RegionMD c;
       o = o->root_and_class(c);
-      reg->RememberedSet::insert<transfer>(alloc, o);
+
+      // An incremental collection keeps what is added while it runs.
+      size_t* marked =
+        (reg->incremental != nullptr) ? &reg->incremental->marked : nullptr;
+      reg->RememberedSet::insert<transfer>(alloc, o, marked);
     }
 
     /**
@@ -186,8 +621,14 @@ namespace verona::rt
       RegionBase* other = o->get_region();
       assert(reg != other);
 
+      reg->finish_incremental_gc(alloc, into);
+
       if (is_trace_region(other))
+      {
+        ((RegionTrace*)other)->finish_incremental_gc(alloc, o);
+        ((RegionTrace*)other)->cancel_deferred_gc();
         reg->merge_internal(o, (RegionTrace*)other);
+      }
       else
         assert(0);
 
@@ -197,6 +638,8 @@ namespace verona::rt
 
       // Now we can deallocate the other region's metadata object.
       other->dealloc(alloc);
+
+      reg->check_gc_trigger(into);
     }
 
     /**
@@ -207,10 +650,13 @@ namespace verona::rt
     {
       assert(prev != next);
       assert(prev->debug_is_iso());
-      assert(next->debug_is_mutable());
-      assert(prev->get_region() != next);
 
+      // The collection may have marked `next`.
       RegionTrace* reg = get(prev);
+      reg->finish_incremental_gc(ThreadAlloc::get(), prev);
+
+      assert(next->debug_is_mutable());
+      assert(prev->get_region() != next);
       reg->swap_root_internal(prev, next);
     }
 
@@ -218,6 +664,8 @@ namespace verona::rt
      * Run a garbage collection on the region represented by the Object `o`.
      * Only `o`'s region will be GC'd; we ignore pointers to Immutables and
      * other regions.
+     *
+     * An incremental collection in progress is finished first.
      **/
     static void gc(Alloc* alloc, Object* o)
     {
@@ -230,14 +678,81 @@ namespace verona::rt
       ObjectStack collect(alloc);
       size_t marked = 0;
 
+      // A collection now makes a deferred one unnecessary.
+      reg->cancel_deferred_gc();
+      reg->finish_incremental_gc(alloc, o);
+
       reg->mark(alloc, o, f, marked);
       reg->sweep(alloc, o, f, collect, marked);
+      reg->release_subregions(alloc, f, collect);
+    }
 
+    /**
+     * Runs a slice of an incremental collection of the region represented by
+     * the iso object `o`, marking or sweeping at most `budget` objects, and
+     * returns true if that finished the collection.  A collection is started
+     * if none is in progress.
+     *
+     * As with `gc`, when a collection starts nothing outside the region may
+     * refer to an object in it, other than to `o`.  Between slices, the
+     * region can be used as normal, so long as fields that refer to objects
+     * are only overwritten after a call to `write_barrier`.  The collection
+     * frees what was unreachable when it started, and keeps everything
+     * allocated while it runs.
+     **/
+    static bool gc_step(Alloc* alloc, Object* o, size_t budget)
+    {
+      assert(budget > 0);
+      size_t reclaimed;
+      return get(o)->gc_slice(alloc, o, budget, reclaimed);
+    }
+
+    /**
+     * Runs a garbage collection on the region represented by the iso object
+     * `o`, and then moves every other object in the region into a single
+     * contiguous block, in the order that a depth-first traversal from `o`
+     * reaches them.  This improves the locality of a region whose objects
+     * have become spread out over many slabs.
+     *
+     * Only `o` stays where it is, so there must be no other pointers into the
+     * region, on the stack or elsewhere.  As the region's external
+     * references would also be left dangling, this does nothing and returns
+     * false unless the region has none.
+     *
+     * Only the fields that an object's descriptor reports through
+     * `trace_fields` are rewritten, so this also does nothing and returns
+     * false unless every object in the region provides them.
+     *
+     * Objects in a block are freed with it, once all of them are dead, or
+     * when the region is compacted again.  A compacted region is frozen in
+     * place, into a single SCC, as an arena region is.
+     **/
+    static bool compact(Alloc* alloc, Object* o)
+    {
+      assert(o->debug_is_iso());
+      RegionTrace* reg = get(o);
+
+      if (!reg->ExternalReferenceTable::empty())
+        return false;
+
+      gc(alloc, o);
+
+      Systematic::cout() << "Region compact: " << o << std::endl;
+      return reg->relocate(alloc, o);
+    }
+
+  private:
+    /**
+     * Releases the regions whose iso objects are in `collect`, which were
+     * referred to only by objects a collection has freed.
+     **/
+    void release_subregions(Alloc* alloc, ObjectStack& f, ObjectStack& collect)
+    {
       // `collect` contains all the iso objects to unreachable subregions.
       // Since they are unreachable, we can just release them.
       while (!collect.empty())
       {
-        o = collect.pop();
+        Object* o = collect.pop();
         assert(o->debug_is_iso());
         Systematic::cout() << "Region GC: releasing unreachable subregion: "
                            << o << std::endl;
@@ -245,7 +760,7 @@ namespace verona::rt
         // Note that we need to dispatch because `r` is a different region
         // metadata object.
         RegionBase* r = o->get_region();
-        assert(r != reg);
+        assert(r != this);
 
         // Unfortunately, we can't use Region::release_internal because of a
         // circular dependency between header files.
@@ -258,7 +773,6 @@ namespace verona::rt
       }
     }
 
-  private:
     inline void append(Object* hd)
     {
       append(hd, hd);
@@ -304,11 +818,19 @@ namespace verona::rt
         append(head, other->last_not_root);
 
       // Update memory usage.
-      current_memory_used += other->current_memory_used;
+      merge_usage(other);
+      previous_memory_used += other->previous_memory_used;
 
-      previous_memory_used = size_to_sizeclass(
-        sizeclass_to_size(other->previous_memory_used) +
-        sizeclass_to_size(other->previous_memory_used));
+      // Take over the other region's compacted blocks.
+      if (other->blocks != nullptr)
+      {
+        CompactBlock* b = other->blocks;
+        while (b->next != nullptr)
+          b = b->next;
+        b->next = blocks;
+        blocks = other->blocks;
+        other->blocks = nullptr;
+      }
     }
 
     void swap_root_internal(Object* oroot, Object* nroot)
@@ -348,6 +870,9 @@ namespace verona::rt
 
       nroot->init_iso();
       nroot->set_region(this);
+
+      if (deferred_iso != nullptr)
+        deferred_iso = nroot;
     }
 
     /**
@@ -356,10 +881,29 @@ namespace verona::rt
      **/
     void mark(Alloc* alloc, Object* o, ObjectStack& dfs, size_t& marked)
     {
+      size_t budget = SIZE_MAX;
       o->trace(dfs);
-      while (!dfs.empty())
+      mark_objects(alloc, dfs, marked, budget);
+    }
+
+    /**
+     * Marks the objects on `dfs` and everything reachable from them, taking
+     * at most `budget` objects off `dfs`.  Returns true if `dfs` is empty.
+     * Objects are prefetched a few visits before they are examined, see
+     * `PrefetchQueue`.
+     **/
+    bool mark_objects(
+      Alloc* alloc, ObjectStack& dfs, size_t& marked, size_t& budget)
+    {
+      ObjectPrefetchQueue queue(dfs);
+
+      while (!queue.empty())
       {
-        Object* p = dfs.pop();
+        if (budget == 0)
+          return false;
+
+        budget--;
+        Object* p = queue.pop();
         switch (p->get_class())
         {
           case Object::ISO:
@@ -385,6 +929,8 @@ namespace verona::rt
             assert(0);
         }
       }
+
+      return true;
     }
 
     /**
@@ -399,28 +945,58 @@ namespace verona::rt
       ObjectStack& collect,
       size_t marked)
     {
-      current_memory_used = 0;
-      sweep_ring<FinaliserRing>(alloc, o, f, collect);
-      sweep_ring<NonfinaliserRing>(alloc, o, f, collect);
+      size_t budget = SIZE_MAX;
+      usage = {};
+
+      auto finaliser_ring = sweep_cursor<FinaliserRing>(o);
+      sweep_ring<FinaliserRing>(alloc, o, f, collect, finaliser_ring, budget);
+
+      auto nonfinaliser_ring = sweep_cursor<NonfinaliserRing>(o);
+      sweep_ring<NonfinaliserRing>(
+        alloc, o, f, collect, nonfinaliser_ring, budget);
+
       hash_set->sweep_set(alloc, marked);
-      previous_memory_used = size_to_sizeclass(current_memory_used);
+      previous_memory_used = usage.bytes;
     }
 
     template<RingKind ring>
-    void
-    sweep_ring(Alloc* alloc, Object* o, ObjectStack& f, ObjectStack& collect)
+    static bool in_secondary_ring(Object* o)
     {
       static_assert(ring != BothRings);
 
-      bool in_secondary_ring;
       if constexpr (ring == FinaliserRing)
-        in_secondary_ring = !o->needs_finaliser_ring();
+        return !o->needs_finaliser_ring();
       else
-        in_secondary_ring = o->needs_finaliser_ring();
+        return o->needs_finaliser_ring();
+    }
+
+    template<RingKind ring>
+    SweepCursor sweep_cursor(Object* o)
+    {
+      return {this, in_secondary_ring<ring>(o) ? next_not_root : get_next()};
+    }
 
-      Object* prev = this;
-      Object* p = in_secondary_ring ? next_not_root : get_next();
-      Object* gc = nullptr;
+    /**
+     * Sweeps `ring` from `cursor`, visiting at most `budget` objects, and
+     * returns true if that finished the ring.
+     *
+     * A full sweep recounts the memory used by the objects it keeps.  An
+     * incremental one instead takes the objects it frees off the count, as
+     * it is not visiting objects allocated since the collection started.
+     **/
+    template<RingKind ring, bool incremental = false>
+    bool sweep_ring(
+      Alloc* alloc,
+      Object* o,
+      ObjectStack& f,
+      ObjectStack& collect,
+      SweepCursor& cursor,
+      size_t& budget)
+    {
+      bool in_secondary_ring = RegionTrace::in_secondary_ring<ring>(o);
+      Object* prev = cursor.prev;
+      Object* p = cursor.p;
+      Object* gc = cursor.finalised;
 
       if constexpr (ring != FinaliserRing)
         UNUSED(gc);
@@ -429,6 +1005,13 @@ namespace verona::rt
       // deallocate objects from the rings.
       while (p != this)
       {
+        if (budget == 0)
+        {
+          cursor = {prev, p, gc};
+          return false;
+        }
+
+        budget--;
         switch (p->get_class())
         {
           case Object::ISO:
@@ -438,14 +1021,16 @@ namespace verona::rt
             assert(p == o);
             assert(p->get_next_any_mark() == this);
             assert(p->get_region() == this);
-            use_memory(p->size());
+            if constexpr (!incremental)
+              use_memory(p->size());
             p = this;
             break;
           }
 
           case Object::MARKED:
           {
-            use_memory(p->size());
+            if constexpr (!incremental)
+              use_memory(p->size());
             p->unmark();
             prev = p;
             p = p->get_next();
@@ -456,12 +1041,18 @@ namespace verona::rt
           {
             Object* q = p->get_next();
 
+            if constexpr (incremental)
+              free_memory(p->size());
+
             if constexpr (ring == FinaliserRing)
             {
               p->find_iso_fields(o, f, collect);
               if (p->has_finaliser())
                 p->finalise();
 
+              if (p->has_ext_ref())
+                ExternalReferenceTable::erase(p);
+
               // Build up linked list of objects with finalisers.
               // We'll deallocate them after sweeping through the entire ring.
               p->set_next(gc);
@@ -478,7 +1069,7 @@ namespace verona::rt
               if (p->has_ext_ref())
                 ExternalReferenceTable::erase(p);
 
-              p->dealloc(alloc);
+              dealloc_object(alloc, p);
             }
 
             if (prev == this && in_secondary_ring)
@@ -504,10 +1095,164 @@ namespace verona::rt
         while (p != nullptr)
         {
           Object* q = p->get_next();
-          p->dealloc(alloc);
+          dealloc_object(alloc, p);
           p = q;
         }
       }
+
+      cursor = {prev, this};
+      return true;
+    }
+
+    /**
+     * Runs a slice of an incremental collection, starting one if none is in
+     * progress, and returns true if the collection finished, in which case
+     * `reclaimed` is the number of bytes it freed.  See `gc_step`.
+     *
+     * The collection keeps everything that was reachable from `o` when it
+     * started (a snapshot), as well as everything allocated since.  Marking
+     * starts from `o`, and the write barrier adds the objects that fields
+     * referred to before they were overwritten.  Objects allocated while
+     * marking, or before the sweep reaches their ring, are allocated marked,
+     * and so are remembered set entries added while the collection runs.
+     **/
+    bool gc_slice(Alloc* alloc, Object* o, size_t budget, size_t& reclaimed)
+    {
+      IncrementalGC* s = incremental;
+
+      if (s == nullptr)
+      {
+        Systematic::cout() << "Region incremental GC started for: " << o
+                           << std::endl;
+        s = new (alloc->alloc<sizeof(IncrementalGC)>()) IncrementalGC;
+        incremental = s;
+
+        ObjectStack dfs(alloc);
+        o->trace(dfs);
+        s->gray.move_from(alloc, dfs);
+      }
+
+      if (s->phase == IncrementalGC::Mark)
+      {
+        ObjectStack dfs(alloc);
+        s->gray.move_to(dfs);
+
+        if (!mark_objects(alloc, dfs, s->marked, budget))
+        {
+          s->gray.move_from(alloc, dfs);
+          return false;
+        }
+
+        Systematic::cout() << "Region incremental GC sweeping: " << o
+                           << std::endl;
+        s->phase = IncrementalGC::Sweep;
+        s->ring = FinaliserRing;
+        s->cursor = sweep_cursor<FinaliserRing>(o);
+      }
+
+      ObjectStack f(alloc);
+      ObjectStack collect(alloc);
+      size_t before = usage.bytes;
+      bool finished = true;
+
+      if (s->ring == FinaliserRing)
+      {
+        finished = sweep_ring<FinaliserRing, true>(
+          alloc, o, f, collect, s->cursor, budget);
+
+        if (finished)
+        {
+          s->ring = NonfinaliserRing;
+          s->cursor = sweep_cursor<NonfinaliserRing>(o);
+        }
+      }
+
+      if (finished)
+      {
+        finished = sweep_ring<NonfinaliserRing, true>(
+          alloc, o, f, collect, s->cursor, budget);
+      }
+
+      s->reclaimed += before - usage.bytes;
+
+      if (!finished)
+      {
+        s->collect.move_from(alloc, collect);
+        return false;
+      }
+
+      Systematic::cout() << "Region incremental GC finished for: " << o
+                         << std::endl;
+      s->collect.move_to(collect);
+      hash_set->sweep_set(alloc, s->marked);
+      previous_memory_used = usage.bytes;
+      reclaimed = s->reclaimed;
+
+      s->gray.dealloc(alloc);
+      s->collect.dealloc(alloc);
+      alloc->dealloc<sizeof(IncrementalGC)>(s);
+      incremental = nullptr;
+
+      release_subregions(alloc, f, collect);
+      return true;
+    }
+
+    /**
+     * Finishes the incremental collection of this region, whose iso object
+     * is `o`, if one is in progress.  As the collection keeps everything
+     * allocated since it started, this is safe at any point, unlike starting
+     * one.
+     **/
+    void finish_incremental_gc(Alloc* alloc, Object* o)
+    {
+      size_t reclaimed;
+      if (incremental != nullptr)
+        gc_slice(alloc, o, SIZE_MAX, reclaimed);
+    }
+
+    /**
+     * Records that `old`, which a field of an object in this region referred
+     * to, is being unlinked while an incremental collection is in progress.
+     **/
+    void shade(Alloc* alloc, Object* o, Object* old)
+    {
+      if (incremental->phase != IncrementalGC::Mark)
+        return;
+
+      if (old->get_class() == Object::ISO)
+        return;
+
+      incremental->gray.push(alloc, old);
+
+      // Carry on marking at the end of this behaviour.
+      if ((deferred_iso == nullptr) && deferred().enabled)
+        defer_gc(o);
+    }
+
+    /**
+     * Makes sure the incremental collection in progress keeps `p`, which has
+     * just been added to the front of its ring.
+     **/
+    void allocated_during_gc(Object* p)
+    {
+      IncrementalGC* s = incremental;
+      RingKind ring =
+        p->needs_finaliser_ring() ? FinaliserRing : NonfinaliserRing;
+
+      // The sweep will reach `p`, so mark it.
+      if (
+        (s->phase == IncrementalGC::Mark) ||
+        ((s->ring == FinaliserRing) && (ring == NonfinaliserRing)))
+      {
+        p->mark();
+        return;
+      }
+
+      // Otherwise `p` is behind the sweep, right after the region metadata
+      // object.  If the sweep has not kept anything in this ring yet, unlink
+      // objects from `p` rather than from the metadata object.
+      if ((s->ring == ring) && (s->cursor.prev == this))
+        s->cursor.prev = p;
     }
 
     /**
@@ -523,19 +1268,417 @@ namespace verona::rt
 
       Systematic::cout() << "Region release: trace region: " << o << std::endl;
 
+      // Finish a collection in progress first, rather than drop it.  The
+      // sweep below frees every object that is not marked, so the marks the
+      // collection has made would have to be undone, along with those in the
+      // remembered set, and the subregions it found unreachable released.
+      // Finishing does all of that, at the cost of the rest of a collection
+      // that had already started.
+      finish_incremental_gc(alloc, o);
+
       o->find_iso_fields(o, f, collect);
       o->finalise();
 
       sweep(alloc, o, f, collect, 0);
+
+      // Note that sweep does not deallocate the iso object!  It may be in a
+      // compacted block, if the root was swapped, so free it while the
+      // region still knows about its blocks.
+      dealloc_object(alloc, o);
       dealloc(alloc);
+    }
+
+    /**
+     * Deallocates `p`, which is in this region, unless it is in a compacted
+     * block, in which case the block is deallocated once all of its objects
+     * have been.
+     **/
+    void dealloc_object(Alloc* alloc, Object* p)
+    {
+      for (CompactBlock** b = &blocks; *b != nullptr; b = &(*b)->next)
+      {
+        if ((*b)->contains(p))
+        {
+          if (--(*b)->live == 0)
+          {
+            CompactBlock* dead = *b;
+            *b = dead->next;
+            dead->dealloc(alloc);
+          }
+          return;
+        }
+      }
+
+      p->dealloc(alloc);
+    }
+
+    /**
+     * Moves every object in the region, other than the iso object `o`, into a
+     * new block, in the order a depth-first traversal from `o` reaches them,
+     * and rewrites the fields that refer to them.
+     *
+     * Every object in the region must be reachable from `o`, so this must
+     * follow a collection.  Nothing is moved, and false is returned, if any
+     * of the objects cannot report its fields.
+     **/
+    bool relocate(Alloc* alloc, Object* o)
+    {
+      ObjectStack dfs(alloc);
+      ObjectStack order(alloc);
+      size_t count = 0;
+      size_t bytes = 0;
+      bool movable = o->has_trace_fields();
+
+      // Find the objects in traversal order, marking them so each is only
+      // found once.
+      o->trace(dfs);
+      while (!dfs.empty())
+      {
+        Object* p = dfs.pop();
+        if (p->get_class() != Object::UNMARKED)
+          continue;
+
+        p->mark();
+        p->trace(dfs);
+        order.push(p);
+        count++;
+        bytes += snmalloc::bits::align_up(p->size(), Object::ALIGNMENT);
+        movable = movable && p->has_trace_fields();
+      }
+
+      if (!movable)
+      {
+        while (!order.empty())
+          order.pop()->unmark();
+        return false;
+      }
+
+      CompactBlock* old_blocks = blocks;
+      CompactBlock* block = nullptr;
+      uintptr_t cursor = 0;
+
+      if (count > 0)
+      {
+        block = CompactBlock::make(alloc, bytes, count);
+        cursor = block->end();
+      }
+
+      // Rebuild the rings with just the iso object, and add each copy as it
+      // is made.  Copies are made, and added to the front of the rings, in
+      // the reverse of traversal order, so both end up in traversal order.
+      init_next(o);
+      next_not_root = this;
+      last_not_root = this;
+
+      ObjectStack moved(alloc);
+      while (!order.empty())
+      {
+        Object* p = order.pop();
+        size_t size = p->size();
+        cursor -= snmalloc::bits::align_up(size, Object::ALIGNMENT);
+        auto q = (Object*)cursor;
+
+        assert(Object::debug_is_aligned(q));
+        memcpy((void*)q, (void*)p, size);
+        append(q);
+
+        // Leave a forwarding pointer in the original.
+        p->init_next(q);
+        p->mark();
+        moved.push(p);
+      }
+
+      assert((block == nullptr) || (cursor == block->begin()));
+
+      // Point the fields of the copies, and of the iso object, at the copies.
+      FieldStack f(alloc);
+      relocate_fields(o, f);
+
+      ObjectStack originals(alloc);
+      while (!moved.empty())
+      {
+        Object* p = moved.pop();
+        relocate_fields(p->get_next_any_mark(), f);
+        originals.push(p);
+      }
+
+      // Free the originals, and the blocks they were in.
+      while (!originals.empty())
+      {
+        Object* p = originals.pop();
+        bool in_block = false;
+
+        for (CompactBlock* b = old_blocks; b != nullptr; b = b->next)
+          in_block = in_block || b->contains(p);
+
+        if (!in_block)
+          p->dealloc(alloc);
+      }
+
+      blocks = block;
+
+      // If the root was swapped to an object in a block, that block has to
+      // stay until the root is freed.
+      while (old_blocks != nullptr)
+      {
+        CompactBlock* b = old_blocks;
+        old_blocks = b->next;
+
+        if (b->contains(o))
+        {
+          b->live = 1;
+          b->next = blocks;
+          blocks = b;
+        }
+        else
+        {
+          b->dealloc(alloc);
+        }
+      }
+
+      return true;
+    }
+
+    /**
+     * Rewrites the fields of `q` that refer to objects `relocate` has moved,
+     * which are marked and hold a forwarding pointer.
+     **/
+    static void relocate_fields(Object* q, FieldStack& f)
+    {
+      q->trace_fields(f);
+      while (!f.empty())
+      {
+        Object** field = f.pop();
+        Object* p = *field;
+        if ((p != nullptr) && (p->get_class() == Object::MARKED))
+          *field = p->get_next_any_mark();
+      }
+    }
+
+    /**
+     * Freezes this compacted region, whose iso object is `o`, in place, into
+     * a single SCC whose root is the region metadata object, as the objects
+     * in its blocks cannot be freed one at a time.  The iso objects of the
+     * regions nested in it are pushed onto `iso`, to be frozen by the caller.
+     **/
+    void freeze_internal(Alloc* alloc, Object* o, ObjectStack& iso)
+    {
+      assert(o->debug_is_iso());
+      assert(blocks != nullptr);
+
+      // Afterwards, every object in the region is reachable, so is frozen.
+      gc(alloc, o);
+      Systematic::cout() << "Freeze: compacted trace region: " << o
+                         << std::endl;
+
+      // Freezing overwrites the headers that link the rings, so move the
+      // objects to an array first.
+      frozen_count = 0;
+      for (auto p : *this)
+      {
+        UNUSED(p);
+        frozen_count++;
+      }
+
+      frozen = (Object**)alloc->alloc(frozen_count * sizeof(Object*));
+      size_t i = 0;
+      for (auto p : *this)
+        frozen[i++] = p;
+
+      // Point each object at the region metadata object, and count the
+      // references out of the region.
+      ObjectStack dfs(alloc);
+      dfs.push(o);
+
+      while (!dfs.empty())
+      {
+        Object* q = dfs.pop();
+
+        switch (q->get_class())
+        {
+          case Object::ISO:
+          {
+            if (q != o)
+            {
+              iso.push(q);
+              break;
+            }
+            [[fallthrough]];
+          }
+
+          case Object::UNMARKED:
+          {
+            q->clear_has_ext_ref();
+            q->set_scc(this);
+            q->trace(dfs);
+            break;
+          }
+
+          case Object::SCC_PTR:
+          {
+            if (q->get_scc() != this)
+              q->immutable()->incref();
+            break;
+          }
+
+          case Object::RC:
+          case Object::COWN:
+          {
+            q->incref();
+            break;
+          }
+
+          default:
+            assert(0);
+        }
+      }
+
+      // The references out of the region are now counted by the SCC, so the
+      // remembered set can drop its own.
+      RememberedSet::discard(alloc);
+      RememberedSet::dealloc(alloc);
+      ExternalReferenceTable::dealloc(alloc);
+
+      set_descriptor(frozen_desc());
+      make_scc();
+    }
+
+    /**
+     * Returns true if `p` is one of the objects of this region, which has
+     * been frozen.
+     **/
+    bool is_frozen(Object* p)
+    {
+      return (p->get_class() == Object::SCC_PTR) && (p->get_scc() == this);
+    }
+
+    /**
+     * Traces the references out of a frozen compacted region, i.e. all the
+     * fields of its objects that do not refer to another of its objects.
+     **/
+    static void frozen_trace(const Object* o, ObjectStack* st)
+    {
+      auto reg = (RegionTrace*)o;
+      ObjectStack f(ThreadAlloc::get());
+
+      for (size_t i = 0; i < reg->frozen_count; i++)
+      {
+        reg->frozen[i]->trace(f);
+        while (!f.empty())
+        {
+          Object* q = f.pop();
+          if (!reg->is_frozen(q))
+            st->push(q);
+        }
+      }
+    }
+
+    /**
+     * Finalises the objects of a frozen compacted region and frees them,
+     * along with their blocks, apart from the region metadata object itself.
+     **/
+    static void frozen_finalise(Object* o)
+    {
+      auto reg = (RegionTrace*)o;
+      auto* alloc = ThreadAlloc::get();
+
+      for (size_t i = 0; i < reg->frozen_count; i++)
+        reg->frozen[i]->finalise();
+
+      for (size_t i = 0; i < reg->frozen_count; i++)
+        reg->dealloc_object(alloc, reg->frozen[i]);
+
+      assert(reg->blocks == nullptr);
+      alloc->dealloc(reg->frozen, reg->frozen_count * sizeof(Object*));
+    }
+
+    /**
+     * Defers a collection of this region, whose iso object is `o`, if the
+     * GC policy says it has grown enough since its last collection, or if it
+     * has gone over its quota.  If the last collection left the region over
+     * its quota, it has to grow by `OVER_QUOTA_GROWTH_FACTOR` first, so that
+     * the live objects of a region that does not fit are not traced again
+     * by every behaviour that allocates in it.
+     **/
+    void check_gc_trigger(Object* o)
+    {
+      auto& policy = gc_policy();
+
+      if ((deferred_iso != nullptr) || !deferred().enabled)
+        return;
+
+      // Carry on an incremental collection at the end of this behaviour.
+      if (incremental != nullptr)
+      {
+        defer_gc(o);
+        return;
+      }
+
+      size_t threshold = SIZE_MAX;
+      if (policy.growth_factor != 0)
+      {
+        threshold = std::max(
+          policy.min_bytes, previous_memory_used * policy.growth_factor);
+      }
+
+      if (quota != 0)
+      {
+        size_t limit = quota;
+        if (previous_memory_used > quota)
+          limit = previous_memory_used * OVER_QUOTA_GROWTH_FACTOR;
+
+        threshold = std::min(threshold, limit);
+      }
+
+      if (usage.bytes <= threshold)
+        return;
+
+      Systematic::cout() << "Region GC deferred for: " << o << " ("
+                         << usage.bytes << " bytes)" << std::endl;
+
+      defer_gc(o);
+      auto_gc_stats().triggered++;
+    }
+
+    /**
+     * Adds this region, whose iso object is `o`, to this thread's list of
+     * deferred collections.
+     **/
+    void defer_gc(Object* o)
+    {
+      auto& d = deferred();
+      deferred_iso = o;
+      deferred_next = d.head;
+      deferred_prev = &d.head;
+      if (deferred_next != nullptr)
+        deferred_next->deferred_prev = &deferred_next;
+      d.head = this;
+    }
+
+    /**
+     * Removes this region from the list of deferred collections it is on, if
+     * any.
+     **/
+    void cancel_deferred_gc()
+    {
+      if (deferred_iso == nullptr)
+        return;
+
+      *deferred_prev = deferred_next;
+      if (deferred_next != nullptr)
+        deferred_next->deferred_prev = deferred_prev;
 
-      // Note that sweep does not deallocate the iso object!
-      o->dealloc(alloc);
+      deferred_iso = nullptr;
+      deferred_next = nullptr;
+      deferred_prev = nullptr;
     }
 
-    void use_memory(size_t size)
+    inline void dealloc(Alloc* alloc)
     {
-      current_memory_used += size;
+      assert(blocks == nullptr);
+      assert(incremental == nullptr);
+      cancel_deferred_gc();
+      RegionBase::dealloc(alloc);
     }
 
   public:
@@ -102,16 +102,20 @@ namespace verona::rt
       }
     }
 
+    /**
+     * If `marked` is not null, the entry for `o` is also marked, as if by
+     * `mark`.
+     **/
     template<TransferOwnership transfer>
-    void insert(Alloc* alloc, Object* o)
+    void insert(Alloc* alloc, Object* o, size_t* marked = nullptr)
     {
       // If o is not present, add it and o->incref().
       assert(o->debug_is_rc() || o->debug_is_cown());
 
-      size_t dummy;
+      size_t index;
 
       HashSetEntry entry{o};
-      if (hash_set->insert(alloc, entry, dummy))
+      if (hash_set->insert(alloc, entry, index))
       {
         assert(entry.o == nullptr);
         // If the caller is not transfering ownership of a refcount, i.e., the
@@ -129,6 +133,9 @@ namespace verona::rt
         if constexpr (transfer == YesTransfer)
           o->decref();
       }
+
+      if (marked != nullptr)
+        hash_set->mark_slot(index, *marked);
     }
 
     void mark(Alloc* alloc, Object* o, size_t& marked)
@@ -0,0 +1,130 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include <algorithm>
+#include <snmalloc.h>
+
+namespace verona::rt
+{
+  using namespace snmalloc;
+
+  /**
+   * Determines how many messages a cown processes in `Cown::run` before it
+   * yields back to the scheduler thread.
+   *
+   *   Fixed
+   *     At most `count` messages are processed per batch.
+   *
+   *   TimeBudget
+   *     Messages are processed until `budget` ticks have elapsed since the
+   *     start of the batch.  This reads the timestamp counter after every
+   *     message.
+   *
+   *   Adaptive
+   *     The batch size is derived from the recent cost per message, so that a
+   *     batch is expected to take about `budget` ticks.  The timestamp counter
+   *     is only read at the start and end of each batch.
+   *
+   * The time based policies make scheduling decisions that depend on the
+   * timestamp counter, so they are not reproducible under systematic testing.
+   **/
+  class BatchPolicy
+  {
+  public:
+    enum Kind : uint8_t
+    {
+      Fixed,
+      TimeBudget,
+      Adaptive
+    };
+
+    static constexpr uint32_t DEFAULT_COUNT = 100;
+    static constexpr uint32_t MAX_ADAPTIVE_COUNT = 10'000;
+    static constexpr uint64_t DEFAULT_BUDGET = 100'000;
+
+  private:
+    Kind kind;
+
+    // For Fixed this is the batch size.  For Adaptive this is the current
+    // estimate of the batch size that fits in the budget.
+    uint32_t count;
+
+    uint64_t budget;
+
+    constexpr BatchPolicy(Kind kind, uint32_t count, uint64_t budget)
+    : kind(kind), count(count), budget(budget)
+    {}
+
+  public:
+    // Trivial, so that constructing a cown does not overwrite the policy it
+    // was given on allocation.
+    BatchPolicy() = default;
+
+    static constexpr BatchPolicy fixed(uint32_t count = DEFAULT_COUNT)
+    {
+      return {Fixed, count == 0 ? 1 : count, 0};
+    }
+
+    static constexpr BatchPolicy time_budget(uint64_t ticks = DEFAULT_BUDGET)
+    {
+      return {TimeBudget, 0, ticks};
+    }
+
+    static constexpr BatchPolicy adaptive(uint64_t ticks = DEFAULT_BUDGET)
+    {
+      return {Adaptive, DEFAULT_COUNT, ticks};
+    }
+
+    Kind get_kind() const
+    {
+      return kind;
+    }
+
+    /**
+     * Called at the start of a batch.  Returns the timestamp that should be
+     * passed to the other methods for this batch.
+     **/
+    uint64_t start() const
+    {
+      return kind == Fixed ? 0 : Aal::tick();
+    }
+
+    /**
+     * Returns true if the batch that began at `start` may process another
+     * message, having already processed `n`.
+     **/
+    bool within_budget(size_t n, uint64_t start) const
+    {
+      switch (kind)
+      {
+        case TimeBudget:
+          return (n == 0) || ((Aal::tick() - start) < budget);
+
+        case Fixed:
+        case Adaptive:
+        default:
+          return n < count;
+      }
+    }
+
+    /**
+     * Called at the end of a batch of `n` messages that began at `start`.
+     * Updates the adaptive estimate of the batch size.
+     **/
+    void end(size_t n, uint64_t start)
+    {
+      if ((kind != Adaptive) || (n == 0))
+        return;
+
+      uint64_t elapsed = Aal::tick() - start;
+      uint64_t cost = std::max<uint64_t>(elapsed / n, 1);
+      uint64_t target = std::min<uint64_t>(
+        std::max<uint64_t>(budget / cost, 1), MAX_ADAPTIVE_COUNT);
+
+      // Smooth the estimate, so a single slow message does not collapse the
+      // batch size.
+      count = (uint32_t)((count + target + 1) / 2);
+    }
+  };
+} // namespace verona::rt
@@ -7,6 +7,7 @@
 #include "../region/region.h"
 #include "../test/systematic.h"
 #include "base_noticeboard.h"
+#include "batchpolicy.h"
 #include "multimessage.h"
 #include "schedulerthread.h"
 
@@ -26,8 +27,6 @@ namespace verona::rt
 
   class Cown : public Object
   {
-    static constexpr size_t BATCH_COUNT = 100;
-
   public:
     enum TryFastSend
     {
@@ -48,11 +47,10 @@ namespace verona::rt
 
     static constexpr auto NO_EPOCH_SET = (std::numeric_limits<uint64_t>::max)();
 
-    union
-    {
-      std::atomic<Cown*> next_in_queue;
-      uint64_t epoch_when_popped = NO_EPOCH_SET;
-    };
+    // These are not in a union, as a thread stealing a run of cowns may read
+    // the link of a cown that has just been popped by someone else.
+    std::atomic<Cown*> next_in_queue;
+    uint64_t epoch_when_popped = NO_EPOCH_SET;
 
     // Five pointer overhead compared to an object.
     verona::rt::MPSCQ<MultiMessage> queue;
@@ -68,6 +66,42 @@ namespace verona::rt
      **/
     std::atomic<size_t> weak_count = 1;
 
+    /**
+     * Determines how many messages are processed each time this cown is
+     * scheduled.  Only accessed by the thread currently running the cown.
+     **/
+    BatchPolicy batch_policy;
+
+    /**
+     * State for generational leak detection.
+     *
+     *   LD_PROMOTED
+     *     The cown has survived enough leak detections that a minor leak
+     *     detection neither traces nor collects it.
+     *
+     *   LD_DIRTY
+     *     A behaviour has run on the cown since it was last traced.
+     *
+     *   LD_HOLDS_YOUNG
+     *     The cown held an unpromoted cown when it was last traced.
+     *
+     * A promoted cown that is dirty, or holds young cowns, is in the
+     * remembered set, and is traced by a minor leak detection.  A new cown
+     * starts dirty, as it has not been traced yet.
+     **/
+    enum : uint8_t
+    {
+      LD_PROMOTED = 1 << 0,
+      LD_DIRTY = 1 << 1,
+      LD_HOLDS_YOUNG = 1 << 2
+    };
+
+    std::atomic<uint8_t> ld_flags = LD_DIRTY;
+
+    /// Leak detections survived, until promotion.  Only accessed by the sweep
+    /// of the thread whose `list` holds this cown.
+    uint8_t ld_age = 0;
+
     static Cown* create_token_cown()
     {
       static constexpr Descriptor desc = {
@@ -108,17 +142,25 @@ namespace verona::rt
 #endif
 
     template<size_t size>
-    static Cown* alloc(Alloc* alloc, const Descriptor* desc, EpochMark epoch)
+    static Cown* alloc(
+      Alloc* alloc,
+      const Descriptor* desc,
+      EpochMark epoch,
+      BatchPolicy policy = BatchPolicy::fixed())
     {
       Cown* a = (Cown*)alloc->alloc<size>();
-      a->init(alloc, desc, epoch);
+      a->init(alloc, desc, epoch, policy);
       return a;
     }
 
-    static Cown* alloc(Alloc* alloc, const Descriptor* desc, EpochMark epoch)
+    static Cown* alloc(
+      Alloc* alloc,
+      const Descriptor* desc,
+      EpochMark epoch,
+      BatchPolicy policy = BatchPolicy::fixed())
     {
       Cown* a = (Cown*)alloc->alloc(desc->size);
-      a->init(alloc, desc, epoch);
+      a->init(alloc, desc, epoch, policy);
       return a;
     }
 
@@ -193,6 +235,48 @@ namespace verona::rt
       return false;
     }
 
+    /**
+     * Sets the policy used to batch messages on this cown.
+     *
+     * This should only be called while this cown is acquired, or before it is
+     * shared, as the policy is read and updated without synchronisation by the
+     * thread running the cown.
+     **/
+    void set_batch_policy(BatchPolicy policy)
+    {
+      batch_policy = policy;
+    }
+
+    BatchPolicy get_batch_policy()
+    {
+      return batch_policy;
+    }
+
+    /**
+     * Returns the memory owned by the regions this cown refers to, including
+     * the regions nested in them, so that memory can be attributed to the
+     * cown that owns it.  Immutable objects, and other cowns, are not
+     * counted.
+     *
+     * This should only be called while this cown is acquired, or before it is
+     * shared, as the regions may otherwise be changing.
+     **/
+    RegionBase::MemoryUsage memory_used(Alloc* alloc)
+    {
+      RegionBase::MemoryUsage total;
+      ObjectStack f(alloc);
+      trace(f);
+
+      while (!f.empty())
+      {
+        Object* o = f.pop();
+        if (o->get_class() == RegionMD::ISO)
+          total += Region::memory_used_with_subregions(alloc, o);
+      }
+
+      return total;
+    }
+
     void wake()
     {
       queue.wake();
@@ -307,11 +391,47 @@ namespace verona::rt
     static void mark_for_scan(Object* o, EpochMark epoch)
     {
       Cown* cown = (Cown*)o;
+      CownThread* local = Scheduler::local();
 
-      if (cown->cown_marked_for_scan(epoch))
+      if (cown->ld_flags.load(std::memory_order_relaxed) & LD_PROMOTED)
+      {
+        // Anything this cown refers to is either promoted, or reached from
+        // the remembered set, which each thread scans in `enter_scan`.
+        if (local->ld_minor)
+        {
+          Systematic::cout() << "Promoted " << cown << std::endl;
+          local->stats.ld_skip();
+          return;
+        }
+      }
+      else
       {
-        Systematic::cout() << "Already marked " << cown << " ("
-                           << cown->get_epoch_mark() << ")" << std::endl;
+        local->ld_young_reached++;
+      }
+
+      cown->schedule_scan(epoch);
+    }
+
+    /**
+     * Called when a scan reaches an immutable that has already been scanned
+     * in this epoch.  The cowns behind it are not seen, so they are counted
+     * as unpromoted.
+     **/
+    static void scan_skipped_immutable()
+    {
+      Scheduler::local()->ld_young_reached++;
+    }
+
+    /**
+     * Marks this cown as reachable, and reschedules it so that it scans
+     * itself, unless that has already happened in this epoch.
+     **/
+    void schedule_scan(EpochMark epoch)
+    {
+      if (cown_marked_for_scan(epoch))
+      {
+        Systematic::cout() << "Already marked " << this << " ("
+                           << get_epoch_mark() << ")" << std::endl;
         return;
       }
 
@@ -319,11 +439,11 @@ namespace verona::rt
 
       // This may mark for scan something that has already been scanned, due
       // to racing over the epoch mark. This is ok.
-      cown->cown_mark_for_scan();
+      cown_mark_for_scan();
 
       yield();
 
-      cown->reschedule();
+      reschedule();
     }
 
     void mark_notify()
@@ -335,11 +455,16 @@ namespace verona::rt
       }
     }
 
-    void init(Alloc* alloc, const Descriptor* desc, EpochMark epoch)
+    void init(
+      Alloc* alloc,
+      const Descriptor* desc,
+      EpochMark epoch,
+      BatchPolicy policy = BatchPolicy::fixed())
     {
       make_cown();
       set_descriptor(desc);
       set_epoch(epoch);
+      batch_policy = policy;
       queue.init(stub_msg(alloc));
       CownThread* local = Scheduler::local();
 
@@ -362,12 +487,14 @@ namespace verona::rt
     {
       // This should only be called if the cown is known to have been
       // unscheduled, for example when detecting a previously empty message
-      // queue on send, or when rescheduling after a multimessage.
+      // queue on send, or when rescheduling after a multimessage.  On a
+      // scheduler thread the cown runs next, as whatever woke it up is likely
+      // to be waiting on it.
       CownThread* t = Scheduler::local();
 
       if (t != nullptr)
       {
-        t->schedule_fifo(this);
+        t->schedule_next(this);
         return;
       }
 
@@ -412,17 +539,72 @@ namespace verona::rt
       {
         cown_mark_scanned();
 
+        CownThread* local = Scheduler::local();
+        bool generational = Scheduler::get_ld_promotion_age() != 0;
+        size_t young = local->ld_young_reached;
+        local->stats.cown_scan();
+
+        // Behaviours cannot run on this cown while it is scanned, so any write
+        // after this will be seen by the next scan.
+        if (generational)
+          ld_flags.fetch_and((uint8_t)~LD_DIRTY);
+
         ObjectStack f(alloc);
         trace(f);
         scan_stack(alloc, epoch, f);
+
+        if (generational)
+        {
+          if (local->ld_young_reached != young)
+            ld_flags.fetch_or(LD_HOLDS_YOUNG);
+          else
+            ld_flags.fetch_and((uint8_t)~LD_HOLDS_YOUNG);
+        }
+      }
+    }
+
+    /**
+     * Called when a behaviour is about to run on this cown.
+     **/
+    void ld_written()
+    {
+      if ((ld_flags.load(std::memory_order_relaxed) & LD_DIRTY) == 0)
+        ld_flags.fetch_or(LD_DIRTY);
+    }
+
+    /**
+     * Called by the sweep of the thread whose `list` holds this cown, when it
+     * has survived a leak detection.
+     **/
+    void ld_survived(size_t promotion_age)
+    {
+      if (ld_flags.load(std::memory_order_relaxed) & LD_PROMOTED)
+        return;
+
+      if (++ld_age >= promotion_age)
+      {
+        Systematic::cout() << "Promoting " << this << std::endl;
+        ld_flags.fetch_or(LD_PROMOTED);
       }
     }
 
+    /**
+     * Returns true if this cown is promoted, but must still be traced by a
+     * minor leak detection.
+     **/
+    bool ld_remembered()
+    {
+      uint8_t f = ld_flags.load(std::memory_order_relaxed);
+      return (f & LD_PROMOTED) && (f & (LD_DIRTY | LD_HOLDS_YOUNG));
+    }
+
     static void scan_stack(Alloc* alloc, EpochMark epoch, ObjectStack& f)
     {
-      while (!f.empty())
+      ObjectPrefetchQueue queue(f);
+
+      while (!queue.empty())
       {
-        Object* o = f.pop();
+        Object* o = queue.pop();
         switch (o->get_class())
         {
           case RegionMD::ISO:
@@ -645,8 +827,26 @@ namespace verona::rt
         }
       }
 
-      // Run the action.
+      if (Scheduler::get_ld_promotion_age() != 0)
+      {
+        for (size_t i = 0; i < body.count; i++)
+          body.cowns[i]->ld_written();
+      }
+
+      // Run the action.  Collections of regions that grew while it ran are
+      // deferred until it has finished, when nothing on the stack can refer
+      // into them.
+      RegionTrace::begin_deferred_gc();
+#ifdef USE_SCHED_STATS
+      auto& stats = Scheduler::local()->stats;
+      uint64_t run_start = Aal::tick();
+      stats.behaviour_queued(run_start - body.scheduled);
+      body.action->f();
+      stats.behaviour_run(Aal::tick() - run_start);
+#else
       body.action->f();
+#endif
+      RegionTrace::end_deferred_gc(alloc);
 
       Systematic::cout() << "MultiMessage " << m << " completed and running on "
                          << cown << std::endl;
@@ -655,10 +855,9 @@ namespace verona::rt
       for (size_t i = 0; i < last; i++)
         body.cowns[i]->schedule();
 
-      // Free the destination array and the action
-      alloc->dealloc(body.cowns, body.count * sizeof(Cown*));
-      alloc->dealloc(body.action, body.action->size());
-      alloc->dealloc<sizeof(MultiMessage::MultiMessageBody)>(m->get_body());
+      // Release the action's reference to the envelope. The message slots
+      // keep it alive until they are retired from their cown queues.
+      MultiMessage::release_body(alloc, &body);
 
       return true;
     }
@@ -690,10 +889,24 @@ namespace verona::rt
       Systematic::cout() << "Schedule behaviour of type: "
                          << typeid(Behaviour).name() << std::endl;
 
+      // The body, message slots, sorted cowns and the action are all allocated
+      // together in a single behaviour envelope.
       Alloc* alloc = ThreadAlloc::get();
-      Behaviour* b = (Behaviour*)alloc->alloc<sizeof(Behaviour)>();
-      Action* action = new (b) Behaviour(std::forward<Args>(args)...);
-      Cown** sort = (Cown**)alloc->alloc(count * sizeof(Cown*));
+      auto body = MultiMessage::make_body(
+        alloc, count, sizeof(Behaviour), alignof(Behaviour));
+      Behaviour* b = (Behaviour*)body->action;
+      new (b) Behaviour(std::forward<Args>(args)...);
+
+      // The regions the behaviour captures are no longer this thread's to
+      // collect once it has been sent.
+      if (RegionTrace::has_deferred_gc())
+      {
+        ObjectStack f(alloc);
+        body->action->trace(f);
+        RegionTrace::cancel_deferred_gc_from(alloc, f);
+      }
+
+      Cown** sort = body->cowns;
       memcpy(sort, cowns, count * sizeof(Cown*));
 
 #ifdef USE_SYSTEMATIC_TESTING
@@ -710,8 +923,6 @@ namespace verona::rt
           Cown::acquire(sort[i]);
       }
 
-      auto body = MultiMessage::make_body(alloc, count, sort, action);
-
       // TODO what if this thread is external.
       //  EPOCH_A okay as currently only sending externally, before we start
       //  and thus its okay.
@@ -752,10 +963,25 @@ namespace verona::rt
 
       auto notified_called = false;
       auto notify = false;
+      auto& stats = Scheduler::local()->stats;
+      uint64_t batch_start = batch_policy.start();
+
+#ifdef USE_SCHED_STATS
+      if (stats.sample_queue_length())
+        stats.cown_dequeue(
+          queue.length(until, SchedulerStats::QUEUE_LENGTH_LIMIT));
+#endif
 
-      // Handle up to BATCH_COUNT messages.
-      for (size_t n = 0; n < BATCH_COUNT; n++)
+      // Handle messages until the batch policy runs out of budget.
+      for (size_t n = 0;; n++)
       {
+        if (!batch_policy.within_budget(n, batch_start))
+        {
+          batch_policy.end(n, batch_start);
+          stats.batch_budget();
+          break;
+        }
+
         assert(!queue.is_sleeping());
 
         MultiMessage* curr = queue.dequeue(alloc, notify);
@@ -768,6 +994,9 @@ namespace verona::rt
 
         if (curr == nullptr)
         {
+          batch_policy.end(n, batch_start);
+          stats.batch_empty();
+
           if (Scheduler::should_scan())
           {
             // We have hit null, and we should scan, then we know
@@ -833,6 +1062,8 @@ namespace verona::rt
         // TODO Back pressure, this should trigger back pressure on this cown.
         if (curr == until)
         {
+          batch_policy.end(n + 1, batch_start);
+          stats.batch_empty();
           break;
         }
       }
@@ -860,6 +1091,15 @@ namespace verona::rt
       if (in_epoch(epoch))
         return false;
 
+      // A minor leak detection does not trace promoted cowns, so keeps them.
+      if (
+        Scheduler::local()->ld_minor &&
+        (ld_flags.load(std::memory_order_relaxed) & LD_PROMOTED))
+      {
+        set_epoch_mark(epoch);
+        return false;
+      }
+
       // Check if the Cown is already collected
       if (thread != nullptr)
       {
@@ -878,7 +1118,9 @@ namespace verona::rt
 
     inline bool is_live(EpochMark send_epoch)
     {
-      return in_epoch(EpochMark::SCHEDULED_FOR_SCAN) || in_epoch(send_epoch);
+      return in_epoch(EpochMark::SCHEDULED_FOR_SCAN) || in_epoch(send_epoch) ||
+        (Scheduler::local()->ld_minor &&
+         (ld_flags.load(std::memory_order_relaxed) & LD_PROMOTED));
     }
 
     void collect(Alloc* alloc)
@@ -922,13 +1164,13 @@ namespace verona::rt
       }
 
       MultiMessage* last = queue.destroy();
-      alloc->dealloc<sizeof(MultiMessage)>(last);
+      last->dealloc(alloc);
     }
 
     static MultiMessage* stub_msg(Alloc* alloc)
     {
       // This is not a real message it is never sent or processed.
-      return MultiMessage::make_message(alloc, nullptr, EpochMark::EPOCH_NONE);
+      return MultiMessage::make_stub(alloc);
     }
   };
 
@@ -943,6 +1185,11 @@ namespace verona::rt
     {
       Cown::mark_for_scan(o, epoch);
     }
+
+    inline void scan_skipped_immutable()
+    {
+      Cown::scan_skipped_immutable();
+    }
   } // namespace cown
 } // namespace verona::rt
 
@@ -5,6 +5,7 @@
 #include <snmalloc.h>
 
 #if defined(__linux__)
+#  include <dirent.h>
 #  include <sched.h>
 #  include <stdio.h>
 #  include <stdlib.h>
@@ -36,11 +37,46 @@ namespace verona::rt
   using namespace snmalloc;
   class Topology
   {
+  public:
+    /**
+     * Where a CPU sits in the machine, used to prefer stealing work from
+     * nearby threads.
+     **/
+    struct Location
+    {
+      size_t numa_node;
+      size_t package;
+      size_t core;
+
+      enum Distance
+      {
+        // Hardware threads of the same physical core.
+        SameCore = 0,
+        // Different cores in the same package and NUMA node.
+        SameSocket = 1,
+        // Anything further away.
+        Remote = 2,
+        DistanceCount = 3
+      };
+
+      Distance distance(const Location& that) const
+      {
+        if ((numa_node != that.numa_node) || (package != that.package))
+          return Remote;
+
+        if (core != that.core)
+          return SameSocket;
+
+        return SameCore;
+      }
+    };
+
   private:
     struct CPU
     {
       size_t numa_node;
       size_t package;
+      size_t core;
       size_t group;
       size_t id;
       bool hyperthread;
@@ -99,17 +135,139 @@ namespace verona::rt
       uint32_t index = 0;
       uint32_t found = 0;
 
-      // TODO: CPU topology detection for Linux
       while (found < count)
       {
         if (CPU_ISSET(index, &all_cpus))
         {
-          cpus->push_back(CPU{0, 0, 0, index, false});
+          cpus->push_back(CPU{0, 0, index, 0, index, false});
           found++;
         }
 
         index++;
       }
+
+#if defined(__linux__)
+      get_linux_topology();
+#endif
+    }
+#endif
+
+#if defined(__linux__)
+    /**
+     * Reads a single non-negative integer from a sysfs file.  Returns false
+     * if the file does not exist or does not contain one.
+     **/
+    static bool read_sysfs(const char* path, size_t& result)
+    {
+      FILE* f = fopen(path, "r");
+
+      if (f == nullptr)
+        return false;
+
+      long value;
+      bool ok = (fscanf(f, "%ld", &value) == 1) && (value >= 0);
+      fclose(f);
+
+      if (ok)
+        result = (size_t)value;
+
+      return ok;
+    }
+
+    /**
+     * Calls `f` for each CPU in a sysfs cpu list, such as "0-3,8,10-11".
+     **/
+    template<typename F>
+    static void read_sysfs_cpulist(const char* path, F f)
+    {
+      FILE* file = fopen(path, "r");
+
+      if (file == nullptr)
+        return;
+
+      unsigned long first;
+      while (fscanf(file, "%lu", &first) == 1)
+      {
+        unsigned long last = first;
+        int c = fgetc(file);
+
+        if (c == '-')
+        {
+          if (fscanf(file, "%lu", &last) != 1)
+            break;
+          c = fgetc(file);
+        }
+
+        for (unsigned long i = first; i <= last; i++)
+          f((size_t)i);
+
+        if (c != ',')
+          break;
+      }
+
+      fclose(file);
+    }
+
+    /**
+     * Fills in the package, core, SMT and NUMA information for each CPU from
+     * /sys/devices/system/cpu and /sys/devices/system/node.  Anything that
+     * cannot be read is left as zero, which is the same as a flat topology.
+     **/
+    void get_linux_topology()
+    {
+      char path[128];
+
+      for (auto& cpu : *cpus)
+      {
+        snprintf(
+          path,
+          sizeof(path),
+          "/sys/devices/system/cpu/cpu%zu/topology/physical_package_id",
+          cpu.id);
+        read_sysfs(path, cpu.package);
+
+        snprintf(
+          path,
+          sizeof(path),
+          "/sys/devices/system/cpu/cpu%zu/topology/core_id",
+          cpu.id);
+        read_sysfs(path, cpu.core);
+
+        // Treat the first hardware thread of a core as the physical core, and
+        // the rest as hyperthreads.
+        snprintf(
+          path,
+          sizeof(path),
+          "/sys/devices/system/cpu/cpu%zu/topology/thread_siblings_list",
+          cpu.id);
+        size_t first_sibling;
+        if (read_sysfs(path, first_sibling))
+          cpu.hyperthread = first_sibling != cpu.id;
+      }
+
+      DIR* nodes = opendir("/sys/devices/system/node");
+
+      if (nodes == nullptr)
+        return;
+
+      while (dirent* entry = readdir(nodes))
+      {
+        size_t node;
+        if (sscanf(entry->d_name, "node%zu", &node) != 1)
+          continue;
+
+        snprintf(
+          path, sizeof(path), "/sys/devices/system/node/node%zu/cpulist", node);
+        read_sysfs_cpulist(path, [&](size_t id) {
+          for (auto& cpu : *cpus)
+          {
+            if (cpu.id == id)
+              cpu.numa_node = node;
+          }
+        });
+      }
+
+      closedir(nodes);
     }
 #endif
 
@@ -155,6 +313,7 @@ namespace verona::rt
               cpus->push_back(
                 CPU{get_numa_node(group, id, numa, numa_count),
                     get_package(group, id, package, package_count),
+                    i,
                     group,
                     id,
                     hyperthread});
@@ -196,7 +355,7 @@ namespace verona::rt
         cpus->reserve(core_count);
         for (uint32_t index = 0; index < core_count; index++)
         {
-          cpus->push_back(CPU{0, 0, 0, index, false});
+          cpus->push_back(CPU{0, 0, index, 0, index, false});
         }
       }
 #else
@@ -221,6 +380,15 @@ namespace verona::rt
       return cpus->at(index).get();
     }
 
+    Location location(size_t index)
+    {
+      if ((cpus == nullptr) || (cpus->size() == 0))
+        abort();
+
+      auto& cpu = cpus->at(index % cpus->size());
+      return {cpu.numa_node, cpu.package, cpu.core};
+    }
+
     size_t size()
     {
       if ((cpus == nullptr) || (cpus->size() == 0))
@@ -0,0 +1,142 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include "../ds/morebits.h"
+#include "../region/immutable.h"
+#include "epoch.h"
+
+#include <snmalloc.h>
+
+namespace verona::rt
+{
+  /**
+   * Deferred reference counting for immutable objects.
+   *
+   * `Immutable::acquire` and `Immutable::release` update the atomic reference
+   * count of the SCC root, so threads that repeatedly read the same frozen
+   * graph all contend on one cache line.  `DeferredRC::acquire` and
+   * `DeferredRC::release` instead keep, for each recently used root, a
+   * per-thread stash of spare references.  A release adds a reference to the
+   * stash, and an acquire takes one from it, so the shared count is only
+   * touched when the stash is empty.
+   *
+   * The stash holds real references, so the deferred and the immediate
+   * operations can be mixed freely, and a reference acquired on one thread
+   * can be released on another.  The cost is that a graph is not freed until
+   * every thread that stashed a reference to it has flushed.  Flushing drops
+   * all but one of a root's spare references directly, which cannot free it,
+   * and passes the last one to the thread's `LocalEpoch` dec_list, which
+   * releases it once the epoch has advanced.
+   *
+   * Scheduler threads flush at the start of each leak detection, and before
+   * they exit.  Any other thread that calls `release` must call `flush` before
+   * it exits.
+   **/
+  class DeferredRC
+  {
+  private:
+    static constexpr size_t SLOT_BITS = 6;
+    static constexpr size_t SLOTS = 1 << SLOT_BITS;
+
+    struct Slot
+    {
+      Object* root = nullptr;
+      size_t spare = 0;
+    };
+
+    static Slot* slots()
+    {
+      static thread_local Slot slots[SLOTS];
+      return slots;
+    }
+
+    static Slot& slot(Object* root)
+    {
+      return slots()[verona::rt::bits::hash(root) & (SLOTS - 1)];
+    }
+
+    static void flush_slot(Epoch& e, Slot& s)
+    {
+      assert(s.spare > 0);
+      Systematic::cout() << "DeferredRC flush: " << s.root << " x" << s.spare
+                         << std::endl;
+
+      if (s.spare > 1)
+        s.root->decref_many(s.spare - 1);
+
+      e.dec_in_epoch(s.root);
+      s.root = nullptr;
+      s.spare = 0;
+    }
+
+  public:
+    /**
+     * Acquires a reference to the immutable object `o`, using a reference this
+     * thread has stashed if there is one.
+     **/
+    static void acquire(Object* o)
+    {
+      assert(o->debug_is_immutable());
+      auto root = o->immutable();
+      auto& s = slot(root);
+
+      if ((s.root == root) && (s.spare > 0))
+      {
+        s.spare--;
+        return;
+      }
+
+      root->incref();
+    }
+
+    /**
+     * Releases a reference to the immutable object `o` by adding it to this
+     * thread's stash.  If the stash's slot holds references to another root,
+     * those are flushed first.
+     **/
+    static void release(Alloc* alloc, Object* o)
+    {
+      assert(o->debug_is_immutable());
+      auto root = o->immutable();
+      auto& s = slot(root);
+
+      if (s.root != root)
+      {
+        if (s.spare > 0)
+        {
+          Epoch e(alloc);
+          flush_slot(e, s);
+        }
+        s.root = root;
+      }
+
+      s.spare++;
+    }
+
+    /**
+     * Drops all of the references stashed by this thread.
+     **/
+    static void flush(Alloc* alloc)
+    {
+      Epoch e(alloc);
+
+      for (size_t i = 0; i < SLOTS; i++)
+      {
+        auto& s = slots()[i];
+        if (s.spare > 0)
+          flush_slot(e, s);
+      }
+    }
+
+    /**
+     * Returns the number of references to `o`'s root stashed by this thread.
+     **/
+    static size_t debug_stashed(Object* o)
+    {
+      auto root = o->immutable();
+      auto& s = slot(root);
+      return (s.root == root) ? s.spare : 0;
+    }
+  };
+} // namespace verona::rt
@@ -14,12 +14,39 @@ namespace verona::rt
 
   class MultiMessage
   {
+    /**
+     * The body of a multimessage is the head of a single allocation, the
+     * behaviour envelope, which is laid out as
+     *
+     *   [ MultiMessageBody | MultiMessage[count] | Cown*[count] | Action ]
+     *
+     * One message slot is reserved for each cown the behaviour will acquire,
+     * so scheduling a behaviour costs a single allocation, independent of the
+     * number of cowns.
+     *
+     * Message slots are retired lazily by the cown queues, which keep the last
+     * dequeued message as their stub. The envelope is therefore reference
+     * counted: one reference for each message slot, and one for the action.
+     * The last one to be released deallocates the whole envelope.
+     **/
     struct MultiMessageBody
     {
       size_t index;
       size_t count;
       Cown** cowns;
       Action* action;
+      std::atomic<size_t> references;
+      size_t envelope_size;
+#ifdef USE_SCHED_STATS
+      // When the behaviour was scheduled, for measuring time in queue.
+      uint64_t scheduled;
+#endif
+
+      inline MultiMessage* slot(size_t i)
+      {
+        assert(i < count);
+        return &((MultiMessage*)(this + 1))[i];
+      }
     };
 
   private:
@@ -35,9 +62,8 @@ namespace verona::rt
     }
 
     static MultiMessage*
-    make(Alloc* alloc, EpochMark epoch, MultiMessageBody* body)
+    make(MultiMessage* msg, EpochMark epoch, MultiMessageBody* body)
     {
-      auto msg = (MultiMessage*)alloc->alloc(sizeof(MultiMessage));
       msg->body = body;
       msg->set_epoch(epoch);
       return msg;
@@ -67,32 +93,86 @@ namespace verona::rt
       assert(get_epoch() == e);
     }
 
-    static MultiMessageBody*
-    make_body(Alloc* alloc, size_t count, Cown** cowns, Action* action)
+    /**
+     * Allocates a behaviour envelope for `count` cowns, with space for an
+     * action of `action_size` bytes.  The cown array and the action storage
+     * are left uninitialised for the caller to fill in.
+     **/
+    static MultiMessageBody* make_body(
+      Alloc* alloc, size_t count, size_t action_size, size_t action_align)
     {
-      auto body = (MultiMessageBody*)alloc->alloc<sizeof(MultiMessageBody)>();
+      size_t cowns_offset =
+        sizeof(MultiMessageBody) + (count * sizeof(MultiMessage));
+      size_t action_offset = snmalloc::bits::align_up(
+        cowns_offset + (count * sizeof(Cown*)), action_align);
+      size_t size = action_offset + action_size;
+
+      auto body = (MultiMessageBody*)alloc->alloc(size);
       body->index = 0;
       body->count = count;
-      body->cowns = cowns;
-      body->action = action;
+      body->cowns = (Cown**)((uintptr_t)body + cowns_offset);
+      body->action = (Action*)((uintptr_t)body + action_offset);
+      body->references.store(count + 1, std::memory_order_relaxed);
+      body->envelope_size = size;
+#ifdef USE_SCHED_STATS
+      body->scheduled = Aal::tick();
+#endif
 
-      Systematic::cout() << "MultiMessageBody " << body << std::endl;
+      Systematic::cout() << "MultiMessageBody " << body << " (" << size
+                         << " bytes)" << std::endl;
 
       return body;
     }
 
+    /**
+     * Drops a reference to the envelope, deallocating it if this was the last
+     * one.  Called once when the action has run, and once for each message
+     * slot as it is retired from a cown's queue.
+     **/
+    static void release_body(Alloc* alloc, MultiMessageBody* body)
+    {
+      if (body->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+        Systematic::cout() << "MultiMessageBody " << body << " deallocated"
+                           << std::endl;
+        alloc->dealloc(body, body->envelope_size);
+      }
+    }
+
+    /**
+     * Initialises the message slot for the cown at `body->index`.
+     **/
     static MultiMessage*
     make_message(Alloc* alloc, MultiMessageBody* body, EpochMark epoch)
     {
-      MultiMessage* m = make(alloc, epoch, body);
+      UNUSED(alloc);
+      MultiMessage* m = make(body->slot(body->index), epoch, body);
       Systematic::cout() << "MultiMessage " << m << " payload " << body << " ("
                          << epoch << ")" << std::endl;
       return m;
     }
 
-    inline size_t size()
+    /**
+     * Allocates a message that is not part of any envelope.  This is used as
+     * the initial stub of a cown's queue, and is never sent or processed.
+     **/
+    static MultiMessage* make_stub(Alloc* alloc)
     {
-      return sizeof(MultiMessage);
+      auto msg = (MultiMessage*)alloc->alloc<sizeof(MultiMessage)>();
+      return make(msg, EpochMark::EPOCH_NONE, nullptr);
+    }
+
+    /**
+     * Retires this message, once it is no longer referenced by a queue.
+     **/
+    void dealloc(Alloc* alloc)
+    {
+      MultiMessageBody* b = get_body();
+
+      if (b == nullptr)
+        alloc->dealloc<sizeof(MultiMessage)>(this);
+      else
+        release_body(alloc, b);
     }
   };
 } // namespace verona::rt
@@ -4,6 +4,7 @@
 
 #include "../ds/forward_list.h"
 #include "../region/region.h"
+#include "../sched/deferredrc.h"
 #include "../sched/epoch.h"
 #include "../sched/schedulerthread.h"
 #include "../test/systematic.h"
@@ -62,6 +63,12 @@ namespace verona::rt
 #endif
     }
 
+    /**
+     * Returns the content of the noticeboard, with a reference the caller
+     * owns.  The reference is taken from this thread's deferred RC stash if
+     * it can be, so releasing it with `DeferredRC::release` lets repeated
+     * peeks avoid the shared reference count.
+     **/
     T peek(Alloc* alloc)
     {
       if constexpr (std::is_fundamental_v<T>)
@@ -76,7 +83,7 @@ namespace verona::rt
           // only protect incref with epoch
           Epoch e(alloc);
           local_content = get<T>();
-          local_content->incref();
+          DeferredRC::acquire(local_content);
         }
         // It's possible that the following three things happen:
         // 1) cown is already Scanned,
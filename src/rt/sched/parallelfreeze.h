@@ -0,0 +1,166 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include "../cpp/vaction.h"
+#include "../cpp/vobject.h"
+#include "../region/freeze.h"
+#include "cown.h"
+
+#include <tuple>
+
+namespace verona::rt
+{
+  /**
+   * Freezes an isolated object graph, freezing its large nested regions in
+   * parallel on scheduler threads.
+   *
+   * `Freeze::apply` freezes the regions of a graph one after another on the
+   * calling thread.  `ParallelFreeze::apply` freezes the root region on the
+   * calling thread, and each nested region estimated to hold at least
+   * `threshold` bytes in a behaviour on a fresh cown, so that it can be
+   * stolen by another scheduler thread.  Smaller regions are frozen by the
+   * thread that found them.  Every region is frozen exactly as
+   * `Freeze::apply` would freeze it, so there is nothing to merge: when the
+   * last region is done, `Behaviour` is scheduled on `cown` with `args`, and
+   * may use the frozen graph.
+   *
+   * Until then the graph is shared by the threads freezing it, so must not be
+   * used or released.  Leak detection cannot trace a graph in this state, so
+   * the freeze is counted as an inflight message, which stops a leak
+   * detection from completing until the continuation has been sent.
+   **/
+  class ParallelFreeze
+  {
+  public:
+    /// Default size, in bytes, from which a nested region is frozen in
+    /// parallel.
+    static constexpr size_t DEFAULT_THRESHOLD = 1024 * 1024;
+
+  private:
+    struct Job
+    {
+      /// Regions still being frozen, plus one for the thread that started
+      /// the job until it has finished its share.
+      std::atomic<size_t> pending = 1;
+      size_t threshold;
+      bool inflight;
+      void (*finish)(Alloc*, Job*);
+
+      Job(size_t threshold, void (*finish)(Alloc*, Job*))
+      : threshold(threshold),
+        inflight(Scheduler::local() != nullptr),
+        finish(finish)
+      {
+        if (inflight)
+          Scheduler::record_inflight_message();
+      }
+    };
+
+    template<class Behaviour, typename... Args>
+    struct Continuation : public Job
+    {
+      Cown* cown;
+      std::tuple<std::decay_t<Args>...> args;
+
+      Continuation(size_t threshold, Cown* cown, Args&&... args)
+      : Job(threshold, finish_job),
+        cown(cown),
+        args(std::forward<Args>(args)...)
+      {
+        Cown::acquire(cown);
+      }
+
+      static void finish_job(Alloc* alloc, Job* job)
+      {
+        auto self = static_cast<Continuation*>(job);
+        bool inflight = self->inflight;
+
+        std::apply(
+          [self](auto&... args) {
+            Cown::schedule<Behaviour, YesTransfer>(
+              self->cown, std::move(args)...);
+          },
+          self->args);
+
+        self->~Continuation();
+        alloc->dealloc<sizeof(Continuation)>(self);
+
+        if (inflight)
+          Scheduler::recv_inflight_message();
+      }
+    };
+
+    struct Worker : public VCown<Worker>
+    {};
+
+    struct Task : public VAction<Task>
+    {
+      Job* job;
+      Object* iso;
+
+      Task(Job* job, Object* iso) : job(job), iso(iso) {}
+
+      void trace(ObjectStack* st) const
+      {
+        st->push(iso);
+      }
+
+      void f()
+      {
+        run(ThreadAlloc::get(), job, iso);
+      }
+    };
+
+    /**
+     * Freezes the region whose entry point is `o`, and the regions nested in
+     * it that are too small to spawn, then drops this thread's share of
+     * `job`.
+     **/
+    static void run(Alloc* alloc, Job* job, Object* o)
+    {
+      ObjectStack objects(alloc);
+      ObjectStack dfs(alloc);
+      ObjectStack iso(alloc);
+      ObjectStack pending(alloc);
+
+      Freeze::freeze_region(alloc, o, iso, objects, dfs, pending);
+
+      while (!iso.empty())
+      {
+        Object* p = iso.pop();
+
+        if (Freeze::region_bytes(p) >= job->threshold)
+        {
+          Systematic::cout() << "ParallelFreeze: spawning " << p << std::endl;
+          job->pending++;
+          Cown::schedule<Task, YesTransfer>(new Worker, job, p);
+          continue;
+        }
+
+        Freeze::freeze_region(alloc, p, iso, objects, dfs, pending);
+      }
+
+      if (job->pending.fetch_sub(1) == 1)
+        job->finish(alloc, job);
+    }
+
+  public:
+    /**
+     * Freezes the graph whose entry point is the iso object `o`, then
+     * schedules `Behaviour` on `cown` with `args`.  This does not consume the
+     * caller's reference to `cown`.
+     **/
+    template<class Behaviour, typename... Args>
+    static void apply(
+      Alloc* alloc, Object* o, size_t threshold, Cown* cown, Args&&... args)
+    {
+      assert(o->debug_is_iso());
+      using C = Continuation<Behaviour, Args...>;
+
+      auto job = new (alloc->alloc<sizeof(C)>())
+        C(threshold, cown, std::forward<Args>(args)...);
+      run(alloc, job, o);
+    }
+  };
+} // namespace verona::rt
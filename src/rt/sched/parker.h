@@ -0,0 +1,125 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(__linux__)
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#else
+#  include <condition_variable>
+#  include <mutex>
+#endif
+
+namespace verona::rt
+{
+  /**
+   * A binary semaphore used to put a single thread to sleep, and to wake it
+   * up again.
+   *
+   * `unpark` leaves a permit that the next call to `park` consumes, so a wake
+   * up sent before the thread has gone to sleep is not lost.  Only the owning
+   * thread may call `park`; any thread may call `unpark`.
+   *
+   * On Linux this is a futex, so waking one thread only touches that thread's
+   * word, rather than a lock shared by every sleeper.  Other platforms use a
+   * mutex and condition variable per parker.
+   **/
+  class Parker
+  {
+  private:
+    enum : uint32_t
+    {
+      Empty = 0,
+      Parked = 1,
+      Notified = 2
+    };
+
+    std::atomic<uint32_t> word = Empty;
+
+#if !defined(__linux__)
+    std::mutex m;
+    std::condition_variable cv;
+#endif
+
+  public:
+    /**
+     * Blocks until there is a permit, and consumes it.
+     **/
+    void park()
+    {
+      // Fast path: a permit is already available.
+      uint32_t expected = Notified;
+      if (word.compare_exchange_strong(expected, Empty))
+        return;
+
+#if defined(__linux__)
+      expected = Empty;
+      if (!word.compare_exchange_strong(expected, Parked))
+      {
+        // Notified in the meantime.
+        word.store(Empty, std::memory_order_relaxed);
+        return;
+      }
+
+      while (true)
+      {
+        syscall(
+          SYS_futex,
+          reinterpret_cast<uint32_t*>(&word),
+          FUTEX_WAIT_PRIVATE,
+          Parked,
+          nullptr,
+          nullptr,
+          0);
+
+        expected = Notified;
+        if (word.compare_exchange_strong(expected, Empty))
+          return;
+        // Spurious wake up.
+      }
+#else
+      std::unique_lock<std::mutex> lock(m);
+      expected = Empty;
+      if (!word.compare_exchange_strong(expected, Parked))
+      {
+        word.store(Empty, std::memory_order_relaxed);
+        return;
+      }
+
+      while (word.load() != Notified)
+        cv.wait(lock);
+
+      word.store(Empty, std::memory_order_relaxed);
+#endif
+    }
+
+    /**
+     * Makes a permit available, waking the owning thread if it is parked.
+     **/
+    void unpark()
+    {
+      if (word.exchange(Notified) != Parked)
+        return;
+
+#if defined(__linux__)
+      syscall(
+        SYS_futex,
+        reinterpret_cast<uint32_t*>(&word),
+        FUTEX_WAKE_PRIVATE,
+        1,
+        nullptr,
+        nullptr,
+        0);
+#else
+      // Taking the lock ensures the owner is either before its check of the
+      // word, or waiting on the condition variable.
+      std::unique_lock<std::mutex> lock(m);
+      cv.notify_one();
+#endif
+    }
+  };
+} // namespace verona::rt
@@ -2,30 +2,139 @@
 // Licensed under the MIT License.
 #pragma once
 
+#include "../ds/histogram.h"
+#include "cpu.h"
+#include "threadstate.h"
+
 #include <iostream>
 #include <snmalloc.h>
 
 namespace verona::rt
 {
   using namespace snmalloc;
+
+  /**
+   * Statistics kept by each scheduler thread when built with
+   * USE_SCHED_STATS.  Otherwise this is empty, and recording does nothing.
+   *
+   * Every thread's statistics are added together and printed as CSV when the
+   * process exits.  They can also be read while the scheduler is running,
+   * with `Scheduler::snapshot_stats`.  To allow that, every field is atomic,
+   * but the counters only written by the owning thread are updated with a
+   * plain load and store, rather than a read-modify-write.
+   **/
   class SchedulerStats
   {
+  public:
+    /**
+     * Histograms of timings in ticks, and of queue lengths.  Each power of
+     * two is split into four buckets.
+     **/
+    using Histogram = LogLinearHistogram<2, 40>;
+
+    /**
+     * The longest cown queue that is measured.  Longer queues are counted as
+     * this long, so that measuring does not walk an unbounded queue.
+     **/
+    static constexpr size_t QUEUE_LENGTH_LIMIT = 4096;
+
+    /**
+     * Measuring a queue walks it, so only one in this many batches on each
+     * thread measures the length of its cown's queue.
+     **/
+    static constexpr size_t QUEUE_LENGTH_SAMPLE = 64;
+
   private:
 #ifdef USE_SCHED_STATS
-    size_t steal_count = 0;
-    size_t pause_count = 0;
+    std::atomic<size_t> steal_count = 0;
+    // Victims this thread tried to steal from, successfully or not.
+    std::atomic<size_t> steal_attempt_count = 0;
+    // Successful steals, by distance from the victim.
+    std::atomic<size_t>
+      steal_distance_count[Topology::Location::DistanceCount] = {};
+    // Additional cowns taken along with a successful steal.
+    std::atomic<size_t> steal_batched_count = 0;
+    std::atomic<size_t> pause_count = 0;
     std::atomic<size_t> unpause_count = 0;
     std::atomic<size_t> lifo_count = 0;
+    std::atomic<size_t> run_next_count = 0;
+    std::atomic<size_t> batch_budget_count = 0;
+    std::atomic<size_t> batch_empty_count = 0;
+    std::atomic<size_t> cown_scan_count = 0;
+    std::atomic<size_t> ld_skip_count = 0;
+    // Time spent in each step of an incremental sweep, in ticks.
+    Log2Histogram<> sweep_pause;
+    Log2Histogram<> stub_pause;
+    // Time from entering PreScan to entering Sweep, for each leak detection.
+    Log2Histogram<> ld_scan_time;
+    // Time spent running each behaviour.
+    Histogram run_time_hist;
+    // Time from scheduling a behaviour to starting to run it.
+    Histogram queue_time_hist;
+    // Messages in a cown's queue when it starts a sampled batch.
+    Histogram queue_length_hist;
+    // Batches started on this thread, used to pick the sampled ones.  Only
+    // read by this thread, so not added to snapshots.
+    size_t batch_count = 0;
+    // Time from looking for work to stealing it.
+    Histogram steal_time_hist;
+    // Time this thread spent in each phase of each leak detection.
+    Histogram ld_phase_hist[ThreadState::PhaseCount];
+    // Snapshots are not added to the totals printed at exit.
+    bool snapshot = false;
+
+    static void inc(std::atomic<size_t>& c, size_t n = 1)
+    {
+      c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static size_t get(const std::atomic<size_t>& c)
+    {
+      return c.load(std::memory_order_relaxed);
+    }
 #endif
 
   public:
+    SchedulerStats() = default;
+
+    /**
+     * Copies are snapshots: they hold the statistics of `that` at the time of
+     * the copy, which may be live, and are not counted again at exit.
+     **/
+    SchedulerStats(const SchedulerStats& that)
+    {
+      UNUSED(that);
+#ifdef USE_SCHED_STATS
+      snapshot = true;
+      add(that);
+#endif
+    }
+
+    SchedulerStats& operator=(const SchedulerStats&) = delete;
+
+    /**
+     * Returns empty statistics, which snapshots can be added to.
+     **/
+    static SchedulerStats empty_snapshot()
+    {
+      SchedulerStats s;
+#ifdef USE_SCHED_STATS
+      s.snapshot = true;
+#endif
+      return s;
+    }
+
     ~SchedulerStats()
 #ifdef USE_SCHED_STATS
     {
       static std::atomic_flag lock = ATOMIC_FLAG_INIT;
       static SchedulerStats global;
 
-      if (this != &global)
+      if (snapshot)
+      {
+        return;
+      }
+      else if (this != &global)
       {
         FlagLock f(lock);
         global.add(*this);
@@ -39,17 +148,44 @@ namespace verona::rt
       = default;
 #endif
 
-    void steal()
+    /**
+     * This thread tried to take work from another thread's queue.
+     **/
+    void steal_attempt()
+    {
+#ifdef USE_SCHED_STATS
+      inc(steal_attempt_count);
+#endif
+    }
+
+    /**
+     * A steal succeeded, `ticks` after this thread started looking for work.
+     **/
+    void steal(Topology::Location::Distance distance, uint64_t ticks)
+    {
+#ifdef USE_SCHED_STATS
+      inc(steal_count);
+      inc(steal_distance_count[distance]);
+      steal_time_hist.add(ticks);
+#else
+      UNUSED(distance);
+      UNUSED(ticks);
+#endif
+    }
+
+    void steal_batch(size_t count)
     {
 #ifdef USE_SCHED_STATS
-      steal_count++;
+      inc(steal_batched_count, count);
+#else
+      UNUSED(count);
 #endif
     }
 
     void pause()
     {
 #ifdef USE_SCHED_STATS
-      pause_count++;
+      inc(pause_count);
 #endif
     }
 
@@ -67,19 +203,230 @@ namespace verona::rt
 #endif
     }
 
-    void add(SchedulerStats& that)
+    void run_next()
+    {
+#ifdef USE_SCHED_STATS
+      inc(run_next_count);
+#endif
+    }
+
+    /**
+     * A cown yielded because its batch policy ran out of budget, although it
+     * still had messages to process.
+     **/
+    void batch_budget()
+    {
+#ifdef USE_SCHED_STATS
+      inc(batch_budget_count);
+#endif
+    }
+
+    /**
+     * A cown yielded because it had processed all the messages that were in
+     * its queue when the batch started.
+     **/
+    void batch_empty()
+    {
+#ifdef USE_SCHED_STATS
+      inc(batch_empty_count);
+#endif
+    }
+
+    /**
+     * The leak detector traced a cown's data.
+     **/
+    void cown_scan()
+    {
+#ifdef USE_SCHED_STATS
+      inc(cown_scan_count);
+#endif
+    }
+
+    /**
+     * A minor leak detection reached a promoted cown, and did not trace it.
+     **/
+    void ld_skip()
+    {
+#ifdef USE_SCHED_STATS
+      inc(ld_skip_count);
+#endif
+    }
+
+    /**
+     * A step of the leak detector's sweep of this thread's cowns took `ticks`.
+     **/
+    void sweep_step(uint64_t ticks)
+    {
+#ifdef USE_SCHED_STATS
+      sweep_pause.add(ticks);
+#else
+      UNUSED(ticks);
+#endif
+    }
+
+    /**
+     * A step of collecting the stubs of this thread's cowns took `ticks`.
+     **/
+    void stub_step(uint64_t ticks)
+    {
+#ifdef USE_SCHED_STATS
+      stub_pause.add(ticks);
+#else
+      UNUSED(ticks);
+#endif
+    }
+
+    /**
+     * A leak detection took `ticks` to get from PreScan to Sweep.
+     **/
+    void ld_scan(uint64_t ticks)
+    {
+#ifdef USE_SCHED_STATS
+      ld_scan_time.add(ticks);
+#else
+      UNUSED(ticks);
+#endif
+    }
+
+    /**
+     * A behaviour started to run `ticks` after it was scheduled.
+     **/
+    void behaviour_queued(uint64_t ticks)
+    {
+#ifdef USE_SCHED_STATS
+      queue_time_hist.add(ticks);
+#else
+      UNUSED(ticks);
+#endif
+    }
+
+    /**
+     * A behaviour ran for `ticks`.
+     **/
+    void behaviour_run(uint64_t ticks)
+    {
+#ifdef USE_SCHED_STATS
+      run_time_hist.add(ticks);
+#else
+      UNUSED(ticks);
+#endif
+    }
+
+    /**
+     * A cown is starting a batch.  Returns true if the length of its queue
+     * should be measured and passed to `cown_dequeue`.
+     **/
+    bool sample_queue_length()
+    {
+#ifdef USE_SCHED_STATS
+      return (batch_count++ % QUEUE_LENGTH_SAMPLE) == 0;
+#else
+      return false;
+#endif
+    }
+
+    /**
+     * A cown started a sampled batch with `length` messages in its queue.
+     **/
+    void cown_dequeue(size_t length)
+    {
+#ifdef USE_SCHED_STATS
+      queue_length_hist.add(length);
+#else
+      UNUSED(length);
+#endif
+    }
+
+    /**
+     * This thread spent `ticks` in `phase` of a leak detection.
+     **/
+    void ld_phase(ThreadState::Phase phase, uint64_t ticks)
+    {
+#ifdef USE_SCHED_STATS
+      ld_phase_hist[phase].add(ticks);
+#else
+      UNUSED(phase);
+      UNUSED(ticks);
+#endif
+    }
+
+#ifdef USE_SCHED_STATS
+    size_t steals() const
+    {
+      return get(steal_count);
+    }
+
+    size_t steal_attempts() const
+    {
+      return get(steal_attempt_count);
+    }
+
+    size_t pauses() const
+    {
+      return get(pause_count);
+    }
+
+    const Histogram& run_time() const
+    {
+      return run_time_hist;
+    }
+
+    const Histogram& queue_time() const
+    {
+      return queue_time_hist;
+    }
+
+    const Histogram& queue_length() const
+    {
+      return queue_length_hist;
+    }
+
+    const Histogram& steal_time() const
+    {
+      return steal_time_hist;
+    }
+
+    const Histogram& ld_phase_time(ThreadState::Phase phase) const
+    {
+      return ld_phase_hist[phase];
+    }
+#endif
+
+    /**
+     * Adds the statistics of `that` to these.  `that` may still be updated
+     * by its own thread while this runs.
+     **/
+    void add(const SchedulerStats& that)
     {
       UNUSED(that);
 
 #ifdef USE_SCHED_STATS
-      steal_count += that.steal_count;
-      pause_count += that.pause_count;
-      unpause_count += that.unpause_count;
-      lifo_count += that.lifo_count;
+      inc(steal_count, get(that.steal_count));
+      inc(steal_attempt_count, get(that.steal_attempt_count));
+      for (size_t i = 0; i < Topology::Location::DistanceCount; i++)
+        inc(steal_distance_count[i], get(that.steal_distance_count[i]));
+      inc(steal_batched_count, get(that.steal_batched_count));
+      inc(pause_count, get(that.pause_count));
+      inc(unpause_count, get(that.unpause_count));
+      inc(lifo_count, get(that.lifo_count));
+      inc(run_next_count, get(that.run_next_count));
+      inc(batch_budget_count, get(that.batch_budget_count));
+      inc(batch_empty_count, get(that.batch_empty_count));
+      inc(cown_scan_count, get(that.cown_scan_count));
+      inc(ld_skip_count, get(that.ld_skip_count));
+      sweep_pause.add(that.sweep_pause);
+      stub_pause.add(that.stub_pause);
+      ld_scan_time.add(that.ld_scan_time);
+      run_time_hist.add(that.run_time_hist);
+      queue_time_hist.add(that.queue_time_hist);
+      queue_length_hist.add(that.queue_length_hist);
+      steal_time_hist.add(that.steal_time_hist);
+      for (size_t i = 0; i < ThreadState::PhaseCount; i++)
+        ld_phase_hist[i].add(that.ld_phase_hist[i]);
 #endif
     }
 
-    void print(std::ostream& o, uint64_t dumpid = 0)
+    void print(std::ostream& o, uint64_t dumpid = 0) const
     {
       UNUSED(o);
       UNUSED(dumpid);
@@ -94,13 +441,48 @@ namespace verona::rt
         csv << "SchedulerStats"
             << "DumpID"
             << "Steal"
+            << "StealAttempt"
+            << "StealSameCore"
+            << "StealSameSocket"
+            << "StealRemote"
+            << "StealBatched"
             << "LIFO"
+            << "RunNext"
             << "Pause"
-            << "Unpause" << csv.endl;
+            << "Unpause"
+            << "BatchBudget"
+            << "BatchEmpty"
+            << "CownScan"
+            << "LDSkip" << csv.endl;
       }
 
-      csv << "SchedulerStats" << dumpid << steal_count << lifo_count
-          << pause_count << unpause_count << csv.endl;
+      csv << "SchedulerStats" << dumpid << get(steal_count)
+          << get(steal_attempt_count)
+          << get(steal_distance_count[Topology::Location::SameCore])
+          << get(steal_distance_count[Topology::Location::SameSocket])
+          << get(steal_distance_count[Topology::Location::Remote])
+          << get(steal_batched_count) << get(lifo_count) << get(run_next_count)
+          << get(pause_count) << get(unpause_count) << get(batch_budget_count)
+          << get(batch_empty_count) << get(cown_scan_count)
+          << get(ld_skip_count) << csv.endl;
+
+      // Pause time histograms, in ticks.  Each row is the number of steps,
+      // the longest step, and then the count in each power of two bucket.
+      sweep_pause.print(csv, "SweepPause", dumpid);
+      stub_pause.print(csv, "StubPause", dumpid);
+      ld_scan_time.print(csv, "LDScan", dumpid);
+
+      // Log-linear histograms, with four buckets per power of two.
+      run_time_hist.print(csv, "RunTime", dumpid);
+      queue_time_hist.print(csv, "QueueTime", dumpid);
+      queue_length_hist.print(csv, "QueueLength", dumpid);
+      steal_time_hist.print(csv, "StealTime", dumpid);
+      ld_phase_hist[ThreadState::PreScanPhase].print(
+        csv, "LDPhasePreScan", dumpid);
+      ld_phase_hist[ThreadState::ScanPhase].print(csv, "LDPhaseScan", dumpid);
+      ld_phase_hist[ThreadState::VotePhase].print(csv, "LDPhaseVote", dumpid);
+      ld_phase_hist[ThreadState::SweepPhase].print(
+        csv, "LDPhaseSweep", dumpid);
 #endif
     }
   };
@@ -4,12 +4,15 @@
 
 #include "../object/object.h"
 #include "cpu.h"
+#include "deferredrc.h"
 #include "schedulerstats.h"
 #include "spmcq.h"
 #include "threadpool.h"
 
+#include <algorithm>
 #include <snmalloc.h>
 #include <thread>
+#include <vector>
 
 namespace verona::rt
 {
@@ -37,6 +40,22 @@ namespace verona::rt
 
     static constexpr uint64_t TSC_QUIESCENCE_TIMEOUT = 1'000'000;
 
+    /// Maximum number of cowns taken from a victim in a single steal.
+    static constexpr size_t STEAL_BATCH = 64;
+
+    /// Maximum number of cowns visited by one step of an incremental sweep of
+    /// `list`.  Systematic testing uses a small budget, so that sweeps are
+    /// interleaved with other work.
+#ifdef USE_SYSTEMATIC_TESTING
+    static constexpr size_t SWEEP_BUDGET = 4;
+#else
+    static constexpr size_t SWEEP_BUDGET = 1024;
+#endif
+
+    /// Maximum number of cowns run in succession from the `run_next` slot
+    /// before the queue is given a turn.
+    static constexpr size_t RUN_NEXT_LIMIT = 32;
+
     T* token_cown = nullptr;
 
 #ifdef USE_SYSTEMATIC_TESTING
@@ -47,11 +66,33 @@ namespace verona::rt
 #endif
 
     SPMCQ<T> q;
+
+    /// The cown most recently scheduled by this thread, which runs as soon as
+    /// the current one finishes, ahead of the queue.  This keeps the latency
+    /// of a request/response chain between cowns independent of the length
+    /// of the queue.  The slot cannot be stolen from, so it holds at most one
+    /// cown, and `run_next_streak` bounds how long it can starve the queue,
+    /// and with it the token used by the LD protocol.
+    T* run_next = nullptr;
+    size_t run_next_streak = 0;
+
     Alloc* alloc = nullptr;
     SchedulerThread<T>* next = nullptr;
     SchedulerThread<T>* victim = nullptr;
+
+    /// Where the CPU this thread runs on sits in the machine.
+    Topology::Location location = {0, 0, 0};
+
+    /// The other scheduler threads, nearest first. Steal attempts walk this
+    /// list, and start again from the nearest after a successful steal.
+    std::vector<SchedulerThread<T>*> victims;
+    size_t victim_index = 0;
     std::condition_variable cv;
 
+    /// Used by the thread pool to pause this thread, and to wake it up.
+    Parker parker;
+    SchedulerThread<T>* next_sleeper = nullptr;
+
     bool running = true;
 
     // `n_ld_tokens` indicates the times of token cown a scheduler has to
@@ -70,8 +111,29 @@ namespace verona::rt
 
     std::atomic<bool> scheduled_unscanned_cown = false;
 
+    /// Messages counted as inflight for leak detection that were sent, and
+    /// received, on this thread.  Only this thread writes them, and they are
+    /// summed over all threads by `no_inflight_messages`.
+    std::atomic<size_t> inflight_sent = 0;
+    std::atomic<size_t> inflight_received = 0;
+
     EpochMark send_epoch = EpochMark::EPOCH_A;
     EpochMark prev_epoch = EpochMark::EPOCH_B;
+
+    /// Leak detections this thread has taken part in.  Every thread takes
+    /// part in every leak detection, so this is the same on all of them.
+    size_t ld_count = 0;
+    /// When this thread entered PreScan in the current leak detection.
+    uint64_t ld_start = 0;
+    /// When this thread entered its current phase of leak detection.
+    uint64_t ld_phase_start = 0;
+    /// True if the current, or last, leak detection is a minor one of a
+    /// generational leak detector.
+    bool ld_minor = false;
+    /// Counts the unpromoted cowns reached by scanning on this thread, so
+    /// that a scan can tell whether the cown it traced holds any.
+    size_t ld_young_reached = 0;
+
     size_t affinity = (size_t)-1;
 
     std::thread t;
@@ -82,6 +144,17 @@ namespace verona::rt
     size_t total_cowns = 0;
     std::atomic<size_t> free_cowns = 0;
 
+    /// The next cown to consider in the leak detector's sweep of `list`.
+    /// Cowns are only unlinked from `list` by `collect_cown_stubs`, which does
+    /// not run while this thread is sweeping, and new cowns are added at the
+    /// front, so the cursor stays valid between steps.
+    T* sweep_cursor = nullptr;
+
+    /// The link to the next cown to consider in an incremental pass of
+    /// `collect_cown_stubs`, or nullptr if no pass is in progress.  The cown
+    /// holding the link is still in `list`, as only this pass unlinks cowns.
+    T** stub_cursor = nullptr;
+
     T* get_token_cown()
     {
       assert(token_cown);
@@ -133,6 +206,62 @@ namespace verona::rt
         stats.unpause();
     }
 
+    /**
+     * Schedules a cown on this thread, from this thread, to run as soon as
+     * the current one finishes.  Any cown already in the `run_next` slot is
+     * moved to the queue.
+     **/
+    inline void schedule_next(T* a)
+    {
+      Systematic::cout() << "Run next Cown: " << a << " ("
+                         << a->get_epoch_mark() << ")" << std::endl;
+
+      if (!a->scanned(send_epoch))
+      {
+        Systematic::cout() << "Run next Unscanned Cown: " << a << std::endl;
+        scheduled_unscanned_cown = true;
+      }
+      assert(!a->queue.is_sleeping());
+
+      T* displaced = run_next;
+      run_next = a;
+
+      if (displaced != nullptr)
+        schedule_fifo(displaced);
+    }
+
+    /**
+     * Takes the cown in the `run_next` slot, if there is one.  Once the slot
+     * has been used `RUN_NEXT_LIMIT` times in a row, its cown is moved to the
+     * queue instead, so that the rest of the queue, and the token, get a
+     * turn.
+     **/
+    T* take_run_next()
+    {
+      T* n = run_next;
+
+      if (n == nullptr)
+      {
+        run_next_streak = 0;
+        return nullptr;
+      }
+
+      run_next = nullptr;
+
+      if (run_next_streak >= RUN_NEXT_LIMIT)
+      {
+        Systematic::cout() << "Run next limit reached" << std::endl;
+        run_next_streak = 0;
+        schedule_fifo(n);
+        return nullptr;
+      }
+
+      run_next_streak++;
+      stats.run_next();
+      Systematic::cout() << "Took run next Cown: " << n << std::endl;
+      return n;
+    }
+
     inline void schedule_lifo(T* a)
     {
       // A lifo scheduled cown is coming from an external source, such as
@@ -142,7 +271,7 @@ namespace verona::rt
       q.push_back(ThreadAlloc::get(), a);
       stats.lifo();
 
-      if (Scheduler::get().unpause())
+      if (Scheduler::get().unpause(this))
         stats.unpause();
     }
 
@@ -187,7 +316,7 @@ namespace verona::rt
 
       Scheduler::local() = this;
       alloc = ThreadAlloc::get();
-      victim = next;
+      init_victims();
       T* cown = nullptr;
 
 #ifdef USE_SYSTEMATIC_TESTING
@@ -197,12 +326,12 @@ namespace verona::rt
       while (true)
       {
         if (
-          (total_cowns < (free_cowns << 1))
+          (stub_cursor != nullptr) || (total_cowns < (free_cowns << 1))
 #ifdef USE_SYSTEMATIC_TESTING
           || Scheduler::coin()
 #endif
         )
-          collect_cown_stubs();
+          collect_cown_stubs(SWEEP_BUDGET);
 
         if (should_steal_for_fairness)
         {
@@ -215,6 +344,9 @@ namespace verona::rt
 
         check_token_cown();
 
+        if (cown == nullptr)
+          cown = take_run_next();
+
         if (cown == nullptr)
         {
           cown = q.pop(alloc);
@@ -274,7 +406,10 @@ namespace verona::rt
             // otherwise run this cown again. Don't push to the queue
             // immediately to avoid another thread stealing our only cown.
 
-            T* n = q.pop(alloc);
+            T* n = take_run_next();
+
+            if (n == nullptr)
+              n = q.pop(alloc);
 
             if (n != nullptr)
             {
@@ -314,6 +449,8 @@ namespace verona::rt
 #endif
       }
 
+      assert(run_next == nullptr);
+
       Systematic::cout() << "Begin teardown (phase 1)" << std::endl;
 
       cown = list;
@@ -329,6 +466,7 @@ namespace verona::rt
 
       Systematic::cout() << "End teardown (phase 1)" << std::endl;
 
+      DeferredRC::flush(alloc);
       Epoch(ThreadAlloc::get()).flush_local();
       Scheduler::get().enter_barrier();
 
@@ -336,13 +474,57 @@ namespace verona::rt
 
       GlobalEpoch::advance();
 
-      collect_cown_stubs();
+      stub_cursor = nullptr;
+      collect_cown_stubs((size_t)-1);
 
       Systematic::cout() << "End teardown (phase 2)" << std::endl;
 
       q.destroy(alloc);
     }
 
+    /**
+     * Orders the other scheduler threads by their distance from this one, so
+     * that work is stolen from a sibling hardware thread before another core
+     * in the same socket, and from the same socket before a remote one.
+     *
+     * Systematic testing keeps the ring order, so that runs do not depend on
+     * the topology of the machine.
+     **/
+    void init_victims()
+    {
+      victims.clear();
+
+      for (auto t = next; t != this; t = t->next)
+        victims.push_back(t);
+
+#ifndef USE_SYSTEMATIC_TESTING
+      std::stable_sort(
+        victims.begin(),
+        victims.end(),
+        [this](SchedulerThread<T>* a, SchedulerThread<T>* b) {
+          return location.distance(a->location) <
+            location.distance(b->location);
+        });
+#endif
+
+      nearest_victim();
+    }
+
+    void nearest_victim()
+    {
+      victim_index = 0;
+      victim = victims.empty() ? this : victims[0];
+    }
+
+    void next_victim()
+    {
+      if (victims.empty())
+        return;
+
+      victim_index = (victim_index + 1) % victims.size();
+      victim = victims[victim_index];
+    }
+
     bool fast_steal(T*& result)
     {
       // auto cur_victim = victim;
@@ -364,7 +546,7 @@ namespace verona::rt
       }
 
       // We were unable to steal, move to the next victim thread.
-      victim = victim->next;
+      next_victim();
 
       return false;
     }
@@ -395,6 +577,32 @@ namespace verona::rt
       token_consumed.store(res, std::memory_order_relaxed);
     }
 
+    /**
+     * Appends a run of cowns stolen from another thread to our own queue.
+     **/
+    void adopt_run(T* first, T* last)
+    {
+      size_t count = 0;
+      for (T* c = first;; c = c->next_in_queue)
+      {
+        Systematic::cout() << "Stole Cown: " << c << " (batch)" << std::endl;
+        count++;
+
+        if (!c->scanned(send_epoch))
+          scheduled_unscanned_cown = true;
+
+        if (c == last)
+          break;
+      }
+
+      q.push_run(alloc, first, last);
+      stats.steal_batch(count);
+
+      // Let other idle threads steal from us in turn.
+      if (Scheduler::get().unpause())
+        stats.unpause();
+    }
+
     T* steal()
     {
       uint64_t tsc = Aal::tick();
@@ -414,28 +622,42 @@ namespace verona::rt
         // Participate in the cown LD protocol.
         ld_protocol();
 
-        // Check if some other thread has pushed work on our queue.
-        cown = q.pop(alloc);
+        // Check if some other thread has pushed work on our queue, or if we
+        // scheduled a cown while participating in the protocol.
+        cown = take_run_next();
+
+        if (cown == nullptr)
+          cown = q.pop(alloc);
 
         if (cown != nullptr)
           return cown;
 
-        // Try to steal from the victim thread.
+        // Try to steal from the victim thread.  Take up to half of its queue
+        // in one go, so that work spreads out from a single busy thread in a
+        // logarithmic number of steals rather than one cown at a time.
         if (victim != this)
         {
-          cown = victim->q.pop(alloc);
+          T* rest;
+          T* rest_last;
+          stats.steal_attempt();
+          cown = victim->q.pop_batch(alloc, STEAL_BATCH, rest, rest_last);
 
           if (cown != nullptr)
           {
-            stats.steal();
+            stats.steal(location.distance(victim->location), Aal::tick() - tsc);
             Systematic::cout() << "Stole Cown: " << cown << " from "
                                << victim->systematic_id << std::endl;
+
+            if (rest != nullptr)
+              adopt_run(rest, rest_last);
+
+            nearest_victim();
             return cown;
           }
         }
 
         // We were unable to steal, move to the next victim thread.
-        victim = victim->next;
+        next_victim();
 
         // Wait until a minimum timeout has passed.
         uint64_t tsc2 = Aal::tick();
@@ -555,6 +777,11 @@ namespace verona::rt
      **/
     void ld_protocol()
     {
+      // Continue sweeping, and only vote to leave the Sweep state once this
+      // thread's sweep is complete.
+      if ((state == ThreadState::Sweep) && !collect_cowns(SWEEP_BUDGET))
+        return;
+
       // Set state to BelieveDone_Vote when we think we've finished scanning.
       if ((state == ThreadState::AllInScan) && ld_checkpoint_reached())
       {
@@ -645,7 +872,10 @@ namespace verona::rt
 
           case ThreadState::Sweep:
           {
-            collect_cowns();
+            stats.ld_scan(Aal::tick() - ld_start);
+            sweep_cursor = list;
+            if (!collect_cowns(SWEEP_BUDGET))
+              return;
             continue;
           }
 
@@ -666,11 +896,29 @@ namespace verona::rt
     {
       Systematic::cout() << "Scheduler state change: " << state << " -> "
                          << snext << std::endl;
+
+      auto phase = ThreadState::phase(state);
+      if (phase != ThreadState::phase(snext))
+      {
+        uint64_t now = Aal::tick();
+        if (phase != ThreadState::Idle)
+          stats.ld_phase(phase, now - ld_phase_start);
+        ld_phase_start = now;
+      }
+
       state = snext;
     }
 
     void enter_prescan()
     {
+      ld_count++;
+      ld_minor = Scheduler::is_minor_ld(ld_count);
+      ld_start = Aal::tick();
+
+      // Immutables released on this thread should not outlive a leak
+      // detection just because they are in its deferred RC stash.
+      DeferredRC::flush(alloc);
+
       // Save epoch for when we start scanning
       prev_epoch = send_epoch;
 
@@ -695,13 +943,26 @@ namespace verona::rt
                                                         EpochMark::EPOCH_B;
       Systematic::cout() << "send_epoch (2): " << send_epoch << std::endl;
 
-      // Send empty messages to all cowns that can be LIFO scheduled.
+      // Send empty messages to all cowns that can be LIFO scheduled.  A minor
+      // leak detection also scans this thread's part of the remembered set,
+      // as the promoted cowns that refer to those cowns are not traced.
       T* p = list;
 
       while (p != nullptr)
       {
         if (p->can_lifo_schedule())
+        {
           p->reschedule();
+        }
+        else if (
+          ld_minor && p->ld_remembered() &&
+          (p->thread.load(std::memory_order_relaxed) != nullptr) &&
+          p->acquire_strong_from_weak())
+        {
+          Systematic::cout() << "Remembered " << p << std::endl;
+          p->schedule_scan(send_epoch);
+          T::release(alloc, p);
+        }
 
         p = p->next;
       }
@@ -711,37 +972,66 @@ namespace verona::rt
       Systematic::cout() << "Enqueued LD check point" << std::endl;
     }
 
-    void collect_cowns()
+    /**
+     * Continues the sweep of `list` from `sweep_cursor`, visiting at most
+     * `budget` cowns, so that a thread with many cowns keeps processing
+     * messages while it sweeps.  Returns true once the sweep is complete.
+     **/
+    bool collect_cowns(size_t budget)
     {
-      T* p = list;
+      uint64_t start = Aal::tick();
+      T* p = sweep_cursor;
 
-      while (p != nullptr)
+      size_t promotion_age = Scheduler::get_ld_promotion_age();
+
+      for (size_t i = 0; (p != nullptr) && (i < budget); i++)
       {
         T* n = p->next;
-        p->try_collect(alloc, send_epoch);
+        if (!p->try_collect(alloc, send_epoch) && (promotion_age != 0))
+          p->ld_survived(promotion_age);
         p = n;
       }
+
+      sweep_cursor = p;
+      stats.sweep_step(Aal::tick() - start);
+
+      if (p != nullptr)
+      {
+        Systematic::cout() << "Sweep paused at " << p << std::endl;
+        return false;
+      }
+
+      return true;
     }
 
-    void collect_cown_stubs()
+    /**
+     * Deallocates cowns that have been collected, and are no longer
+     * referenced by any thread.  This visits at most `budget` cowns, and
+     * continues from where the previous call stopped, if that did not reach
+     * the end of `list`.
+     **/
+    void collect_cown_stubs(size_t budget)
     {
       // Cannot collect the cown state while another thread could be
       // sweeping.  The other thread could be checking to see if it should
       // issue a decref to the object that is part of the same collection,
-      // and thus cause a use-after-free.
+      // and thus cause a use-after-free.  This thread may also be part way
+      // through its own sweep.
       switch (state)
       {
         case ThreadState::ReallyDone_Confirm:
+        case ThreadState::Sweep:
         case ThreadState::Finished:
           return;
 
         default:;
       }
 
-      T** p = &list;
+      uint64_t start = Aal::tick();
+      T** p = (stub_cursor == nullptr) ? &list : stub_cursor;
       size_t count = 0;
 
-      while (*p != nullptr)
+      for (size_t i = 0; (*p != nullptr) && (i < budget); i++)
       {
         T* c = *p;
         Systematic::cout() << "Stub collect: " << c << std::endl;
@@ -771,6 +1061,8 @@ namespace verona::rt
       }
 
       free_cowns -= count;
+      stub_cursor = (*p == nullptr) ? nullptr : p;
+      stats.stub_step(Aal::tick() - start);
     }
   };
 } // namespace verona::rt
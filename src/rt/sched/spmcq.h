@@ -15,21 +15,38 @@ namespace verona::rt
     snmalloc::ABA<T> tail;
     static constexpr uintptr_t BIT = 1;
 
-    T* unmask(T* tagged_ptr)
+    static T* unmask(T* tagged_ptr)
     {
       return (T*)((uintptr_t)tagged_ptr & ~BIT);
     }
 
-    bool is_bit_set(T* tagged_ptr)
+    static bool is_bit_set(T* tagged_ptr)
     {
       return unmask(tagged_ptr) != tagged_ptr;
     }
 
-    T* set_bit(T* ptr)
+    static T* set_bit(T* ptr)
     {
       return (T*)((uintptr_t)ptr | BIT);
     }
 
+    /**
+     * Returns true if `node` could be taken as part of a run, and moves it on
+     * to the next element.
+     **/
+    static bool can_take(T*& node)
+    {
+      if (is_bit_set(node))
+        return false;
+
+      T* n = node->next_in_queue;
+      if (n == nullptr)
+        return false;
+
+      node = n;
+      return true;
+    }
+
   public:
     explicit SPMCQ(T* token)
     {
@@ -50,6 +67,20 @@ namespace verona::rt
       head = node;
     }
 
+    /**
+     * Appends a run of untagged elements, linked through `next_in_queue` from
+     * `first` to `last`, as obtained from `pop_batch`.  Like `push`, this may
+     * only be called by the owner of the queue.
+     **/
+    void push_run(Alloc* alloc, T* first, T* last)
+    {
+      (void)alloc;
+      assert(last->next_in_queue == nullptr);
+      auto unmasked_head = unmask(head);
+      unmasked_head->next_in_queue.store(first, std::memory_order_release);
+      head = last;
+    }
+
     void push_back(Alloc* alloc, T* node)
     {
       (void)alloc;
@@ -87,6 +118,74 @@ namespace verona::rt
       return tl;
     }
 
+    /**
+     * Steal-half: detaches a run of up to half of the elements in the queue,
+     * and at most `max`, with a single CAS on the tail.
+     *
+     * Returns the first element of the run, which has left the queue as if
+     * by `pop`.  The rest of the run, if any, is returned as `rest` to
+     * `rest_last`, linked through `next_in_queue`, and is expected to be
+     * pushed onto the caller's own queue with `push_run`.
+     *
+     * Tagged elements (scheduler thread tokens) are never part of a longer
+     * run, so a token is only ever taken on its own.
+     *
+     * Returns nullptr if nothing could be detached.
+     **/
+    T* pop_batch(Alloc* alloc, size_t max, T*& rest, T*& rest_last)
+    {
+      assert(max > 0);
+      T* tl;
+      T* last;
+      T* next;
+      auto cmp = tail.read();
+
+      uint64_t epoch;
+      do
+      {
+        Epoch e(alloc);
+        epoch = e.get_local_epoch_epoch();
+        tl = ABA<T>::ptr(cmp);
+        next = unmask(tl)->next_in_queue;
+
+        if (next == nullptr)
+          return nullptr;
+
+        // `probe` runs two elements ahead for every element added to the run,
+        // so the run is about half of the elements that could be taken.  The
+        // element at the head, and tokens, cannot be part of a longer run.
+        last = tl;
+        if (!is_bit_set(tl))
+        {
+          T* probe = next;
+          for (size_t count = 1; count < max; count++)
+          {
+            if (!can_take(probe) || !can_take(probe))
+              break;
+
+            T* n = next->next_in_queue;
+            if (n == nullptr)
+              break;
+
+            last = next;
+            next = n;
+          }
+        }
+      } while (!tail.compare_exchange(cmp, next));
+
+      assert(epoch != T::NO_EPOCH_SET);
+
+      // The run is now owned by the caller, so cut it off from the queue,
+      // and detach the first element before its link is reused for the epoch.
+      unmask(last)->next_in_queue.store(nullptr, std::memory_order_relaxed);
+      rest = (last == tl) ? nullptr : tl->next_in_queue.load();
+      rest_last = (last == tl) ? nullptr : last;
+
+      tl->epoch_when_popped = epoch;
+
+      return tl;
+    }
+
     // The callers are expected to guarantee no one is attempting to access the
     // queue concurrently.
     void destroy(Alloc* alloc)
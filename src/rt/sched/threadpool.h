@@ -3,8 +3,11 @@
 #pragma once
 
 #include "cpu.h"
+#include "parker.h"
+#include "schedulerstats.h"
 #include "threadstate.h"
 
+#include <algorithm>
 #include <condition_variable>
 #include <mutex>
 #include <snmalloc.h>
@@ -29,20 +32,35 @@ namespace verona::rt
     static constexpr uint64_t TSC_PAUSE_SLOP = 1'000'000;
     static constexpr uint64_t TSC_UNPAUSE_SLOP = TSC_PAUSE_SLOP / 2;
 
+    /// A thread only pauses if no thread has been unpaused for this many
+    /// ticks.
+    uint64_t pause_slop = TSC_PAUSE_SLOP;
+    /// Unpausing is skipped if another unpause happened within this many
+    /// ticks.
+    uint64_t unpause_slop = TSC_UNPAUSE_SLOP;
+
     bool detect_leaks = true;
+    /// Leak detections a cown must survive before it is promoted, or zero if
+    /// leak detection is not generational.
+    size_t ld_promotion_age = 0;
+    /// Every this many leak detections, promoted cowns are traced and
+    /// collected like any other.
+    size_t full_ld_interval = 0;
     size_t incarnation = 1;
     size_t thread_count = 0;
     size_t active_thread_count = 0;
 
-    /**
-     * Number of messages that have been sent that may not be visible to a
-     *thread in a Scan state.
-     **/
-    std::atomic<size_t> inflight_count = 0;
-
     uint64_t last_unpause_tsc = Aal::tick();
     std::mutex m;
     std::condition_variable cv;
+
+    /// Paused threads, most recently paused first, linked through
+    /// `next_sleeper`.  Protected by `m`.  Each thread parks on its own
+    /// `Parker`, so a thread can be woken without waking all of them.
+    T* sleepers = nullptr;
+    /// Number of threads in `sleepers`, so unpausing can skip taking the lock
+    /// when no thread is paused.
+    std::atomic<size_t> sleeper_count = 0;
     std::atomic_uint64_t barrier_count = 0;
     T* first_thread = nullptr;
 #ifdef USE_SYSTEMATIC_TESTING
@@ -64,6 +82,34 @@ namespace verona::rt
     Topology topology;
 
   public:
+    /**
+     * Returns the statistics of all the scheduler threads added together.
+     *
+     * This does not stop or synchronise with the scheduler threads, so it can
+     * be called from a behaviour, or from another thread, while the scheduler
+     * is running.  The result is not an atomic snapshot: each count is read
+     * at some point during the call.  It must not race with `run` returning.
+     *
+     * The statistics are only kept when built with USE_SCHED_STATS.
+     **/
+    static SchedulerStats snapshot_stats()
+    {
+      SchedulerStats result = SchedulerStats::empty_snapshot();
+      T* first = get().first_thread;
+      T* t = first;
+
+      if (t == nullptr)
+        return result;
+
+      do
+      {
+        result.add(t->stats);
+        t = t->next;
+      } while (t != first);
+
+      return result;
+    }
+
     static ThreadPool<T>& get()
     {
       static ThreadPool<T> global_thread_pool;
@@ -80,26 +126,97 @@ namespace verona::rt
       return get().detect_leaks;
     }
 
+    /**
+     * Makes leak detection generational.  A cown that has survived
+     * `promotion_age` leak detections is promoted.  Most leak detections are
+     * then minor ones, which neither trace nor collect a promoted cown, unless
+     * a behaviour has run on it, or it held an unpromoted cown, when it was
+     * last traced.  Every `full_interval`th leak detection is a full one,
+     * which traces and collects promoted cowns as well.
+     *
+     * Only cowns created on a scheduler thread are promoted.  A
+     * `promotion_age` of zero, the default, turns this off.  This must be
+     * called before the scheduler is started.
+     **/
+    static void set_generational_ld(size_t promotion_age, size_t full_interval)
+    {
+      auto& s = get();
+      s.ld_promotion_age = std::min<size_t>(promotion_age, UINT8_MAX);
+      s.full_ld_interval = full_interval;
+    }
+
+    static size_t get_ld_promotion_age()
+    {
+      return get().ld_promotion_age;
+    }
+
+    /**
+     * Returns true if the `count`th leak detection is a minor one.
+     **/
+    static bool is_minor_ld(size_t count)
+    {
+      auto& s = get();
+      return (s.ld_promotion_age != 0) && (s.full_ld_interval > 1) &&
+        ((count % s.full_ld_interval) != 0);
+    }
+
+    /**
+     * Counts a message that has been sent that may not be visible to a thread
+     * in a Scan state.  The count is kept by the sending thread, so sends
+     * during leak detection do not contend on a shared counter.
+     **/
     static void record_inflight_message()
     {
-      Systematic::cout() << "Increase inflight count: "
-                         << get().inflight_count + 1 << std::endl;
-      local()->scheduled_unscanned_cown = true;
-      get().inflight_count++;
+      T* t = local();
+      Systematic::cout() << "Increase inflight count" << std::endl;
+      t->scheduled_unscanned_cown = true;
+      t->inflight_sent.store(
+        t->inflight_sent.load(std::memory_order_relaxed) + 1,
+        std::memory_order_release);
     }
 
     static void recv_inflight_message()
     {
-      Systematic::cout() << "Decrease inflight count: "
-                         << get().inflight_count - 1 << std::endl;
-      get().inflight_count--;
+      T* t = local();
+      Systematic::cout() << "Decrease inflight count" << std::endl;
+      t->inflight_received.store(
+        t->inflight_received.load(std::memory_order_relaxed) + 1,
+        std::memory_order_release);
     }
 
+    /**
+     * Returns true if every message counted by `record_inflight_message` has
+     * been received.
+     *
+     * The receive counts are all read before the send counts.  A receive is
+     * ordered after its send, so any receive that is seen has its send seen
+     * too, and a send that is missed means there is no matching receive to
+     * cancel it out.  Reading them in the other order could pair a late
+     * receive with an unrelated outstanding send, and report zero.
+     **/
     static bool no_inflight_messages()
     {
-      Systematic::cout() << "Check inflight count: " << get().inflight_count
+      T* first = get().first_thread;
+      size_t received = 0;
+      size_t sent = 0;
+
+      T* t = first;
+      do
+      {
+        received += t->inflight_received.load(std::memory_order_acquire);
+        t = t->next;
+      } while (t != first);
+
+      t = first;
+      do
+      {
+        sent += t->inflight_sent.load(std::memory_order_acquire);
+        t = t->next;
+      } while (t != first);
+
+      Systematic::cout() << "Check inflight count: " << (sent - received)
                          << std::endl;
-      return get().inflight_count == 0;
+      return sent == received;
     }
 
     static void set_allow_teardown(bool allow)
@@ -111,6 +228,19 @@ namespace verona::rt
         s.unpause();
     }
 
+    /**
+     * Sets the number of ticks a thread must spend without finding work, since
+     * the last unpause, before it pauses, and the minimum number of ticks
+     * between unpauses.  Larger values burn more CPU while idle, but reduce
+     * the latency of new work arriving, and the number of wake ups.
+     **/
+    static void set_pause_slop(uint64_t pause, uint64_t unpause)
+    {
+      auto& s = get();
+      s.pause_slop = pause;
+      s.unpause_slop = unpause;
+    }
+
     static void set_fair(bool fair)
     {
       Systematic::cout() << "Set fair: " << fair << std::endl;
@@ -397,8 +527,17 @@ namespace verona::rt
       size_t i = 0;
       T* t = first_thread;
 
+      // Record where every thread will run before starting any of them, as
+      // each thread orders its steal victims by distance when it starts.
+      do
+      {
+        t->location = topology.location(i++);
+        t = t->next;
+      } while (t != first_thread);
+
       Systematic::cout() << "Starting all threads" << std::endl;
 
+      i = 0;
       do
       {
         t->template start<Args...>(topology.get(i++), startup, args...);
@@ -439,10 +578,76 @@ namespace verona::rt
       return state.next(s, thread_count);
     }
 
+    /**
+     * Parks the calling thread until it is woken by `wake_one` or
+     * `wake_all_locked`.  `lock` must be held on `m`, and is released while
+     * parked.
+     **/
+    void park(std::unique_lock<std::mutex>& lock)
+    {
+      T* me = local();
+      me->next_sleeper = sleepers;
+      sleepers = me;
+      sleeper_count.fetch_add(1, std::memory_order_relaxed);
+
+      lock.unlock();
+      me->parker.park();
+      lock.lock();
+    }
+
+    /**
+     * Wakes `prefer` if it is paused, and otherwise the most recently paused
+     * thread, if there is one.
+     **/
+    bool wake_one(T* prefer)
+    {
+      if (sleeper_count.load(std::memory_order_relaxed) == 0)
+        return false;
+
+      T* t;
+      {
+        std::unique_lock<std::mutex> lock(m);
+        T** prev = &sleepers;
+
+        if (prefer != nullptr)
+        {
+          while ((*prev != nullptr) && (*prev != prefer))
+            prev = &(*prev)->next_sleeper;
+
+          if (*prev == nullptr)
+            prev = &sleepers;
+        }
+
+        t = *prev;
+        if (t == nullptr)
+          return false;
+
+        *prev = t->next_sleeper;
+        sleeper_count.fetch_sub(1, std::memory_order_relaxed);
+      }
+
+      t->parker.unpark();
+      return true;
+    }
+
+    /**
+     * Wakes every paused thread.  Must be called with `m` held.
+     **/
+    void wake_all_locked()
+    {
+      while (sleepers != nullptr)
+      {
+        T* t = sleepers;
+        sleepers = t->next_sleeper;
+        sleeper_count.fetch_sub(1, std::memory_order_relaxed);
+        t->parker.unpark();
+      }
+    }
+
     bool pause(uint64_t tsc)
     {
 #ifndef USE_SYSTEMATIC_TESTING
-      if ((tsc - last_unpause_tsc) < TSC_PAUSE_SLOP)
+      if ((tsc - last_unpause_tsc) < pause_slop)
         return false;
 #else
       UNUSED(tsc);
@@ -459,7 +664,7 @@ namespace verona::rt
           cv_wait();
           lock.lock();
 #else
-          cv.wait(lock);
+          park(lock);
 #endif
           active_thread_count++;
           Systematic::cout() << "Unpausing" << std::endl;
@@ -478,7 +683,7 @@ namespace verona::rt
             lock.unlock();
             cv_notify_all();
 #else
-            cv.notify_all();
+            wake_all_locked();
 #endif
             return true;
           }
@@ -501,7 +706,7 @@ namespace verona::rt
 #ifdef USE_SYSTEMATIC_TESTING
               cv_notify_all();
 #else
-              cv.notify_all();
+              wake_all_locked();
 #endif
               return true;
             }
@@ -509,11 +714,19 @@ namespace verona::rt
           } while (t != first_thread);
 
           Systematic::cout() << "Runtime pausing" << std::endl;
+#ifdef USE_SYSTEMATIC_TESTING
           cv.wait(lock);
+#else
+          park(lock);
+#endif
 
           Systematic::cout() << "Runtime unpausing" << std::endl;
           runtime_pausing++;
+#ifdef USE_SYSTEMATIC_TESTING
           cv.notify_all();
+#else
+          wake_all_locked();
+#endif
 
           return true;
         }
@@ -542,14 +755,22 @@ namespace verona::rt
         t = t->next;
       } while (t != first_thread);
 #else
-      cv.notify_all();
+      {
+        std::unique_lock<std::mutex> lock(m);
+        wake_all_locked();
+      }
 #endif
       Systematic::cout() << "Teardown: all threads beginning teardown"
                          << std::endl;
       return true;
     }
 
-    bool unpause()
+    /**
+     * Called when there is new work that a paused thread could pick up.  If
+     * the work was added to the queue of a thread that may be paused, such as
+     * from outside the runtime, that thread should be passed as `owner`.
+     **/
+    bool unpause(T* owner = nullptr)
     {
       Barrier::compiler();
 
@@ -563,7 +784,11 @@ namespace verona::rt
 #ifdef USE_SYSTEMATIC_TESTING
           cv_notify_all();
 #else
-          cv.notify_all();
+          if (sleeper_count.load(std::memory_order_relaxed) != 0)
+          {
+            std::unique_lock<std::mutex> lock(m);
+            wake_all_locked();
+          }
 #endif
         } while (runtime_pausing == pausing);
         Systematic::cout() << "Unpausing other threads." << std::endl;
@@ -576,9 +801,15 @@ namespace verona::rt
       uint64_t elapsed = now - last_unpause_tsc;
       last_unpause_tsc = now;
 
-      if (elapsed < TSC_UNPAUSE_SLOP)
+      if (elapsed < unpause_slop)
         return false;
-#endif
+
+      // Wake a single thread.  If there is more work than it can handle, it
+      // will unpause another when it schedules or steals a batch.
+      if (!wake_one(owner))
+        return false;
+#else
+      UNUSED(owner);
 
       {
         std::unique_lock<std::mutex> lock(m);
@@ -587,10 +818,7 @@ namespace verona::rt
           return false;
       }
 
-#ifdef USE_SYSTEMATIC_TESTING
       cv_notify_all();
-#else
-      cv.notify_all();
 #endif
       Systematic::cout() << "Unpausing other threads." << std::endl;
 
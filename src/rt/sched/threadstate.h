@@ -107,6 +107,51 @@ namespace verona::rt
       Finished,
     };
 
+    // The states grouped by what a scheduler thread is doing, for reporting
+    // how long each part of the protocol takes.
+    enum Phase
+    {
+      Idle,
+      PreScanPhase,
+      ScanPhase,
+      VotePhase,
+      SweepPhase,
+      PhaseCount,
+    };
+
+    static Phase phase(State s)
+    {
+      switch (s)
+      {
+        case PreScan:
+          return PreScanPhase;
+
+        case Scan:
+        case AllInScan:
+        case ReallyDone_Retract:
+          return ScanPhase;
+
+        case BelieveDone_Vote:
+        case BelieveDone_Voted:
+        case BelieveDone:
+        case BelieveDone_Confirm:
+        case BelieveDone_Retract:
+        case BelieveDone_Ack:
+        case ReallyDone:
+        case ReallyDone_Confirm:
+          return VotePhase;
+
+        case Sweep:
+          return SweepPhase;
+
+        case NotInLD:
+        case WantLD:
+        case Finished:
+        default:
+          return Idle;
+      }
+    }
+
   private:
     State state;
     bool retracted;
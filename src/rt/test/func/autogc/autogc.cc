@@ -0,0 +1,151 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <test/harness.h>
+
+/**
+ * Checks that regions owned by cowns are collected at the end of the
+ * behaviour that grew them past the allocation-driven GC threshold, and that
+ * this keeps the regions bounded without losing reachable objects.  Regions
+ * that a behaviour sends on are left for their new owner.
+ **/
+static constexpr size_t growth = 2;
+static constexpr size_t min_bytes = 4096;
+static constexpr size_t garbage = 100;
+static constexpr size_t owners = 4;
+
+size_t steps = 100;
+
+struct Node : public V<Node>
+{
+  Node* next = nullptr;
+
+  void trace(ObjectStack* st) const
+  {
+    if (next != nullptr)
+      st->push(next);
+  }
+};
+
+struct Owner : public VCown<Owner>
+{
+  Node* region;
+  size_t live = 0;
+  size_t runs = 0;
+
+  Owner()
+  {
+    region = new (ThreadAlloc::get()) Node;
+  }
+
+  void trace(ObjectStack* st) const
+  {
+    st->push(region);
+  }
+};
+
+struct Churn : public VAction<Churn>
+{
+  Owner* o;
+
+  Churn(Owner* o) : o(o) {}
+
+  void f()
+  {
+    auto* alloc = ThreadAlloc::get();
+    Node* r = o->region;
+
+    // The previous behaviour either collected the region, or left it below
+    // its threshold.
+    check(!RegionTrace::is_gc_deferred(r));
+    size_t bound = std::max(min_bytes, growth * (o->live + 1) * sizeof(Node));
+    check(Region::debug_size(r) * sizeof(Node) <= bound);
+
+    for (size_t i = 0; i < garbage; i++)
+    {
+      Node* n = new (alloc, r) Node;
+      n->next = new (alloc, r) Node;
+    }
+
+    Node* n = new (alloc, r) Node;
+    n->next = r->next;
+    r->next = n;
+    o->live++;
+
+    if (++o->runs < steps)
+      return;
+
+    // Nothing reachable was collected.
+    size_t length = 0;
+    for (Node* p = r->next; p != nullptr; p = p->next)
+      length++;
+    check(length == o->live);
+    check(RegionTrace::auto_gc_stats().collections > 0);
+  }
+};
+
+/**
+ * Hands a region on to the next behaviour, after growing it past its
+ * threshold.  Once it is sent, the collection that was deferred must not
+ * run, as the region may already be in use on another thread.
+ **/
+struct Pass : public VAction<Pass>
+{
+  Owner* o;
+  Node* region;
+  size_t size;
+  size_t hops;
+
+  Pass(Owner* o, Node* region, size_t size, size_t hops)
+  : o(o), region(region), size(size), hops(hops)
+  {}
+
+  void trace(ObjectStack* st) const
+  {
+    st->push(region);
+  }
+
+  void f()
+  {
+    auto* alloc = ThreadAlloc::get();
+    check(!RegionTrace::is_gc_deferred(region));
+    check(Region::debug_size(region) == size);
+
+    if (hops == 0)
+    {
+      Region::release(alloc, region);
+      return;
+    }
+
+    // Grow the region until a collection of it is deferred, then send it.
+    while (!RegionTrace::is_gc_deferred(region))
+      new (alloc, region) Node;
+
+    Cown::schedule<Pass>(
+      o, o, region, Region::debug_size(region), hops - 1);
+  }
+};
+
+void test_autogc()
+{
+  auto* alloc = ThreadAlloc::get();
+  RegionTrace::set_gc_growth(growth, min_bytes);
+
+  for (size_t i = 0; i < owners; i++)
+  {
+    auto o = new Owner;
+    for (size_t j = 0; j < steps; j++)
+      Cown::schedule<Churn>(o, o);
+
+    auto* r = new (alloc) Node;
+    Cown::schedule<Pass>(o, o, r, Region::debug_size(r), steps);
+    Cown::release(alloc, o);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  SystematicTestHarness harness(argc, argv);
+  steps = harness.opt.is<size_t>("--steps", steps);
+  harness.run(test_autogc);
+  return 0;
+}
@@ -0,0 +1,85 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <test/harness.h>
+
+/**
+ * Checks that every batch policy processes all messages, in order, whether it
+ * is selected by the cown type or set at runtime.
+ **/
+static constexpr size_t messages = 1000;
+
+struct Fixed : public VCown<Fixed>
+{
+  size_t count = 0;
+
+  static BatchPolicy batch_policy()
+  {
+    return BatchPolicy::fixed(3);
+  }
+};
+
+struct Adaptive : public VCown<Adaptive>
+{
+  size_t count = 0;
+
+  static BatchPolicy batch_policy()
+  {
+    return BatchPolicy::adaptive(10'000);
+  }
+};
+
+struct Runtime : public VCown<Runtime>
+{
+  size_t count = 0;
+};
+
+template<typename C>
+struct Check : public VAction<Check<C>>
+{
+  C* c;
+  size_t expected;
+
+  Check(C* c, size_t expected) : c(c), expected(expected) {}
+
+  void f()
+  {
+    check(c->count == expected);
+    c->count++;
+  }
+};
+
+template<typename C>
+void send_all(C* c)
+{
+  for (size_t i = 0; i < messages; i++)
+    Cown::schedule<Check<C>>(c, c, i);
+}
+
+void test_batch_policy()
+{
+  auto* alloc = ThreadAlloc::get();
+
+  auto fixed = new Fixed;
+  check(fixed->get_batch_policy().get_kind() == BatchPolicy::Fixed);
+  send_all(fixed);
+
+  auto adaptive = new Adaptive;
+  check(adaptive->get_batch_policy().get_kind() == BatchPolicy::Adaptive);
+  send_all(adaptive);
+
+  auto runtime = new Runtime;
+  check(runtime->get_batch_policy().get_kind() == BatchPolicy::Fixed);
+  runtime->set_batch_policy(BatchPolicy::time_budget(10'000));
+  send_all(runtime);
+
+  Cown::release(alloc, fixed);
+  Cown::release(alloc, adaptive);
+  Cown::release(alloc, runtime);
+}
+
+int main(int argc, char** argv)
+{
+  SystematicTestHarness harness(argc, argv);
+  harness.run(test_batch_policy);
+  return 0;
+}
@@ -0,0 +1,105 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+/**
+ * Stresses the inflight message accounting used by the leak detector.
+ *
+ * A ring of cowns, each holding a reference to the next, is only kept alive by
+ * its own cycle once the test has started.  Several chains of behaviours walk
+ * around the ring, each acquiring two cowns at a time, while repeatedly asking
+ * for leak detection.  Multi-cown behaviours sent during PreScan and Scan are
+ * counted as inflight on the sending thread, and received on whichever thread
+ * acquires their last cown, so the per-thread counts only balance when summed.
+ *
+ * If leak detection ever completed with a message still inflight, it could
+ * collect the ring while a chain was still walking it.
+ **/
+#include <test/harness.h>
+
+struct Node : public VCown<Node>
+{
+  Node* next = nullptr;
+
+  void trace(ObjectStack* st) const
+  {
+    if (next != nullptr)
+      st->push(next);
+  }
+};
+
+static std::atomic<size_t> remaining_hops;
+static size_t ld_every;
+
+struct Hop : public VAction<Hop>
+{
+  Node* a;
+  Node* b;
+  size_t hops;
+
+  Hop(Node* a, Node* b, size_t hops) : a(a), b(b), hops(hops) {}
+
+  void f()
+  {
+    check(a->next != nullptr);
+    check(b->next != nullptr);
+    remaining_hops--;
+
+    if ((hops % ld_every) == 0)
+      Scheduler::want_ld();
+
+    if (hops == 0)
+      return;
+
+    // Only follow references from the cowns we have acquired.  As `a` and `b`
+    // are distinct, so are their successors.
+    Node* na = a->next;
+    Node* nb = b->next;
+
+    Cown* cowns[2] = {na, nb};
+    Cown::schedule<Hop>(2, cowns, na, nb, hops - 1);
+  }
+};
+
+static size_t nodes;
+static size_t chains;
+static size_t hops;
+
+void run_test()
+{
+  // Check the previous seed ran every hop.
+  check(remaining_hops == 0);
+  remaining_hops = chains * (hops + 1);
+
+  std::vector<Node*> ring(nodes);
+  for (size_t i = 0; i < nodes; i++)
+    ring[i] = new Node;
+
+  for (size_t i = 0; i < chains; i++)
+  {
+    Node* a = ring[(i * 2) % nodes];
+    Node* b = ring[(i * 2 + 1) % nodes];
+    Cown* cowns[2] = {a, b};
+    Cown::schedule<Hop>(2, cowns, a, b, hops);
+  }
+
+  // Give our reference to each node to its predecessor.
+  for (size_t i = 0; i < nodes; i++)
+    ring[i]->next = ring[(i + 1) % nodes];
+}
+
+int main(int argc, char** argv)
+{
+  SystematicTestHarness harness(argc, argv);
+
+  nodes = harness.opt.is<size_t>("--nodes", 17);
+  chains = harness.opt.is<size_t>("--chains", 8);
+  hops = harness.opt.is<size_t>("--hops", 200);
+  ld_every = harness.opt.is<size_t>("--ld_every", 10);
+
+  if (nodes < 3)
+    nodes = 3;
+
+  harness.run(run_test);
+
+  check(remaining_hops == 0);
+  return 0;
+}
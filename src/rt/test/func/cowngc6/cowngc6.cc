@@ -0,0 +1,210 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+/**
+ * Exercises generational leak detection.
+ *
+ * A root cown holds a few slots, each the head of a chain of nodes.  A
+ * stream of behaviours on the root visits the chains, and occasionally
+ * replaces one.  Visiting a node may give it a new child, drop its child,
+ * close a cycle back to it, or carry on down the chain.  Chains that are left
+ * alone long enough are promoted, and are then written again by later
+ * visits, so promoted nodes regularly come to hold unpromoted ones.  Dropped
+ * chains, and the cycles in them, are garbage for the leak detector, which
+ * is asked to run throughout.
+ *
+ * A node that is collected while still reachable is caught when a behaviour
+ * next runs on it.
+ *
+ * Run with `--generational <age>` to enable generational leak detection.
+ **/
+#include <test/harness.h>
+
+struct Node : public VCown<Node>
+{
+  Node* child = nullptr;
+  uint64_t state;
+  bool live = true;
+
+  Node(uint64_t seed) : state(seed | 1) {}
+
+  ~Node()
+  {
+    live = false;
+  }
+
+  // Only used while this node is acquired.
+  uint64_t next()
+  {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+
+  void trace(ObjectStack* st) const
+  {
+    if (child != nullptr)
+      st->push(child);
+  }
+};
+
+// Builds a chain of `length` new nodes, and returns its head.
+static Node* chain(size_t length, uint64_t seed)
+{
+  Node* head = new Node(seed);
+  Node* n = head;
+
+  for (size_t i = 1; i < length; i++)
+  {
+    n->child = new Node(seed + i);
+    n = n->child;
+  }
+
+  return head;
+}
+
+static constexpr size_t SLOTS = 8;
+static size_t steps;
+static size_t ld_every;
+static std::atomic<size_t> visits;
+
+struct Visit : public VAction<Visit>
+{
+  Node* node;
+  size_t depth;
+
+  Visit(Node* node, size_t depth) : node(node), depth(depth) {}
+
+  void f()
+  {
+    check(node->live);
+    visits++;
+
+    if (node->child != nullptr)
+      check(node->child->live);
+
+    auto* alloc = ThreadAlloc::get();
+    uint64_t r = node->next();
+
+    switch (r % 8)
+    {
+      case 0:
+      {
+        // Give the node a new child, which is young.
+        Node* old = node->child;
+        node->child = chain(1 + ((r >> 8) % 3), r);
+        if (old != nullptr)
+          Cown::release(alloc, old);
+        break;
+      }
+
+      case 1:
+      {
+        Node* old = node->child;
+        node->child = nullptr;
+        if (old != nullptr)
+          Cown::release(alloc, old);
+        break;
+      }
+
+      case 2:
+      {
+        // Close a cycle: a new child refers back to this node.
+        Node* old = node->child;
+        Node* back = new Node(r);
+        Cown::acquire(node);
+        back->child = node;
+        node->child = back;
+        if (old != nullptr)
+          Cown::release(alloc, old);
+        break;
+      }
+
+      default:
+      {
+        if ((depth > 0) && (node->child != nullptr))
+          Cown::schedule<Visit>(node->child, node->child, depth - 1);
+        break;
+      }
+    }
+  }
+};
+
+struct Root : public VCown<Root>
+{
+  Node* slots[SLOTS] = {};
+  uint64_t state = 0x9e3779b97f4a7c15;
+
+  uint64_t next()
+  {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+
+  void trace(ObjectStack* st) const
+  {
+    for (auto n : slots)
+    {
+      if (n != nullptr)
+        st->push(n);
+    }
+  }
+};
+
+struct Step : public VAction<Step>
+{
+  Root* root;
+  size_t remaining;
+
+  Step(Root* root, size_t remaining) : root(root), remaining(remaining) {}
+
+  void f()
+  {
+    uint64_t r = root->next();
+    size_t i = r % SLOTS;
+
+    if (root->slots[i] == nullptr)
+    {
+      // Nodes are created on a scheduler thread, so they can be promoted.
+      root->slots[i] = chain(1 + ((r >> 8) % 4), r);
+    }
+    else if (((r >> 8) % 16) == 0)
+    {
+      // Drop the whole chain, and start a new one.
+      Cown::release(ThreadAlloc::get(), root->slots[i]);
+      root->slots[i] = chain(1 + ((r >> 12) % 4), r);
+    }
+    else
+    {
+      Cown::schedule<Visit>(root->slots[i], root->slots[i], (size_t)4);
+    }
+
+    if ((remaining % ld_every) == 0)
+      Scheduler::want_ld();
+
+    if (remaining > 0)
+      Cown::schedule<Step>(root, root, remaining - 1);
+  }
+};
+
+void run_test()
+{
+  auto* root = new Root;
+  Cown::schedule<Step>(root, root, steps);
+  Cown::release(ThreadAlloc::get(), root);
+}
+
+int main(int argc, char** argv)
+{
+  SystematicTestHarness harness(argc, argv);
+
+  steps = harness.opt.is<size_t>("--steps", 200);
+  ld_every = harness.opt.is<size_t>("--ld_every", 5);
+
+  harness.run(run_test);
+
+  check(visits > 0);
+  return 0;
+}
@@ -0,0 +1,182 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <test/harness.h>
+
+/**
+ * Checks that references to immutables stashed by DeferredRC keep the graph
+ * alive until they are flushed, and no longer, including when references
+ * are acquired and released on different scheduler threads.
+ **/
+static constexpr size_t readers = 4;
+
+size_t steps = 100;
+
+struct Alive : public VCown<Alive>
+{};
+
+struct Node : public V<Node>
+{
+  static inline std::atomic<size_t> live = 0;
+
+  Node* next = nullptr;
+  Node* head = nullptr;
+  Alive* alive = nullptr;
+  size_t value = 0;
+
+  ~Node()
+  {
+    live--;
+  }
+
+  void trace(ObjectStack* st) const
+  {
+    if (next != nullptr)
+      st->push(next);
+
+    if (head != nullptr)
+      st->push(head);
+
+    if (alive != nullptr)
+      st->push(alive);
+  }
+};
+
+/**
+ * Builds and freezes a list of `length` nodes, whose last node refers to a
+ * cown.  Each node refers back to the head, so the list is a single SCC.
+ **/
+Node* make_graph(Alloc* alloc, size_t length)
+{
+  auto* r = new (alloc) Node;
+  Node* n = r;
+  for (size_t i = 1; i < length; i++)
+  {
+    n->next = new (alloc, r) Node;
+    n = n->next;
+    n->head = r;
+    n->value = i;
+  }
+
+  Node::live += length;
+  n->alive = new Alive;
+  RegionTrace::insert<YesTransfer>(alloc, r, n->alive);
+  Freeze::apply(alloc, r);
+  return r;
+}
+
+void test_stash()
+{
+  auto* alloc = ThreadAlloc::get();
+  auto* r = make_graph(alloc, 3);
+  auto* n = r->next;
+
+  // Releases are stashed, and acquires use them.
+  DeferredRC::acquire(n);
+  check(r->debug_test_rc(2));
+  DeferredRC::release(alloc, r);
+  check(r->debug_test_rc(2));
+  check(DeferredRC::debug_stashed(n) == 1);
+  DeferredRC::acquire(r);
+  check(r->debug_test_rc(2));
+  check(DeferredRC::debug_stashed(r) == 0);
+
+  // Mixes with the immediate operations.
+  Immutable::acquire(r);
+  DeferredRC::release(alloc, r);
+  DeferredRC::release(alloc, n);
+  check(r->debug_test_rc(3));
+  check(DeferredRC::debug_stashed(r) == 2);
+
+  // The last reference is stashed, so the graph is kept until the stash is
+  // flushed, and then the epoch has advanced.
+  DeferredRC::release(alloc, r);
+  check(Node::live == 3);
+  DeferredRC::flush(alloc);
+  check(DeferredRC::debug_stashed(r) == 0);
+  Epoch(alloc).flush_local();
+  check(Node::live == 0);
+}
+
+struct Reader : public VCown<Reader>
+{
+  Node* graph = nullptr;
+  size_t runs = 0;
+
+  void trace(ObjectStack* st) const
+  {
+    if (graph != nullptr)
+      st->push(graph);
+  }
+};
+
+struct Read : public VAction<Read>
+{
+  Reader* reader;
+  Node* graph;
+
+  Read(Reader* reader, Node* graph) : reader(reader), graph(graph) {}
+
+  void trace(ObjectStack* st) const
+  {
+    st->push(graph);
+  }
+
+  void f()
+  {
+    auto* alloc = ThreadAlloc::get();
+
+    // Hold one reference across behaviours, which may run on different
+    // threads, and take and drop another within this one.
+    if (reader->graph != nullptr)
+      DeferredRC::release(alloc, reader->graph);
+
+    DeferredRC::acquire(graph);
+    reader->graph = graph;
+
+    DeferredRC::acquire(graph);
+    size_t length = 0;
+    for (Node* n = graph; n != nullptr; n = n->next)
+      check(n->value == length++);
+    check(Node::live >= length);
+    DeferredRC::release(alloc, graph);
+
+    // The message's reference was acquired on the main thread.
+    DeferredRC::release(alloc, graph);
+
+    if (++reader->runs == steps)
+    {
+      DeferredRC::release(alloc, reader->graph);
+      reader->graph = nullptr;
+    }
+  }
+};
+
+void test_readers()
+{
+  auto* alloc = ThreadAlloc::get();
+  auto* graph = make_graph(alloc, 10);
+
+  for (size_t i = 0; i < readers; i++)
+  {
+    auto* r = new Reader;
+    for (size_t j = 0; j < steps; j++)
+    {
+      Immutable::acquire(graph);
+      Cown::schedule<Read>(r, r, graph);
+    }
+    Cown::release(alloc, r);
+  }
+
+  Immutable::release(alloc, graph);
+}
+
+int main(int argc, char** argv)
+{
+  test_stash();
+
+  SystematicTestHarness harness(argc, argv);
+  steps = harness.opt.is<size_t>("--steps", steps);
+  harness.run(test_readers);
+  check(Node::live == 0);
+  return 0;
+}
@@ -9,8 +9,7 @@
 using namespace snmalloc;
 using namespace verona::rt;
 
-// This only tests trace regions.
-// At the moment, it does not make sense to freeze arena regions.
+// Most of these test trace regions, the arena tests are at the end.
 
 struct C1 : public V<C1>
 {
@@ -449,6 +448,162 @@ void test_random(size_t seed = 1, size_t max_edges = 128)
   snmalloc::current_alloc_pool()->debug_check_empty();
 }
 
+/**
+ * An object in an arena region, which may refer to anything.
+ **/
+template<size_t padding = 0>
+struct A : public V<A<padding>, RegionType::Arena>
+{
+  static inline int live = 0;
+
+  Object* f1 = nullptr;
+  Object* f2 = nullptr;
+  char pad[padding + 1];
+
+  A()
+  {
+    live++;
+  }
+
+  ~A()
+  {
+    live--;
+  }
+
+  void trace(ObjectStack* st) const
+  {
+    if (f1 != nullptr)
+      st->push(f1);
+
+    if (f2 != nullptr)
+      st->push(f2);
+  }
+
+  void trace_possibly_iso(ObjectStack* st)
+  {
+    trace(st);
+  }
+};
+
+struct AC : public V<AC, RegionType::Arena>
+{
+  AC* f1 = nullptr;
+
+  void trace(ObjectStack* st) const
+  {
+    if (f1 != nullptr)
+      st->push(f1);
+  }
+};
+
+// Too large for an arena, so is in the large object ring.
+using ALarge = A<1024 * 1024>;
+
+void test_arena()
+{
+  // Everything reachable is frozen into one SCC, rooted at the region
+  // metadata object, whatever the shape of the graph.
+  auto* alloc = ThreadAlloc::get();
+
+  auto* o1 = new (alloc) A<>;
+  auto* o2 = new (alloc, o1) A<>;
+  auto* o3 = new (alloc, o1) AC;
+  auto* o4 = new (alloc, o1) AC;
+  auto* o5 = new (alloc, o1) ALarge;
+
+  o1->f1 = o2;
+  o1->f2 = o3;
+  o2->f1 = o5;
+  o3->f1 = o4;
+  o5->f1 = o1;
+
+  // Unreachable.
+  auto* g = new (alloc, o1) A<>;
+  g->f1 = o1;
+  new (alloc, o1) ALarge;
+  new (alloc, o1) AC;
+
+  check(A<>::live == 3);
+  check(ALarge::live == 2);
+
+  Freeze::apply(alloc, o1);
+
+  // The unreachable objects are finalised.
+  check(A<>::live == 2);
+  check(ALarge::live == 1);
+
+  auto r = o1->debug_immutable_root();
+  check(r != o1);
+  check(r->debug_test_rc(1));
+  check(o2->debug_immutable_root() == r);
+  check(o3->debug_immutable_root() == r);
+  check(o4->debug_immutable_root() == r);
+  check(o5->debug_immutable_root() == r);
+
+  Immutable::acquire(o4);
+  check(r->debug_test_rc(2));
+  Immutable::release(alloc, o1);
+  check(A<>::live == 2);
+
+  Immutable::release(alloc, o4);
+  check(A<>::live == 0);
+  check(ALarge::live == 0);
+  UNUSED(r);
+
+  snmalloc::current_alloc_pool()->debug_check_empty();
+}
+
+void test_arena_nested()
+{
+  // An arena region nested in a trace region, which itself has a nested
+  // trace region, and refers to an existing immutable.
+  //
+  // [t1] -> [a1, a2] -> [t2]
+  //            |
+  //            v
+  //          imm
+  auto* alloc = ThreadAlloc::get();
+
+  auto* imm = new (alloc) C1;
+  Freeze::apply(alloc, imm);
+
+  auto* t1 = new (alloc) C1;
+  auto* a1 = new (alloc) A<>;
+  auto* a2 = new (alloc, a1) A<>;
+  auto* t2 = new (alloc) C1;
+  t2->f1 = new (alloc, t2) C1;
+
+  t1->f1 = (C1*)(Object*)a1;
+  a1->f1 = a2;
+  a2->f1 = t2;
+  a2->f2 = imm;
+  RegionArena::insert<YesTransfer>(alloc, a1, imm);
+
+  // Another region's iso, in unreachable memory in the arena, is left alone.
+  auto* t3 = new (alloc) C1;
+  (new (alloc, a1) A<>)->f1 = t3;
+
+  Freeze::apply(alloc, t1);
+
+  check(t1->debug_test_rc(1));
+  auto r = a1->debug_immutable_root();
+  check(r->debug_test_rc(1));
+  check(a2->debug_immutable_root() == r);
+  check(t2->debug_test_rc(1));
+  check(t2->f1->debug_immutable_root() == t2->f1);
+  check(t3->debug_is_iso());
+  UNUSED(r);
+
+  // The frozen arena region holds the only reference to imm.
+  check(imm->debug_test_rc(1));
+
+  Region::release(alloc, t3);
+  Immutable::release(alloc, t1);
+  check(A<>::live == 0);
+
+  snmalloc::current_alloc_pool()->debug_check_empty();
+}
+
 int main(int, char**)
 {
   test1();
@@ -458,6 +613,8 @@ int main(int, char**)
   test_two_rings_1();
   test_two_rings_2();
   freeze_weird_ring();
+  test_arena();
+  test_arena_nested();
 
   for (size_t i = 1; i < 10000; i++)
   {
@@ -0,0 +1,129 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <random>
+#include <test/harness.h>
+#include <unordered_set>
+
+using namespace snmalloc;
+using namespace verona::rt;
+
+/**
+ * Checks both probing schemes of PtrKeyHashMap against std::unordered_set,
+ * through rounds of random inserts and erases followed by marking a random
+ * subset of the entries and sweeping the rest.  Some entries are inserted
+ * while marking, which may grow the map.
+ **/
+struct Entry
+{
+  size_t key;
+};
+
+size_t& entry_key_of(Entry* e)
+{
+  return e->key;
+}
+
+template<HashMapProbe probe>
+void check_map(
+  PtrKeyHashMap<Entry, entry_key_of, probe>* map,
+  const std::unordered_set<size_t>& expected)
+{
+  using Map = PtrKeyHashMap<Entry, entry_key_of, probe>;
+
+  // The map may keep its own bits in the low bits of the key.
+  size_t count = 0;
+  for (auto& e : *map)
+  {
+    check(expected.count((size_t)Map::get_unmarked_pointer(e.key)) == 1);
+    count++;
+  }
+  check(count == expected.size());
+
+  for (auto key : expected)
+    check(map->find(key) != map->end());
+}
+
+template<HashMapProbe probe>
+void test_random(size_t seed, size_t rounds, size_t keys)
+{
+  using Map = PtrKeyHashMap<Entry, entry_key_of, probe>;
+  auto* alloc = ThreadAlloc::get();
+  auto* map = Map::create();
+  std::unordered_set<size_t> expected;
+  std::mt19937_64 rand(seed);
+
+  auto random_key = [&]() {
+    return ((rand() % keys) + 1) << MIN_ALLOC_BITS;
+  };
+
+  for (size_t round = 0; round < rounds; round++)
+  {
+    size_t ops = rand() % (keys / 2);
+    for (size_t i = 0; i < ops; i++)
+    {
+      auto key = random_key();
+      if ((rand() % 4) == 0)
+      {
+        map->erase((void*)key);
+        expected.erase(key);
+        check(map->find(key) == map->end());
+      }
+      else
+      {
+        Entry e{key};
+        size_t location;
+        check(map->insert(alloc, e, location) == expected.insert(key).second);
+        check(map->find(key).get_index() == location);
+      }
+    }
+
+    check_map(map, expected);
+
+    std::unordered_set<size_t> kept;
+    size_t marked = 0;
+    for (auto key : expected)
+    {
+      if ((rand() % 3) == 0)
+      {
+        map->mark_slot(map->find(key).get_index(), marked);
+        kept.insert(key);
+      }
+    }
+
+    for (size_t i = 0; i < keys / 16; i++)
+    {
+      auto key = random_key();
+      Entry e{key};
+      size_t location;
+      map->insert(alloc, e, location);
+      map->mark_slot(location, marked);
+      kept.insert(key);
+    }
+    check(marked == kept.size());
+
+    map->sweep_set(alloc, marked);
+    expected = std::move(kept);
+    check_map(map, expected);
+  }
+
+  map->clear(alloc);
+  check(map->begin() == map->end());
+
+  map->dealloc(alloc);
+  alloc->dealloc<sizeof(Map)>(map);
+  snmalloc::current_alloc_pool()->debug_check_empty();
+}
+
+int main(int argc, char** argv)
+{
+  (void)argc;
+  (void)argv;
+
+  for (size_t seed = 0; seed < 10; seed++)
+  {
+    test_random<HashMapProbe::RobinHood>(seed, 20, 1 << 12);
+    test_random<HashMapProbe::Swiss>(seed, 20, 1 << 12);
+  }
+
+  return 0;
+}
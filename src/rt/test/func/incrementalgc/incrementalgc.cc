@@ -0,0 +1,121 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <test/harness.h>
+
+/**
+ * Checks that regions owned by cowns are collected incrementally, a slice at
+ * the end of each behaviour that uses them, while the behaviours keep
+ * allocating and moving objects around through the write barrier, and that
+ * no reachable object is lost.
+ **/
+static constexpr size_t growth = 2;
+static constexpr size_t min_bytes = 4096;
+static constexpr size_t garbage = 50;
+static constexpr size_t owners = 4;
+
+size_t steps = 100;
+size_t budget = 16;
+
+struct Node : public V<Node>
+{
+  Node* next = nullptr;
+
+  void trace(ObjectStack* st) const
+  {
+    if (next != nullptr)
+      st->push(next);
+  }
+};
+
+struct Owner : public VCown<Owner>
+{
+  Node* region;
+  size_t live = 0;
+  size_t runs = 0;
+
+  Owner()
+  {
+    region = new (ThreadAlloc::get()) Node;
+  }
+
+  void trace(ObjectStack* st) const
+  {
+    st->push(region);
+  }
+};
+
+struct Churn : public VAction<Churn>
+{
+  Owner* o;
+
+  Churn(Owner* o) : o(o) {}
+
+  void f()
+  {
+    auto* alloc = ThreadAlloc::get();
+    Node* r = o->region;
+
+    for (size_t i = 0; i < garbage; i++)
+    {
+      Node* n = new (alloc, r) Node;
+      n->next = new (alloc, r) Node;
+    }
+
+    // Add a node at the front of the list.
+    Node* n = new (alloc, r) Node;
+    n->next = r->next;
+    Node::store(alloc, r, r->next, n);
+    o->live++;
+
+    // Move the second node to the end of the list, unlinking it from the
+    // part that may not have been marked yet.
+    Node* second = n->next;
+    if ((second != nullptr) && (second->next != nullptr))
+    {
+      Node::store(alloc, r, n->next, second->next);
+      Node::store(alloc, r, second->next, (Node*)nullptr);
+
+      Node* last = n;
+      while (last->next != nullptr)
+        last = last->next;
+      Node::store(alloc, r, last->next, second);
+    }
+
+    if (++o->runs < steps)
+      return;
+
+    // Nothing reachable was collected.
+    size_t length = 0;
+    for (Node* p = r->next; p != nullptr; p = p->next)
+      length++;
+    check(length == o->live);
+
+    auto& stats = RegionTrace::auto_gc_stats();
+    check(stats.collections > 0);
+    check(stats.slices > stats.collections);
+  }
+};
+
+void test_incremental_gc()
+{
+  auto* alloc = ThreadAlloc::get();
+  RegionTrace::set_gc_growth(growth, min_bytes);
+  RegionTrace::set_incremental_gc(budget, 0);
+
+  for (size_t i = 0; i < owners; i++)
+  {
+    auto o = new Owner;
+    for (size_t j = 0; j < steps; j++)
+      Cown::schedule<Churn>(o, o);
+    Cown::release(alloc, o);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  SystematicTestHarness harness(argc, argv);
+  steps = harness.opt.is<size_t>("--steps", steps);
+  budget = harness.opt.is<size_t>("--budget", budget);
+  harness.run(test_incremental_gc);
+  return 0;
+}
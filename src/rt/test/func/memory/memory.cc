@@ -3,11 +3,15 @@
 #include "memory.h"
 
 #include "memory_alloc.h"
+#include "memory_autogc.h"
+#include "memory_compact.h"
 #include "memory_gc.h"
+#include "memory_incremental.h"
 #include "memory_iterator.h"
 #include "memory_merge.h"
 #include "memory_subregion.h"
 #include "memory_swap_root.h"
+#include "memory_usage.h"
 
 #include <test/harness.h>
 #include <test/opt.h>
@@ -66,6 +70,10 @@ int main(int argc, char** argv)
   memory_merge::run_test();
   memory_gc::run_test();
   memory_subregion::run_test();
+  memory_autogc::run_test();
+  memory_incremental::run_test();
+  memory_compact::run_test();
+  memory_usage::run_test();
 
   test_alloc_pool();
   test_dealloc();
@@ -148,9 +148,85 @@ namespace memory_alloc
     }
   }
 
+  struct SmallArena : public V<SmallArena, RegionType::Arena>
+  {
+    SmallArena* next = nullptr;
+
+    void trace(ObjectStack* st) const
+    {
+      if (next != nullptr)
+        st->push(next);
+    }
+
+    static RegionArena::ArenaSizes arena_sizes()
+    {
+      return {RegionArena::MIN_ARENA_SIZE, 4 * RegionArena::MIN_ARENA_SIZE};
+    }
+  };
+
+  /**
+   * Tests that arenas start at the region's initial size, and double up to
+   * its maximum size.
+   **/
+  void test_arena_sizes()
+  {
+    auto* alloc = ThreadAlloc::get();
+    constexpr size_t min = RegionArena::MIN_ARENA_SIZE;
+
+    // The default is a single 1 MiB arena.
+    auto* d = new (alloc) C1<RegionType::Arena>;
+    assert(
+      RegionArena::memory_reserved(d) == RegionArena::DEFAULT_ARENA_SIZE);
+    Region::release(alloc, d);
+
+    auto* r = new (alloc) SmallArena;
+    assert(RegionArena::memory_reserved(r) == min);
+
+    // Fill the region until it has allocated 4 arenas: 4, 8, 16 and 16 KiB.
+    size_t count = 1;
+    while (RegionArena::memory_reserved(r) < 11 * min)
+    {
+      auto* n = new (alloc, r) SmallArena;
+      n->next = r->next;
+      r->next = n;
+      count++;
+    }
+    assert(RegionArena::memory_reserved(r) == 11 * min);
+
+    // An object larger than the usual arena gets an arena of its own.
+    new (alloc, r) MediumC2<RegionType::Arena>;
+    count++;
+    assert(
+      RegionArena::memory_reserved(r) ==
+      11 * min +
+        snmalloc::bits::align_up(
+          sizeof(MediumC2<RegionType::Arena>) + 4 * sizeof(uintptr_t), min));
+
+    // Objects too large for any arena go in the large object ring.
+    new (alloc, r) XLargeC2<RegionType::Arena>;
+    count++;
+
+    size_t seen = 0;
+    for (auto p : *RegionArena::get(r))
+    {
+      UNUSED(p);
+      seen++;
+    }
+    assert(seen == count);
+
+    // The arenas of a small region can be merged into a default one.
+    auto* m = new (alloc) C1<RegionType::Arena>;
+    RegionArena::merge(alloc, m, r);
+    new (alloc, m) C1<RegionType::Arena>;
+
+    Region::release(alloc, m);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+  }
+
   void run_test()
   {
     test_alloc<RegionType::Trace>();
     test_alloc<RegionType::Arena>();
+    test_arena_sizes();
   }
 }
\ No newline at end of file
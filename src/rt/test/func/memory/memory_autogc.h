@@ -0,0 +1,204 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include "memory.h"
+
+namespace memory_autogc
+{
+  constexpr auto region_type = RegionType::Trace;
+  using C = C1<region_type>;
+  using F = F1<region_type>;
+
+  /**
+   * Allocates unreachable objects in `o`'s region until a collection of it is
+   * deferred.  Returns the number of objects allocated.
+   **/
+  size_t grow_until_deferred(Alloc* alloc, Object* o)
+  {
+    size_t count = 0;
+    while (!RegionTrace::is_gc_deferred(o))
+    {
+      alloc_in_region<C, F>(alloc, o);
+      count += 2;
+      assert(count < 10000);
+    }
+    return count;
+  }
+
+  /**
+   * Without a policy, or outside of a behaviour, allocation does not trigger
+   * a collection.
+   **/
+  void test_off()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto* o = new (alloc) C;
+
+    RegionTrace::begin_deferred_gc();
+    for (size_t i = 0; i < 1000; i++)
+      alloc_in_region<C, F>(alloc, o);
+    assert(!RegionTrace::is_gc_deferred(o));
+    RegionTrace::end_deferred_gc(alloc);
+    assert(Region::debug_size(o) == 2001);
+
+    RegionTrace::set_gc_growth(2, 1024);
+    for (size_t i = 0; i < 1000; i++)
+      alloc_in_region<C, F>(alloc, o);
+    assert(!RegionTrace::is_gc_deferred(o));
+
+    RegionTrace::set_gc_growth(0);
+    Region::release(alloc, o);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+    assert(live_count == 0);
+  }
+
+  /**
+   * A region that grows past its threshold is collected at the end of the
+   * behaviour, and its next threshold is relative to what survived.
+   **/
+  void test_trigger()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto& stats = RegionTrace::auto_gc_stats();
+    size_t collections = stats.collections;
+    size_t reclaimed = stats.reclaimed_bytes;
+
+    RegionTrace::set_gc_growth(2, 1024);
+    auto* o = new (alloc) C;
+    o->f1 = new (alloc, o) C;
+
+    RegionTrace::begin_deferred_gc();
+    size_t garbage = grow_until_deferred(alloc, o);
+    assert(Region::debug_size(o) == 2 + garbage);
+
+    // Only one collection is deferred, however much more is allocated.
+    alloc_in_region<C, F>(alloc, o);
+    RegionTrace::end_deferred_gc(alloc);
+
+    assert(!RegionTrace::is_gc_deferred(o));
+    assert(Region::debug_size(o) == 2);
+    assert(live_count == 0);
+    assert(stats.collections == collections + 1);
+    assert(stats.reclaimed_bytes > reclaimed);
+
+    // Nothing is deferred once the behaviour is over.
+    for (size_t i = 0; i < 1000; i++)
+      alloc_in_region<C, F>(alloc, o);
+    assert(!RegionTrace::is_gc_deferred(o));
+
+    RegionTrace::set_gc_growth(0);
+    Region::release(alloc, o);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+    assert(live_count == 0);
+
+    UNUSED(collections);
+    UNUSED(reclaimed);
+    UNUSED(garbage);
+  }
+
+  /**
+   * A deferred collection is dropped if the region is collected, released or
+   * merged first, and follows the region's iso object if the root is
+   * swapped.
+   **/
+  void test_cancel()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto& stats = RegionTrace::auto_gc_stats();
+    size_t collections = stats.collections;
+
+    RegionTrace::set_gc_growth(2, 1024);
+    RegionTrace::begin_deferred_gc();
+
+    // Collected explicitly.
+    auto* o1 = new (alloc) C;
+    grow_until_deferred(alloc, o1);
+    RegionTrace::gc(alloc, o1);
+    assert(!RegionTrace::is_gc_deferred(o1));
+
+    // Released.
+    auto* o2 = new (alloc) F;
+    grow_until_deferred(alloc, o2);
+    Region::release(alloc, o2);
+
+    // Merged into a region that is not deferred.
+    auto* o3 = new (alloc) C;
+    auto* o4 = new (alloc) C;
+    grow_until_deferred(alloc, o4);
+    RegionTrace::merge(alloc, o3, o4);
+    o3->f1 = o4;
+
+    // Deferred, and then the root is swapped.
+    auto* n = new (alloc, o1) C;
+    n->f1 = o1;
+    grow_until_deferred(alloc, o1);
+    RegionTrace::swap_root(o1, n);
+    assert(RegionTrace::is_gc_deferred(n));
+
+    RegionTrace::end_deferred_gc(alloc);
+    assert(Region::debug_size(n) == 2);
+    assert(live_count == 0);
+
+    // The merged region was over its threshold, so the merge deferred a
+    // collection of the result.
+    assert(Region::debug_size(o3) == 2);
+    assert(stats.collections == collections + 2);
+    UNUSED(collections);
+
+    RegionTrace::set_gc_growth(0);
+    Region::release(alloc, n);
+    Region::release(alloc, o3);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+    assert(live_count == 0);
+  }
+
+  /**
+   * Sending a region to another behaviour drops the deferred collections of
+   * it and of the regions nested in it, but not of other regions.
+   **/
+  void test_send()
+  {
+    auto* alloc = ThreadAlloc::get();
+
+    RegionTrace::set_gc_growth(2, 1024);
+    RegionTrace::begin_deferred_gc();
+
+    auto* o1 = new (alloc) F;
+    o1->f1 = new (alloc, o1) F;
+    auto* sub = new (alloc) F;
+    o1->f1->f2 = sub;
+    auto* o2 = new (alloc) F;
+
+    grow_until_deferred(alloc, sub);
+    grow_until_deferred(alloc, o1);
+    grow_until_deferred(alloc, o2);
+
+    ObjectStack st(alloc);
+    st.push(o1);
+    RegionTrace::cancel_deferred_gc_from(alloc, st);
+    assert(st.empty());
+    assert(!RegionTrace::is_gc_deferred(o1));
+    assert(!RegionTrace::is_gc_deferred(sub));
+    assert(RegionTrace::is_gc_deferred(o2));
+
+    RegionTrace::end_deferred_gc(alloc);
+    assert(Region::debug_size(o1) > 2);
+    assert(Region::debug_size(sub) > 1);
+    assert(Region::debug_size(o2) == 1);
+
+    RegionTrace::set_gc_growth(0);
+    Region::release(alloc, o1);
+    Region::release(alloc, o2);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+    assert(live_count == 0);
+  }
+
+  void run_test()
+  {
+    test_off();
+    test_trigger();
+    test_cancel();
+    test_send();
+  }
+}
@@ -0,0 +1,308 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include "memory.h"
+
+namespace memory_compact
+{
+  struct Node : public V<Node>
+  {
+    Node* next = nullptr;
+    // Refers to a subregion, an immutable, or another node.
+    Object* other = nullptr;
+    size_t value = 0;
+
+    void trace(ObjectStack* st) const
+    {
+      if (next != nullptr)
+        st->push(next);
+
+      if (other != nullptr)
+        st->push(other);
+    }
+
+    void trace_possibly_iso(ObjectStack* st)
+    {
+      trace(st);
+    }
+
+    void trace_fields(FieldStack* st)
+    {
+      st->push((Object**)&next);
+      st->push(&other);
+    }
+  };
+
+  using C = C1<RegionType::Trace>;
+  using LC = LargeC2<RegionType::Trace>;
+
+  /**
+   * Builds a list of `length` nodes after the iso object `r`, with garbage
+   * allocated in between, and each node's `other` pointing back to the node
+   * that is half way along the list from it.
+   **/
+  void build(Alloc* alloc, Node* r, size_t length)
+  {
+    Node* prev = r;
+    Node* half = r;
+    for (size_t i = 1; i <= length; i++)
+    {
+      alloc_in_region<C, C>(alloc, r);
+
+      Node* n = new (alloc, r) Node;
+      n->value = i;
+      prev->next = n;
+      prev = n;
+
+      if ((i % 2) == 0)
+        half = half->next;
+      n->other = half;
+    }
+  }
+
+  void check_list(Node* r, size_t length)
+  {
+    Node* half = r;
+    size_t i = 0;
+    for (Node* n = r->next; n != nullptr; n = n->next)
+    {
+      i++;
+      assert(n->value == i);
+      if ((i % 2) == 0)
+        half = half->next;
+      assert(n->other == half);
+    }
+    assert(i == length);
+    UNUSED(length);
+  }
+
+  /**
+   * Compacting keeps the graph intact, frees the garbage, and lays the
+   * objects out in traversal order.
+   **/
+  void test_basic()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto* r = new (alloc) Node;
+    build(alloc, r, 100);
+
+    assert(RegionTrace::compact(alloc, r));
+    assert(Region::debug_size(r) == 101);
+    check_list(r, 100);
+
+    size_t stride =
+      snmalloc::bits::align_up(sizeof(Node), Object::ALIGNMENT);
+    for (Node* n = r->next; n->next != nullptr; n = n->next)
+      assert((uintptr_t)n->next == (uintptr_t)n + stride);
+    UNUSED(stride);
+
+    // Compacting again moves everything to a new block.
+    Node* first = r->next;
+    assert(RegionTrace::compact(alloc, r));
+    assert(r->next != first);
+    check_list(r, 100);
+    UNUSED(first);
+
+    // Drop the list, and collect it, which frees the block.
+    r->next = nullptr;
+    RegionTrace::gc(alloc, r);
+    assert(Region::debug_size(r) == 1);
+
+    Region::release(alloc, r);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+  }
+
+  /**
+   * A region with external references cannot be compacted.
+   **/
+  void test_ext_ref()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto* r = new (alloc) Node;
+    build(alloc, r, 10);
+
+    auto* ext = ExternalRef::create(Region::get(r), r->next->next);
+    assert(!RegionTrace::compact(alloc, r));
+    assert(Region::debug_size(r) == 31);
+    Immutable::release(alloc, ext);
+
+    // The entry goes once the object it refers to is collected.
+    r->next->next = nullptr;
+    RegionTrace::gc(alloc, r);
+    assert(RegionTrace::compact(alloc, r));
+    check_list(r, 1);
+
+    Region::release(alloc, r);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+  }
+
+  /**
+   * Fields that refer outside the region are left alone, and compacted
+   * regions can be merged, have their roots swapped, and be released.
+   **/
+  void test_outside()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto* r = new (alloc) Node;
+    build(alloc, r, 20);
+
+    // A subregion, and an immutable.
+    auto* sub = new (alloc) Node;
+    build(alloc, sub, 5);
+    r->next->other = sub;
+    auto* imm = new (alloc) C;
+    Freeze::apply(alloc, imm);
+    r->next->next->other = imm;
+    RegionTrace::insert<YesTransfer>(alloc, r, imm);
+
+    assert(RegionTrace::compact(alloc, r));
+    assert(r->next->other == sub);
+    assert(r->next->next->other == imm);
+    assert(Region::debug_size(sub) == 16);
+    check_list(sub, 5);
+
+    // Merge a compacted region into another, and swap the root to an object
+    // in the block.
+    auto* r2 = new (alloc) Node;
+    build(alloc, r2, 3);
+    assert(RegionTrace::compact(alloc, r2));
+    RegionTrace::merge(alloc, r, r2);
+    r->next->next->next->other = r2;
+
+    Node* n = r->next;
+    r->next = nullptr;
+    n->next->next->next->next = r;
+    RegionTrace::swap_root(r, n);
+    assert(RegionTrace::compact(alloc, n));
+    RegionTrace::gc(alloc, n);
+
+    Region::release(alloc, n);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+  }
+
+  /**
+   * A compacted region is frozen in place, along with the objects allocated
+   * in it since, and those it refers to.
+   **/
+  void test_freeze()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto* r = new (alloc) Node;
+    build(alloc, r, 50);
+    new (alloc, r) LC;
+
+    assert(RegionTrace::compact(alloc, r));
+
+    // An object without `trace_fields`, a subregion and an immutable.
+    auto* c = new (alloc, r) C;
+    c->f1 = new (alloc, r) C;
+    r->next->other = c;
+    auto* sub = new (alloc) Node;
+    build(alloc, sub, 5);
+    r->next->next->other = sub;
+    auto* imm = new (alloc) C;
+    Freeze::apply(alloc, imm);
+    r->next->next->next->other = imm;
+    RegionTrace::insert<YesTransfer>(alloc, r, imm);
+
+    Freeze::apply(alloc, r);
+    assert(r->debug_is_immutable());
+    assert(r->next->other == c);
+    assert(c->f1->debug_is_immutable());
+    assert(sub->debug_is_immutable());
+    check_list(sub, 5);
+
+    Immutable::release(alloc, r);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+  }
+
+  /**
+   * A region whose root has been swapped to an object in a block can be
+   * frozen, and the root is freed with the block.
+   **/
+  void test_freeze_swapped_root()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto* r = new (alloc) Node;
+    build(alloc, r, 20);
+
+    assert(RegionTrace::compact(alloc, r));
+    Node* n = r->next;
+    r->next = nullptr;
+    n->other = r;
+    RegionTrace::swap_root(r, n);
+
+    Freeze::apply(alloc, n);
+    assert(n->debug_is_immutable());
+    assert(n->other == r);
+    assert(r->debug_is_immutable());
+
+    Immutable::release(alloc, n);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+  }
+
+  /**
+   * A word that is not a field is left alone, even if it holds the address of
+   * an object that is moved.
+   **/
+  void test_not_field()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto* r = new (alloc) Node;
+    build(alloc, r, 10);
+
+    Node* n = r->next->next;
+    r->value = (size_t)n;
+
+    assert(RegionTrace::compact(alloc, r));
+    assert(r->next->next != n);
+    assert(r->value == (size_t)n);
+    check_list(r, 10);
+    UNUSED(n);
+
+    Region::release(alloc, r);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+  }
+
+  /**
+   * A region cannot be compacted if any of its objects do not report their
+   * fields.
+   **/
+  void test_no_fields()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto* r = new (alloc) Node;
+    build(alloc, r, 10);
+
+    auto* c = new (alloc, r) C;
+    r->next->next->other = c;
+
+    Node* n = r->next;
+    assert(!RegionTrace::compact(alloc, r));
+    assert(r->next == n);
+    assert(Region::debug_size(r) == 12);
+    assert(r->next->next->other == c);
+    UNUSED(n);
+
+    // Once that object is gone, it can be.
+    r->next->next->other = r->next;
+    assert(RegionTrace::compact(alloc, r));
+    assert(r->next != n);
+    assert(Region::debug_size(r) == 11);
+
+    Region::release(alloc, r);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+  }
+
+  void run_test()
+  {
+    test_basic();
+    test_not_field();
+    test_no_fields();
+    test_ext_ref();
+    test_outside();
+    test_freeze();
+    test_freeze_swapped_root();
+  }
+}
@@ -0,0 +1,273 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include "memory.h"
+
+namespace memory_incremental
+{
+  constexpr auto region_type = RegionType::Trace;
+  using C = C1<region_type>;
+  using F = F1<region_type>;
+
+  /**
+   * Builds a list of `length` objects, alternating between C and F so that
+   * both rings are used, hanging off `o->f1`, and returns its last object.
+   * C and F have the same fields, so the list is typed as either.
+   **/
+  template<class T>
+  T* make_list(Alloc* alloc, T* o, size_t length)
+  {
+    T* n = o;
+    for (size_t i = 0; i < length; i++)
+    {
+      n->f1 = (i % 2 == 0) ? (T*)new (alloc, o) C : (T*)new (alloc, o) F;
+      n = n->f1;
+    }
+    return n;
+  }
+
+  template<class T>
+  void make_garbage(Alloc* alloc, T* o, size_t count)
+  {
+    for (size_t i = 0; i < count; i++)
+      alloc_in_region<C, F>(alloc, o);
+  }
+
+  template<class T>
+  void run_to_end(Alloc* alloc, T* o, size_t budget)
+  {
+    size_t slices = 0;
+    while (!RegionTrace::gc_step(alloc, o, budget))
+    {
+      slices++;
+      assert(slices < 100000);
+    }
+    assert(!RegionTrace::is_gc_in_progress(o));
+    UNUSED(slices);
+  }
+
+  /**
+   * Objects that the write barrier sees unlinked while marking is in
+   * progress are kept, even if they are only reachable through objects
+   * allocated since.
+   **/
+  void test_barrier()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto* o = new (alloc) F;
+    make_list(alloc, o, 100);
+    make_garbage(alloc, o, 50);
+    assert(Region::debug_size(o) == 201);
+
+    assert(!RegionTrace::gc_step(alloc, o, 10));
+    assert(RegionTrace::is_gc_in_progress(o));
+
+    // Move the second half of the list behind a new object.
+    F* mid = o;
+    for (size_t i = 0; i < 50; i++)
+      mid = mid->f1;
+
+    auto* n = new (alloc, o) F;
+    n->f1 = mid->f1;
+    F::store(alloc, o, mid->f1, (F*)nullptr);
+    F::store(alloc, o, o->f2, n);
+
+    run_to_end(alloc, o, 10);
+    assert(Region::debug_size(o) == 102);
+
+    // The next collection frees what was unreachable when it started.
+    F::store(alloc, o, o->f2, (F*)nullptr);
+    run_to_end(alloc, o, 10);
+    assert(Region::debug_size(o) == 51);
+
+    Region::release(alloc, o);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+    assert(live_count == 0);
+  }
+
+  /**
+   * A subregion that is taken out of the region while marking is in
+   * progress can be released before the collection carries on.
+   **/
+  void test_barrier_subregion()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto* o = new (alloc) F;
+    make_list(alloc, o, 20);
+    auto* sub = new (alloc) F;
+    make_list(alloc, sub, 5);
+    o->f2 = sub;
+
+    assert(!RegionTrace::gc_step(alloc, o, 2));
+    F::store(alloc, o, o->f2, (F*)nullptr);
+    Region::release(alloc, sub);
+
+    run_to_end(alloc, o, 1000);
+    assert(Region::debug_size(o) == 21);
+
+    Region::release(alloc, o);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+    assert(live_count == 0);
+  }
+
+  /**
+   * Objects allocated during a collection are kept, whether it is marking
+   * or sweeping, and whichever ring they are in.  So are remembered set
+   * entries added during a collection.
+   **/
+  void test_allocate()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto* o = new (alloc) F;
+    F* last = make_list(alloc, o, 40);
+    make_garbage(alloc, o, 40);
+
+    auto* imm = new (alloc) C;
+    Freeze::apply(alloc, imm);
+
+    size_t added = 0;
+    while (!RegionTrace::gc_step(alloc, o, 3))
+    {
+      F* n = (added % 2 == 0) ? (F*)new (alloc, o) C : new (alloc, o) F;
+      F::store(alloc, o, last->f1, n);
+      last = n;
+      added++;
+
+      // Unreachable, but allocated during the collection.
+      alloc_in_region<C, F>(alloc, o);
+
+      if (added == 20)
+      {
+        RegionTrace::insert(alloc, o, imm);
+        last->f2 = (F*)imm;
+      }
+    }
+    assert(added > 20);
+    assert(Region::debug_size(o) == 41 + (added * 3));
+    assert(imm->debug_test_rc(2));
+
+    run_to_end(alloc, o, 3);
+    assert(Region::debug_size(o) == 41 + added);
+    assert(imm->debug_test_rc(2));
+
+    Immutable::release(alloc, imm);
+    Region::release(alloc, o);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+    assert(live_count == 0);
+  }
+
+  /**
+   * Operations that need the whole region finish a collection in progress.
+   **/
+  void test_finish()
+  {
+    auto* alloc = ThreadAlloc::get();
+
+    // Released.
+    auto* o1 = new (alloc) F;
+    make_list(alloc, o1, 20);
+    make_garbage(alloc, o1, 20);
+    RegionTrace::gc_step(alloc, o1, 5);
+    assert(RegionTrace::is_gc_in_progress(o1));
+    Region::release(alloc, o1);
+    assert(live_count == 0);
+
+    // Collected.
+    auto* o2 = new (alloc) F;
+    make_list(alloc, o2, 20);
+    make_garbage(alloc, o2, 20);
+    RegionTrace::gc_step(alloc, o2, 5);
+    RegionTrace::gc(alloc, o2);
+    assert(!RegionTrace::is_gc_in_progress(o2));
+    assert(Region::debug_size(o2) == 21);
+
+    // Merged, into and from a region being collected.
+    auto* o3 = new (alloc) F;
+    make_garbage(alloc, o3, 10);
+    RegionTrace::gc_step(alloc, o2, 5);
+    RegionTrace::gc_step(alloc, o3, 5);
+    RegionTrace::merge(alloc, o2, o3);
+    assert(!RegionTrace::is_gc_in_progress(o2));
+    o2->f2 = o3;
+    assert(Region::debug_size(o2) == 22);
+
+    // Root swapped.
+    F* n = o2->f1;
+    RegionTrace::gc_step(alloc, o2, 5);
+    RegionTrace::swap_root(o2, n);
+    assert(!RegionTrace::is_gc_in_progress(n));
+    n->f2 = o2;
+
+    // Frozen.
+    RegionTrace::gc_step(alloc, n, 5);
+    Freeze::apply(alloc, n);
+    Immutable::release(alloc, n);
+
+    snmalloc::current_alloc_pool()->debug_check_empty();
+    assert(live_count == 0);
+  }
+
+  /**
+   * With an incremental policy, a deferred collection runs a slice at the
+   * end of each behaviour that touches the region, until it finishes.
+   **/
+  void test_deferred()
+  {
+    auto* alloc = ThreadAlloc::get();
+    auto& stats = RegionTrace::auto_gc_stats();
+    size_t collections = stats.collections;
+    size_t slices = stats.slices;
+
+    RegionTrace::set_gc_growth(2, 1024);
+    RegionTrace::set_incremental_gc(8, 0);
+
+    auto* o = new (alloc) C;
+    make_list(alloc, o, 20);
+
+    RegionTrace::begin_deferred_gc();
+    while (!RegionTrace::is_gc_deferred(o))
+      alloc_in_region<C, F>(alloc, o);
+    RegionTrace::end_deferred_gc(alloc);
+    assert(RegionTrace::is_gc_in_progress(o));
+    assert(stats.slices == slices + 1);
+
+    // A behaviour that does not touch the region does not collect it.
+    RegionTrace::begin_deferred_gc();
+    RegionTrace::end_deferred_gc(alloc);
+    assert(stats.slices == slices + 1);
+
+    size_t behaviours = 0;
+    while (RegionTrace::is_gc_in_progress(o))
+    {
+      RegionTrace::begin_deferred_gc();
+      C::store(alloc, o, o->f2, (C*)nullptr);
+      new (alloc, o) C;
+      RegionTrace::end_deferred_gc(alloc);
+      behaviours++;
+      assert(behaviours < 10000);
+    }
+
+    assert(stats.slices == slices + 1 + behaviours);
+    assert(stats.collections == collections + 1);
+    assert(Region::debug_size(o) == 21 + behaviours);
+
+    RegionTrace::set_incremental_gc(0);
+    RegionTrace::set_gc_growth(0);
+    Region::release(alloc, o);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+    assert(live_count == 0);
+
+    UNUSED(collections);
+    UNUSED(slices);
+  }
+
+  void run_test()
+  {
+    test_barrier();
+    test_barrier_subregion();
+    test_allocate();
+    test_finish();
+    test_deferred();
+  }
+}
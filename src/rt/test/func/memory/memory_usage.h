@@ -0,0 +1,159 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include "memory.h"
+
+namespace memory_usage
+{
+  /**
+   * Checks that the memory used by `o`'s region is `objects` objects of
+   * `size` bytes each.
+   **/
+  void check_usage(Object* o, size_t objects, size_t size)
+  {
+    auto usage = Region::memory_used(o);
+    UNUSED(usage);
+    assert(usage.objects == objects);
+    assert(usage.bytes == objects * size);
+  }
+
+  /**
+   * Usage follows allocation, merging, and collection.
+   **/
+  template<RegionType region_type>
+  void test_accounting()
+  {
+    using RegionClass = typename RegionType_to_class<region_type>::T;
+    using C = C1<region_type>;
+    auto* alloc = ThreadAlloc::get();
+
+    auto* r = new (alloc) C;
+    check_usage(r, 1, sizeof(C));
+
+    r->f1 = new (alloc, r) C;
+    r->f1->f1 = new (alloc, r) C;
+    new (alloc, r) C;
+    check_usage(r, 4, sizeof(C));
+
+    auto* o = new (alloc) C;
+    new (alloc, o) C;
+    RegionClass::merge(alloc, r, o);
+    check_usage(r, 6, sizeof(C));
+
+    // Collection only frees the unreachable objects of a trace region.
+    if constexpr (region_type == RegionType::Trace)
+    {
+      RegionTrace::gc(alloc, r);
+      check_usage(r, 3, sizeof(C));
+    }
+
+    Region::release(alloc, r);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+  }
+
+  /**
+   * `try_alloc_in` fails rather than go over a region's quota, unless
+   * collecting the region first frees enough memory.
+   **/
+  void test_quota()
+  {
+    using C = C1<RegionType::Trace>;
+    auto* alloc = ThreadAlloc::get();
+
+    auto* r = new (alloc) C;
+    assert(Region::get_quota(r) == 0);
+    Region::set_quota(r, 3 * sizeof(C));
+
+    r->f1 = C::try_alloc_in(alloc, r);
+    assert(r->f1 != nullptr);
+    auto* garbage = C::try_alloc_in(alloc, r);
+    assert(garbage != nullptr);
+    assert(C::try_alloc_in(alloc, r) == nullptr);
+    check_usage(r, 3, sizeof(C));
+
+    // Collecting first frees the unreachable object.
+    r->f2 = C::try_alloc_in(alloc, r, true);
+    assert(r->f2 != nullptr);
+    check_usage(r, 3, sizeof(C));
+
+    // Nothing is unreachable now.
+    assert(C::try_alloc_in(alloc, r, true) == nullptr);
+
+    // Other allocations go over the quota, and defer a collection during a
+    // behaviour.
+    RegionTrace::begin_deferred_gc();
+    new (alloc, r) C;
+    assert(RegionTrace::is_gc_deferred(r));
+    RegionTrace::end_deferred_gc(alloc);
+    check_usage(r, 3, sizeof(C));
+
+    // If a collection leaves the region over its quota, the next one waits
+    // until the region has doubled in size.
+    Region::set_quota(r, 2 * sizeof(C));
+    RegionTrace::begin_deferred_gc();
+    for (size_t i = 0; i < 3; i++)
+      new (alloc, r) C;
+    assert(!RegionTrace::is_gc_deferred(r));
+    new (alloc, r) C;
+    assert(RegionTrace::is_gc_deferred(r));
+    RegionTrace::end_deferred_gc(alloc);
+    check_usage(r, 3, sizeof(C));
+
+    Region::set_quota(r, 0);
+    assert(C::try_alloc_in(alloc, r) != nullptr);
+
+    Region::release(alloc, r);
+    snmalloc::current_alloc_pool()->debug_check_empty();
+  }
+
+  struct Tenant : public VCown<Tenant>
+  {
+    Object* region = nullptr;
+
+    void trace(ObjectStack* st) const
+    {
+      if (region != nullptr)
+        st->push(region);
+    }
+  };
+
+  /**
+   * Usage can be summed over subregions, and over the regions a cown owns.
+   **/
+  void test_subregions()
+  {
+    using F = F1<RegionType::Arena>;
+    auto* alloc = ThreadAlloc::get();
+
+    auto* r = new (alloc) F;
+    r->f1 = new (alloc, r) F;
+    r->f1->f1 = new (alloc) F;
+    new (alloc, r->f1->f1) C1<RegionType::Arena>;
+    r->f2 = new (alloc) F;
+
+    auto total = Region::memory_used_with_subregions(alloc, r);
+    assert(total.objects == 5);
+    assert(total.bytes == 4 * sizeof(F) + sizeof(C1<RegionType::Arena>));
+
+    auto* t = new Tenant;
+    t->region = r;
+    auto owned = t->memory_used(alloc);
+    UNUSED(owned);
+    assert(owned.objects == total.objects);
+    assert(owned.bytes == total.bytes);
+
+    t->region = nullptr;
+    Region::release(alloc, r);
+    Cown::release(alloc, t);
+    assert(live_count == 0);
+  }
+
+  void run_test()
+  {
+    test_accounting<RegionType::Trace>();
+    test_accounting<RegionType::Arena>();
+    test_quota();
+    test_subregions();
+  }
+}
@@ -0,0 +1,183 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <test/harness.h>
+
+/**
+ * Freezes a tree of nested trace and arena regions with ParallelFreeze, both
+ * with a threshold that spawns every nested region and with one that spawns
+ * none, and checks the frozen graph in the continuation.  Every region refers
+ * to a shared immutable, so its reference count is updated by several
+ * threads at once.
+ **/
+size_t length = 4;
+size_t depth = 2;
+
+std::atomic<size_t> live = 0;
+
+template<RegionType type>
+struct Node : public V<Node<type>, type>
+{
+  Node* next = nullptr;
+  Object* child = nullptr;
+  Object* shared = nullptr;
+
+  ~Node()
+  {
+    live--;
+  }
+
+  void trace(ObjectStack* st) const
+  {
+    if (next != nullptr)
+      st->push(next);
+
+    if (child != nullptr)
+      st->push(child);
+
+    if (shared != nullptr)
+      st->push(shared);
+  }
+};
+
+using TNode = Node<RegionType::Trace>;
+using ANode = Node<RegionType::Arena>;
+
+struct Shared : public V<Shared>
+{};
+
+/**
+ * Builds a region holding a cycle of `length` nodes, each of which is the
+ * entry point of a nested region of the other kind, down to `levels`.  The
+ * entry point refers to `shared`.
+ **/
+template<RegionType type>
+Object* make_region(Alloc* alloc, size_t levels, Object* shared, size_t& count)
+{
+  using N = Node<type>;
+  auto* r = new (alloc) N;
+  N* n = r;
+  for (size_t i = 1; i < length; i++)
+  {
+    n->next = new (alloc, r) N;
+    n = n->next;
+  }
+  n->next = r;
+  live += length;
+  count++;
+
+  r->shared = shared;
+  if constexpr (type == RegionType::Trace)
+    RegionTrace::insert(alloc, r, shared);
+  else
+    RegionArena::insert(alloc, r, shared);
+
+  if (levels > 0)
+  {
+    n = r;
+    do
+    {
+      if constexpr (type == RegionType::Trace)
+        n->child =
+          make_region<RegionType::Arena>(alloc, levels - 1, shared, count);
+      else
+        n->child =
+          make_region<RegionType::Trace>(alloc, levels - 1, shared, count);
+      n = n->next;
+    } while (n != r);
+  }
+
+  return r;
+}
+
+template<RegionType type>
+void check_region(Object* o, size_t levels)
+{
+  using N = Node<type>;
+  auto* r = (N*)o;
+
+  // Each region is one SCC, referred to only by its parent.
+  check(r->debug_is_immutable());
+  check(r->debug_immutable_root()->debug_test_rc(1));
+
+  N* n = r;
+  do
+  {
+    check(n->debug_immutable_root() == r->debug_immutable_root());
+
+    if (levels > 0)
+    {
+      if constexpr (type == RegionType::Trace)
+        check_region<RegionType::Arena>(n->child, levels - 1);
+      else
+        check_region<RegionType::Trace>(n->child, levels - 1);
+    }
+    n = n->next;
+  } while (n != r);
+}
+
+struct Checker : public VCown<Checker>
+{};
+
+struct Check : public VAction<Check>
+{
+  Object* root;
+  Object* shared;
+  size_t regions;
+
+  Check(Object* root, Object* shared, size_t regions)
+  : root(root), shared(shared), regions(regions)
+  {}
+
+  void trace(ObjectStack* st) const
+  {
+    st->push(root);
+    st->push(shared);
+  }
+
+  void f()
+  {
+    auto* alloc = ThreadAlloc::get();
+
+    check_region<RegionType::Trace>(root, depth);
+    check(shared->debug_test_rc(regions + 1));
+
+    Immutable::release(alloc, root);
+    check(shared->debug_test_rc(1));
+    Immutable::release(alloc, shared);
+  }
+};
+
+void freeze(size_t threshold)
+{
+  auto* alloc = ThreadAlloc::get();
+
+  auto* shared = new (alloc) Shared;
+  Freeze::apply(alloc, shared);
+
+  size_t regions = 0;
+  auto* root = make_region<RegionType::Trace>(alloc, depth, shared, regions);
+
+  auto* c = new Checker;
+  ParallelFreeze::apply<Check>(
+    alloc, root, threshold, c, root, shared, regions);
+  Cown::release(alloc, c);
+}
+
+void test_parallel_freeze()
+{
+  // Spawn every nested region.
+  freeze(0);
+
+  // Spawn none of them.
+  freeze(ParallelFreeze::DEFAULT_THRESHOLD);
+}
+
+int main(int argc, char** argv)
+{
+  SystematicTestHarness harness(argc, argv);
+  length = harness.opt.is<size_t>("--length", length);
+  depth = harness.opt.is<size_t>("--depth", depth);
+  harness.run(test_parallel_freeze);
+  check(live == 0);
+  return 0;
+}
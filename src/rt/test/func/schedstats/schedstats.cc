@@ -0,0 +1,91 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <test/harness.h>
+
+/**
+ * Checks the bucketing of log-linear histograms, and that the scheduler
+ * statistics can be read from a behaviour while the scheduler is running.
+ **/
+static constexpr size_t messages = 100;
+
+template<typename H>
+void check_buckets()
+{
+  uint64_t values[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 100, 1000, 4095};
+
+  for (auto v : values)
+  {
+    size_t b = H::bucket(v);
+    check(b < H::BUCKETS);
+    check(H::lower_bound(b) <= v);
+    check((b + 1 == H::BUCKETS) || (v < H::lower_bound(b + 1)));
+  }
+
+  for (size_t b = 1; b < H::BUCKETS; b++)
+  {
+    check(H::lower_bound(b - 1) < H::lower_bound(b));
+    check(H::bucket(H::lower_bound(b)) == b);
+  }
+
+  H h;
+  for (uint64_t v = 0; v < 1000; v++)
+    h.add(v);
+
+  check(h.count() == 1000);
+  check(h.max() == 999);
+  check(h.quantile(0.5) >= 500);
+  check(h.quantile(1.0) == 999);
+}
+
+struct Counter : public VCown<Counter>
+{
+  size_t count = 0;
+};
+
+struct Step : public VAction<Step>
+{
+  Counter* c;
+
+  Step(Counter* c) : c(c) {}
+
+  void f()
+  {
+    c->count++;
+
+    if (c->count < messages)
+      return;
+
+    auto stats = Scheduler::snapshot_stats();
+    UNUSED(stats);
+#ifdef USE_SCHED_STATS
+    // The behaviours before this one have all finished, and this one is
+    // still running.
+    check(stats.run_time().count() >= messages - 1);
+    check(stats.queue_time().count() >= messages);
+    check(stats.queue_length().count() >= 1);
+    check(stats.steals() <= stats.steal_attempts());
+#endif
+  }
+};
+
+void test_snapshot()
+{
+  auto* alloc = ThreadAlloc::get();
+  auto c = new Counter;
+
+  for (size_t i = 0; i < messages; i++)
+    Cown::schedule<Step>(c, c);
+
+  Cown::release(alloc, c);
+}
+
+int main(int argc, char** argv)
+{
+  check_buckets<Log2Histogram<>>();
+  check_buckets<LogLinearHistogram<2, 40>>();
+  check_buckets<LogLinearHistogram<3, 12>>();
+
+  SystematicTestHarness harness(argc, argv);
+  harness.run(test_snapshot);
+  return 0;
+}
@@ -64,6 +64,15 @@ public:
       std::cout << " --allow_leaks " << std::endl;
     Scheduler::set_detect_leaks(detect_leaks);
 
+    size_t promotion_age = opt.is<size_t>("--generational", 0);
+    if (promotion_age != 0)
+    {
+      size_t full_ld_every = opt.is<size_t>("--full_ld_every", 4);
+      std::cout << " --generational " << promotion_age << " --full_ld_every "
+                << full_ld_every << std::endl;
+      Scheduler::set_generational_ld(promotion_age, full_ld_every);
+    }
+
 #if defined(_WIN32) && defined(CI_BUILD)
     _set_error_mode(_OUT_TO_STDERR);
     _set_abort_behavior(0, _WRITE_ABORT_MSG);
@@ -0,0 +1,97 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <test/measuretime.h>
+#include <test/opt.h>
+#include <vector>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+
+/**
+ * Measures the memory reserved by `--regions` live arena regions, each
+ * holding `--objects` small objects, for initial arena sizes from 4 KiB up
+ * to `--max_arena`.
+ *
+ * This runs as a test, so by default it reserves under a gigabyte.  The
+ * full sweep up to the default arena size of 1 MiB, which reserves about
+ * 98 GiB at its last step, is
+ *
+ *   arenasize --regions 100000 --max_arena 1048576
+ **/
+static RegionArena::ArenaSizes sizes;
+
+struct Node : public V<Node, RegionType::Arena>
+{
+  Node* next = nullptr;
+  size_t value = 0;
+
+  void trace(ObjectStack* st) const
+  {
+    if (next != nullptr)
+      st->push(next);
+  }
+
+  static RegionArena::ArenaSizes arena_sizes()
+  {
+    return sizes;
+  }
+};
+
+static Node* make_region(Alloc* alloc, size_t objects)
+{
+  auto* r = new (alloc) Node;
+  for (size_t i = 1; i < objects; i++)
+  {
+    auto* n = new (alloc, r) Node;
+    n->next = r->next;
+    n->value = i;
+    r->next = n;
+  }
+  return r;
+}
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t regions = opt.is<size_t>("--regions", 10000);
+  size_t objects = opt.is<size_t>("--objects", 8);
+  size_t max_arena = opt.is<size_t>("--max_arena", 64 * 1024);
+
+  auto* alloc = ThreadAlloc::get();
+  std::vector<Node*> live;
+  live.reserve(regions);
+
+  for (size_t initial = RegionArena::MIN_ARENA_SIZE;
+       initial <= std::min(max_arena, RegionArena::DEFAULT_ARENA_SIZE);
+       initial *= 4)
+  {
+    sizes = {initial, RegionArena::DEFAULT_ARENA_SIZE};
+
+    DO_TIME("Create, initial arena " << std::setw(8) << initial, {
+      for (size_t i = 0; i < regions; i++)
+        live.push_back(make_region(alloc, objects));
+    });
+
+    size_t reserved = 0;
+    for (auto r : live)
+      reserved += RegionArena::memory_reserved(r);
+
+    std::cout << "  " << regions << " regions of " << objects
+              << " objects reserve " << (reserved >> 20) << " MiB, "
+              << (reserved / regions) << " bytes per region" << std::endl;
+
+    DO_TIME("Release, initial arena " << std::setw(8) << initial, {
+      for (auto r : live)
+        Region::release(alloc, r);
+    });
+
+    live.clear();
+  }
+
+  snmalloc::current_alloc_pool()->debug_check_empty();
+  return 0;
+}
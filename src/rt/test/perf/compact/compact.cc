@@ -0,0 +1,146 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <iomanip>
+#include <iostream>
+#include <test/measuretime.h>
+#include <test/opt.h>
+#include <test/xoroshiro.h>
+#include <vector>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+
+/**
+ * Measures traversal of a linked list in a trace region before and after
+ * compacting it.
+ *
+ * The list is built with garbage of varying sizes allocated between its
+ * nodes, and with the links shuffled, so after the garbage is collected the
+ * nodes are scattered, and visited out of address order.  Compacting the
+ * region packs the nodes into one block in list order.
+ **/
+struct Node : public V<Node>
+{
+  Node* next = nullptr;
+  size_t value = 0;
+
+  void trace(ObjectStack* st) const
+  {
+    if (next != nullptr)
+      st->push(next);
+  }
+
+  void trace_fields(FieldStack* st)
+  {
+    st->push((Object**)&next);
+  }
+};
+
+template<size_t N>
+struct Garbage : public V<Garbage<N>>
+{
+  char payload[N];
+};
+
+template<size_t N>
+void alloc_garbage(Alloc* alloc, Object* r, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+    new (alloc, r) Garbage<N>;
+}
+
+static Node* build(Alloc* alloc, size_t length, xoroshiro::p128r64& rand)
+{
+  auto* r = new (alloc) Node;
+  std::vector<Node*> nodes;
+  nodes.reserve(length);
+
+  for (size_t i = 0; i < length; i++)
+  {
+    auto* n = new (alloc, r) Node;
+    n->value = i;
+    nodes.push_back(n);
+
+    switch (rand.next() % 4)
+    {
+      case 0:
+        alloc_garbage<16>(alloc, r, 1 + (rand.next() % 4));
+        break;
+      case 1:
+        alloc_garbage<48>(alloc, r, 1 + (rand.next() % 2));
+        break;
+      case 2:
+        alloc_garbage<240>(alloc, r, 1);
+        break;
+      default:
+        break;
+    }
+  }
+
+  for (size_t i = length; i > 1; i--)
+    std::swap(nodes[i - 1], nodes[rand.next() % i]);
+
+  Node* prev = r;
+  for (auto n : nodes)
+  {
+    prev->next = n;
+    prev = n;
+  }
+
+  return r;
+}
+
+static size_t traverse(Node* r, size_t rounds)
+{
+  size_t sum = 0;
+  for (size_t i = 0; i < rounds; i++)
+  {
+    for (Node* n = r->next; n != nullptr; n = n->next)
+      sum += n->value;
+  }
+  return sum;
+}
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t rounds = opt.is<size_t>("--rounds", 10);
+  size_t max_length = opt.is<size_t>("--length", 1000000);
+
+  auto* alloc = ThreadAlloc::get();
+  xoroshiro::p128r64 rand(opt.is<size_t>("--seed", 1));
+
+  for (size_t length = max_length / 100; length <= max_length; length *= 10)
+  {
+    Node* r = build(alloc, length, rand);
+    RegionTrace::gc(alloc, r);
+
+    size_t before;
+    size_t after;
+
+    DO_TIME("Scattered: " << std::setw(10) << length, {
+      before = traverse(r, rounds);
+    });
+
+    DO_TIME("Compact:   " << std::setw(10) << length, {
+      RegionTrace::compact(alloc, r);
+    });
+
+    DO_TIME("Compacted: " << std::setw(10) << length, {
+      after = traverse(r, rounds);
+    });
+
+    if (before != after)
+    {
+      std::cout << "Traversals disagree: " << before << " != " << after
+                << std::endl;
+      abort();
+    }
+
+    Region::release(alloc, r);
+  }
+
+  snmalloc::current_alloc_pool()->debug_check_empty();
+  return 0;
+}
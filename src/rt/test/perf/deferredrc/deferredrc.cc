@@ -0,0 +1,131 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <test/measuretime.h>
+#include <test/opt.h>
+#include <thread>
+#include <vector>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+
+/**
+ * Measures contention on the reference count of a shared immutable graph.
+ *
+ * `--threads` threads each repeatedly acquire a reference to one frozen
+ * graph, read it, and release the reference, first with `Immutable::acquire`
+ * and `Immutable::release`, which update the shared count every time, and
+ * then with `DeferredRC`, which only uses each thread's stash.
+ **/
+struct Node : public V<Node>
+{
+  Node* next = nullptr;
+  Node* head = nullptr;
+  size_t value = 0;
+
+  void trace(ObjectStack* st) const
+  {
+    if (next != nullptr)
+      st->push(next);
+
+    if (head != nullptr)
+      st->push(head);
+  }
+};
+
+static Node* make_graph(Alloc* alloc, size_t length)
+{
+  auto* r = new (alloc) Node;
+  Node* n = r;
+  for (size_t i = 1; i < length; i++)
+  {
+    n->next = new (alloc, r) Node;
+    n = n->next;
+    n->head = r;
+    n->value = i;
+  }
+
+  Freeze::apply(alloc, r);
+  return r;
+}
+
+template<bool deferred>
+static void reader(Node* graph, size_t reads, std::atomic<size_t>* sum)
+{
+  auto* alloc = ThreadAlloc::get();
+  size_t local = 0;
+
+  for (size_t i = 0; i < reads; i++)
+  {
+    if constexpr (deferred)
+      DeferredRC::acquire(graph);
+    else
+      Immutable::acquire(graph);
+
+    for (Node* n = graph; n != nullptr; n = n->next)
+      local += n->value;
+
+    if constexpr (deferred)
+      DeferredRC::release(alloc, graph);
+    else
+      Immutable::release(alloc, graph);
+  }
+
+  if constexpr (deferred)
+  {
+    DeferredRC::flush(alloc);
+    Epoch(alloc).flush_local();
+  }
+
+  *sum += local;
+}
+
+template<bool deferred>
+static size_t run(Node* graph, size_t threads, size_t reads)
+{
+  std::atomic<size_t> sum = 0;
+  std::vector<std::thread> ts;
+
+  for (size_t i = 0; i < threads; i++)
+    ts.emplace_back(reader<deferred>, graph, reads, &sum);
+
+  for (auto& t : ts)
+    t.join();
+
+  return sum;
+}
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t threads = opt.is<size_t>("--threads", 64);
+  size_t reads = opt.is<size_t>("--reads", 1000000);
+  size_t length = opt.is<size_t>("--length", 4);
+
+  auto* alloc = ThreadAlloc::get();
+  auto* graph = make_graph(alloc, length);
+
+  size_t immediate;
+  size_t deferred;
+
+  DO_TIME("Immediate RC: " << std::setw(4) << threads << " threads", {
+    immediate = run<false>(graph, threads, reads);
+  });
+
+  DO_TIME("Deferred RC:  " << std::setw(4) << threads << " threads", {
+    deferred = run<true>(graph, threads, reads);
+  });
+
+  if ((immediate != deferred) || !graph->debug_test_rc(1))
+  {
+    std::cout << "Readers disagree, or leaked references" << std::endl;
+    abort();
+  }
+
+  Immutable::release(alloc, graph);
+  snmalloc::current_alloc_pool()->debug_check_empty();
+  return 0;
+}
@@ -0,0 +1,125 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <test/opt.h>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+using namespace std::chrono;
+
+/**
+ * Measures the cost of leak detection with a large heap of cowns that do not
+ * change.
+ *
+ * A tree of `--cowns` cowns hangs off a heartbeat cown, which reschedules
+ * itself `--beats` times and asks for leak detection every `--ld_every`
+ * beats.  Without `--generational`, every leak detection reschedules and
+ * traces the whole tree.  With it, the tree is promoted after that many leak
+ * detections, and only every `--full_ld_every`th one traces it again.
+ *
+ * Build with USE_SCHED_STATS to see the number of cowns traced (CownScan) and
+ * skipped (LDSkip).
+ **/
+struct Node : public VCown<Node>
+{
+  static constexpr size_t FANOUT = 8;
+  Node* kids[FANOUT] = {};
+
+  void trace(ObjectStack* st) const
+  {
+    for (auto k : kids)
+    {
+      if (k != nullptr)
+        st->push(k);
+    }
+  }
+};
+
+// Builds a tree of `count` nodes, and returns its root.
+static Node* build(size_t count)
+{
+  auto* n = new Node;
+  count--;
+
+  for (size_t i = 0; (i < Node::FANOUT) && (count > 0); i++)
+  {
+    size_t share = (count + Node::FANOUT - 1 - i) / (Node::FANOUT - i);
+    n->kids[i] = build(share);
+    count -= share;
+  }
+
+  return n;
+}
+
+struct Heart : public VCown<Heart>
+{
+  Node* tree = nullptr;
+
+  void trace(ObjectStack* st) const
+  {
+    if (tree != nullptr)
+      st->push(tree);
+  }
+};
+
+static size_t ld_every;
+
+struct Beat : public VAction<Beat>
+{
+  Heart* heart;
+  size_t remaining;
+  size_t cowns;
+
+  Beat(Heart* heart, size_t remaining, size_t cowns)
+  : heart(heart), remaining(remaining), cowns(cowns)
+  {}
+
+  void f()
+  {
+    // Built on a scheduler thread, so the tree can be promoted.
+    if (heart->tree == nullptr)
+      heart->tree = build(cowns);
+
+    if ((remaining % ld_every) == 0)
+      Scheduler::want_ld();
+
+    if (remaining > 0)
+      Cown::schedule<Beat>(heart, heart, remaining - 1, cowns);
+  }
+};
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t cores = opt.is<size_t>("--cores", 2);
+  size_t cowns = opt.is<size_t>("--cowns", 100000);
+  size_t beats = opt.is<size_t>("--beats", 200000);
+  size_t promotion_age = opt.is<size_t>("--generational", 0);
+  size_t full_ld_every = opt.is<size_t>("--full_ld_every", 8);
+  ld_every = opt.is<size_t>("--ld_every", 1000);
+
+  Scheduler::set_generational_ld(promotion_age, full_ld_every);
+
+  Scheduler& sched = Scheduler::get();
+  sched.init(cores);
+
+  auto* heart = new Heart;
+  Cown::schedule<Beat>(heart, heart, beats, cowns);
+  Cown::release(ThreadAlloc::get(), heart);
+
+  auto start = steady_clock::now();
+  sched.run();
+  auto end = steady_clock::now();
+
+  double seconds = duration_cast<duration<double>>(end - start).count();
+  std::cout << "Cores: " << cores << "  cowns: " << cowns
+            << "  leak detections: " << (beats / ld_every)
+            << "  generational: " << promotion_age << "/" << full_ld_every
+            << "  time: " << std::fixed << std::setprecision(3) << seconds
+            << "s" << std::endl;
+
+  return 0;
+}
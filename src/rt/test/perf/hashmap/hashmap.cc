@@ -0,0 +1,124 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <test/opt.h>
+#include <vector>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+using namespace std::chrono;
+
+/**
+ * Measures insert, find (hits and misses) and sweep_set on both probing
+ * schemes of PtrKeyHashMap, from 1K entries up to `--max` entries.  Keys are
+ * spread like the addresses of objects in a few regions, and the sweep keeps
+ * a random `--keep` percent of the entries, as a remembered set would after a
+ * collection.
+ **/
+struct Entry
+{
+  size_t key;
+};
+
+size_t& entry_key_of(Entry* e)
+{
+  return e->key;
+}
+
+static double seconds_since(high_resolution_clock::time_point start)
+{
+  auto end = high_resolution_clock::now();
+  return duration_cast<duration<double>>(end - start).count();
+}
+
+static void report(const char* name, const char* op, size_t n, double seconds)
+{
+  std::cout << std::left << std::setw(10) << name << std::setw(8) << op
+            << std::right << std::setw(10) << n << "  " << std::fixed
+            << std::setprecision(2) << std::setw(8)
+            << (seconds * 1e9 / (double)n) << " ns/op" << std::endl;
+}
+
+template<HashMapProbe probe>
+void bench(
+  const char* name,
+  const std::vector<size_t>& keys,
+  const std::vector<size_t>& misses,
+  size_t keep)
+{
+  using Map = PtrKeyHashMap<Entry, entry_key_of, probe>;
+  auto* alloc = ThreadAlloc::get();
+  auto* map = Map::create();
+  size_t n = keys.size();
+
+  auto start = high_resolution_clock::now();
+  for (auto key : keys)
+  {
+    Entry e{key};
+    size_t location;
+    map->insert(alloc, e, location);
+  }
+  report(name, "insert", n, seconds_since(start));
+
+  size_t found = 0;
+  start = high_resolution_clock::now();
+  for (auto key : keys)
+    found += (map->find(key) != map->end()) ? 1 : 0;
+  report(name, "hit", n, seconds_since(start));
+
+  start = high_resolution_clock::now();
+  for (auto key : misses)
+    found += (map->find(key) != map->end()) ? 1 : 0;
+  report(name, "miss", n, seconds_since(start));
+
+  if (found != n)
+    std::cout << "  expected " << n << " hits, found " << found << std::endl;
+
+  size_t marked = 0;
+  for (size_t i = 0; i < n; i++)
+  {
+    if ((i * 100 / n) < keep)
+      map->mark_slot(map->find(keys[i]).get_index(), marked);
+  }
+
+  start = high_resolution_clock::now();
+  map->sweep_set(alloc, marked);
+  report(name, "sweep", n, seconds_since(start));
+
+  map->dealloc(alloc);
+  alloc->dealloc<sizeof(Map)>(map);
+}
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t max = opt.is<size_t>("--max", 10000000);
+  size_t keep = opt.is<size_t>("--keep", 50);
+  size_t seed = opt.is<size_t>("--seed", 0);
+
+  std::mt19937_64 rand(seed);
+
+  for (size_t n = 1000; n <= max; n *= 10)
+  {
+    // Every other 64 byte object, so misses fall between hits.
+    std::vector<size_t> keys(n);
+    std::vector<size_t> misses(n);
+    for (size_t i = 0; i < n; i++)
+    {
+      keys[i] = (i + 1) * 128;
+      misses[i] = keys[i] + 64;
+    }
+    std::shuffle(keys.begin(), keys.end(), rand);
+    std::shuffle(misses.begin(), misses.end(), rand);
+
+    bench<HashMapProbe::RobinHood>("robinhood", keys, misses, keep);
+    bench<HashMapProbe::Swiss>("swiss", keys, misses, keep);
+  }
+
+  snmalloc::current_alloc_pool()->debug_check_empty();
+  return 0;
+}
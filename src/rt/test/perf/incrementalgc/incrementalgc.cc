@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <test/opt.h>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+using namespace std::chrono;
+
+/**
+ * Measures the longest pause of a behaviour that uses a large trace region,
+ * when the region is collected in one go and when it is collected
+ * incrementally with a budget of `--budget` objects per slice.
+ *
+ * The region holds a list of `--live` objects, and each of `--behaviours`
+ * simulated behaviours allocates `--garbage` objects in it and replaces a
+ * field of the root, so that automatic collections keep being triggered.
+ **/
+struct Node : public V<Node>
+{
+  Node* next = nullptr;
+  Node* last = nullptr;
+
+  void trace(ObjectStack* st) const
+  {
+    if (next != nullptr)
+      st->push(next);
+
+    if (last != nullptr)
+      st->push(last);
+  }
+};
+
+static void run(
+  const char* name,
+  size_t live,
+  size_t garbage,
+  size_t behaviours,
+  size_t budget)
+{
+  auto* alloc = ThreadAlloc::get();
+  auto& stats = RegionTrace::auto_gc_stats();
+  size_t collections = stats.collections;
+  size_t slices = stats.slices;
+
+  RegionTrace::set_incremental_gc(budget, 0);
+
+  auto* root = new (alloc) Node;
+  Node* n = root;
+  for (size_t i = 0; i < live; i++)
+  {
+    n->next = new (alloc, root) Node;
+    n = n->next;
+  }
+
+  double total = 0;
+  double longest = 0;
+  for (size_t i = 0; i < behaviours; i++)
+  {
+    auto start = high_resolution_clock::now();
+    RegionTrace::begin_deferred_gc();
+
+    Node* g = nullptr;
+    for (size_t j = 0; j < garbage; j++)
+    {
+      auto* m = new (alloc, root) Node;
+      m->next = g;
+      g = m;
+    }
+    Node::store(alloc, root, root->last, g);
+
+    RegionTrace::end_deferred_gc(alloc);
+    auto end = high_resolution_clock::now();
+
+    double pause = duration_cast<duration<double>>(end - start).count();
+    total += pause;
+    longest = std::max(longest, pause);
+  }
+
+  std::cout << std::left << std::setw(12) << name << std::right << std::fixed
+            << std::setprecision(3) << " max " << std::setw(10)
+            << (longest * 1e3) << " ms  mean " << std::setw(8)
+            << (total * 1e3 / (double)behaviours) << " ms  collections "
+            << (stats.collections - collections) << "  slices "
+            << (stats.slices - slices) << std::endl;
+
+  Region::release(alloc, root);
+}
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t live = opt.is<size_t>("--live", 1000000);
+  size_t garbage = opt.is<size_t>("--garbage", 10000);
+  size_t behaviours = opt.is<size_t>("--behaviours", 1000);
+  size_t budget = opt.is<size_t>("--budget", 50000);
+
+  RegionTrace::set_gc_growth(2);
+
+  run("full", live, garbage, behaviours, 0);
+  run("incremental", live, garbage, behaviours, budget);
+
+  RegionTrace::set_incremental_gc(0);
+  RegionTrace::set_gc_growth(0);
+  snmalloc::current_alloc_pool()->debug_check_empty();
+  return 0;
+}
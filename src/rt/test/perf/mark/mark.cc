@@ -0,0 +1,168 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <test/opt.h>
+#include <vector>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+using namespace std::chrono;
+
+/**
+ * Measures the throughput of marking a large randomly linked graph, in
+ * objects per second.
+ *
+ * A region holds `--objects` objects.  Each one points to the next one in a
+ * random order, so they are all reachable, and to `--edges - 1` other random
+ * objects.  The graph is traversed with a plain ObjectStack, and with a
+ * PrefetchQueue of a few depths, and then collected with RegionTrace::gc,
+ * which marks through a PrefetchQueue and then sweeps.  Each is repeated
+ * `--repeat` times and the best time is reported.
+ **/
+struct Node : public V<Node>
+{
+  static constexpr size_t MAX_EDGES = 4;
+  Node* edges[MAX_EDGES] = {};
+  bool visited = false;
+
+  void trace(ObjectStack* st) const
+  {
+    for (auto e : edges)
+    {
+      if (e != nullptr)
+        st->push(e);
+    }
+  }
+};
+
+static void report(const char* name, size_t n, double seconds)
+{
+  std::cout << std::left << std::setw(12) << name << std::right << std::fixed
+            << std::setprecision(2) << std::setw(10)
+            << ((double)n / seconds / 1e6) << " M objects/s" << std::endl;
+}
+
+template<typename Traverse>
+static void bench(
+  const char* name, std::vector<Node*>& nodes, size_t repeat, Traverse traverse)
+{
+  double best = 0;
+
+  for (size_t i = 0; i < repeat; i++)
+  {
+    for (auto n : nodes)
+      n->visited = false;
+
+    auto start = high_resolution_clock::now();
+    size_t visited = traverse(nodes[0]);
+    auto end = high_resolution_clock::now();
+
+    if (visited != nodes.size())
+      std::cout << "  visited " << visited << " of " << nodes.size()
+                << std::endl;
+
+    double seconds = duration_cast<duration<double>>(end - start).count();
+    if ((i == 0) || (seconds < best))
+      best = seconds;
+  }
+
+  report(name, nodes.size(), best);
+}
+
+static size_t visit(Node* n, ObjectStack& st)
+{
+  if (n->visited)
+    return 0;
+
+  n->visited = true;
+  n->trace(&st);
+  return 1;
+}
+
+static size_t traverse_stack(Node* root)
+{
+  ObjectStack st(ThreadAlloc::get());
+  st.push(root);
+
+  size_t count = 0;
+  while (!st.empty())
+    count += visit((Node*)st.pop(), st);
+
+  return count;
+}
+
+template<size_t DEPTH>
+static size_t traverse_prefetch(Node* root)
+{
+  ObjectStack st(ThreadAlloc::get());
+  PrefetchQueue<Object, Alloc, DEPTH> queue(st);
+  st.push(root);
+
+  size_t count = 0;
+  while (!queue.empty())
+    count += visit((Node*)queue.pop(), st);
+
+  return count;
+}
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t objects = opt.is<size_t>("--objects", 4000000);
+  size_t edges = opt.is<size_t>("--edges", 2);
+  size_t repeat = opt.is<size_t>("--repeat", 5);
+  size_t seed = opt.is<size_t>("--seed", 0);
+
+  edges = std::min(std::max<size_t>(edges, 1), Node::MAX_EDGES);
+  std::mt19937_64 rand(seed);
+  auto* alloc = ThreadAlloc::get();
+
+  std::vector<Node*> nodes(objects);
+  nodes[0] = new (alloc) Node;
+  for (size_t i = 1; i < objects; i++)
+    nodes[i] = new (alloc, nodes[0]) Node;
+
+  std::vector<Node*> order(nodes.begin() + 1, nodes.end());
+  std::shuffle(order.begin(), order.end(), rand);
+
+  Node* prev = nodes[0];
+  for (auto n : order)
+  {
+    prev->edges[0] = n;
+    prev = n;
+  }
+
+  std::uniform_int_distribution<size_t> pick(0, objects - 1);
+  for (auto n : nodes)
+  {
+    for (size_t e = 1; e < edges; e++)
+      n->edges[e] = nodes[pick(rand)];
+  }
+
+  bench("stack", nodes, repeat, traverse_stack);
+  bench("prefetch4", nodes, repeat, traverse_prefetch<4>);
+  bench("prefetch8", nodes, repeat, traverse_prefetch<8>);
+  bench("prefetch16", nodes, repeat, traverse_prefetch<16>);
+
+  double best = 0;
+  for (size_t i = 0; i < repeat; i++)
+  {
+    auto start = high_resolution_clock::now();
+    RegionTrace::gc(alloc, nodes[0]);
+    auto end = high_resolution_clock::now();
+
+    double seconds = duration_cast<duration<double>>(end - start).count();
+    if ((i == 0) || (seconds < best))
+      best = seconds;
+  }
+  report("gc", objects, best);
+
+  Region::release(alloc, nodes[0]);
+  snmalloc::current_alloc_pool()->debug_check_empty();
+  return 0;
+}
@@ -0,0 +1,143 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <test/opt.h>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+using namespace std::chrono;
+
+/**
+ * Measures freezing a graph of `--objects` objects, split evenly over
+ * `--regions` regions nested in one root region, with `Freeze::apply` on one
+ * thread, and with `ParallelFreeze::apply` on `--cores` scheduler threads.
+ **/
+struct Node : public V<Node>
+{
+  Node* next = nullptr;
+  Object* child = nullptr;
+
+  void trace(ObjectStack* st) const
+  {
+    if (next != nullptr)
+      st->push(next);
+
+    if (child != nullptr)
+      st->push(child);
+  }
+};
+
+static Node* make_list(Alloc* alloc, size_t length)
+{
+  auto* r = new (alloc) Node;
+  Node* n = r;
+  for (size_t i = 1; i < length; i++)
+  {
+    n->next = new (alloc, r) Node;
+    n = n->next;
+  }
+  return r;
+}
+
+static Node* build(Alloc* alloc, size_t objects, size_t regions)
+{
+  auto* r = make_list(alloc, regions);
+  for (Node* n = r; n != nullptr; n = n->next)
+    n->child = make_list(alloc, objects / regions);
+  return r;
+}
+
+static high_resolution_clock::time_point start;
+static double parallel_seconds;
+
+struct Holder : public VCown<Holder>
+{};
+
+struct Done : public VAction<Done>
+{
+  Node* root;
+
+  Done(Node* root) : root(root) {}
+
+  void trace(ObjectStack* st) const
+  {
+    st->push(root);
+  }
+
+  void f()
+  {
+    auto end = high_resolution_clock::now();
+    parallel_seconds = duration_cast<duration<double>>(end - start).count();
+    Immutable::release(ThreadAlloc::get(), root);
+  }
+};
+
+struct Start : public VAction<Start>
+{
+  Node* root;
+  Cown* holder;
+  size_t threshold;
+
+  Start(Node* root, Cown* holder, size_t threshold)
+  : root(root), holder(holder), threshold(threshold)
+  {}
+
+  void trace(ObjectStack* st) const
+  {
+    st->push(root);
+    st->push(holder);
+  }
+
+  void f()
+  {
+    start = high_resolution_clock::now();
+    ParallelFreeze::apply<Done>(
+      ThreadAlloc::get(), root, threshold, holder, root);
+  }
+};
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t cores = opt.is<size_t>("--cores", 4);
+  size_t objects = opt.is<size_t>("--objects", 10000000);
+  size_t regions = opt.is<size_t>("--regions", 1000);
+  size_t threshold =
+    opt.is<size_t>("--threshold", ParallelFreeze::DEFAULT_THRESHOLD / 4);
+
+  auto* alloc = ThreadAlloc::get();
+
+  {
+    auto* root = build(alloc, objects, regions);
+    auto begin = high_resolution_clock::now();
+    Freeze::apply(alloc, root);
+    auto end = high_resolution_clock::now();
+    double seconds = duration_cast<duration<double>>(end - begin).count();
+    Immutable::release(alloc, root);
+
+    std::cout << "Freeze:         " << std::setw(10) << objects << " objects  "
+              << std::fixed << std::setprecision(3) << seconds << " s"
+              << std::endl;
+  }
+
+  {
+    Scheduler& sched = Scheduler::get();
+    sched.init(cores);
+
+    auto* root = build(alloc, objects, regions);
+    auto* holder = new Holder;
+    Cown::schedule<Start>(holder, root, holder, threshold);
+    Cown::release(alloc, holder);
+    sched.run();
+
+    std::cout << "ParallelFreeze: " << std::setw(10) << objects << " objects  "
+              << std::fixed << std::setprecision(3) << parallel_seconds
+              << " s  (" << cores << " cores)" << std::endl;
+  }
+
+  snmalloc::current_alloc_pool()->debug_check_empty();
+  return 0;
+}
@@ -0,0 +1,110 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <test/opt.h>
+#include <thread>
+#include <vector>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+using namespace std::chrono;
+
+/**
+ * Measures how quickly a paused scheduler thread picks up work, and how much
+ * CPU the runtime uses while it is mostly idle.
+ *
+ * An external thread sends a message every `--interval` microseconds, so the
+ * scheduler threads spend most of their time with nothing to do.  Each
+ * message records the time from being sent to being run.
+ **/
+static std::atomic<uint64_t> total_latency;
+static std::atomic<uint64_t> max_latency;
+
+struct Target : public VCown<Target>
+{};
+
+struct Event : public VAction<Event>
+{
+  Target* target;
+  steady_clock::time_point sent;
+  bool last;
+
+  Event(Target* target, bool last)
+  : target(target), sent(steady_clock::now()), last(last)
+  {}
+
+  void f()
+  {
+    uint64_t ns =
+      (uint64_t)duration_cast<nanoseconds>(steady_clock::now() - sent).count();
+    total_latency += ns;
+
+    uint64_t prev = max_latency;
+    while ((prev < ns) && !max_latency.compare_exchange_weak(prev, ns))
+    {}
+
+    if (last)
+      Cown::release(ThreadAlloc::get(), target);
+  }
+};
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t cores = opt.is<size_t>("--cores", 4);
+  size_t events = opt.is<size_t>("--events", 1000);
+  size_t interval = opt.is<size_t>("--interval", 1000);
+  size_t targets = opt.is<size_t>("--targets", 16);
+  uint64_t pause_slop = opt.is<uint64_t>("--pause_slop", 1'000'000);
+  uint64_t unpause_slop = opt.is<uint64_t>("--unpause_slop", 500'000);
+
+  if (targets > events)
+    targets = events;
+
+  Scheduler& sched = Scheduler::get();
+  sched.init(cores);
+  Scheduler::set_pause_slop(pause_slop, unpause_slop);
+  Scheduler::set_allow_teardown(false);
+
+  std::vector<Target*> cowns(targets);
+  for (auto& c : cowns)
+    c = new Target;
+
+  auto thr = std::thread([&]() {
+    for (size_t i = 0; i < events; i++)
+    {
+      std::this_thread::sleep_for(microseconds(interval));
+      Target* t = cowns[i % targets];
+      Cown::schedule<Event>(t, t, i >= (events - targets));
+    }
+
+    Scheduler::set_allow_teardown(true);
+  });
+
+  auto start = steady_clock::now();
+  std::clock_t cpu_start = std::clock();
+  sched.run();
+  std::clock_t cpu_end = std::clock();
+  auto end = steady_clock::now();
+  thr.join();
+
+  double seconds = duration_cast<duration<double>>(end - start).count();
+  double cpu = (double)(cpu_end - cpu_start) / CLOCKS_PER_SEC;
+
+  std::cout << "Cores: " << cores << "  events: " << events
+            << "  interval: " << interval << "us" << std::endl;
+  std::cout << "Wake up latency: mean " << std::fixed << std::setprecision(1)
+            << ((double)total_latency / (double)events / 1000.0)
+            << "us  max " << ((double)max_latency / 1000.0) << "us"
+            << std::endl;
+  std::cout << "CPU time: " << std::setprecision(3) << cpu << "s over "
+            << seconds << "s (" << std::setprecision(2) << (cpu / seconds)
+            << " cores busy)" << std::endl;
+
+  snmalloc::current_alloc_pool()->debug_check_empty();
+  return 0;
+}
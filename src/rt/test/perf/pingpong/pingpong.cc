@@ -0,0 +1,119 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <test/opt.h>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+using namespace std::chrono;
+
+/**
+ * Measures the latency of passing a message around a ring of cowns, while
+ * other cowns keep the scheduler queues busy.
+ *
+ * Each message wakes up a cown that has gone to sleep, so this exercises the
+ * path where a cown is scheduled by the thread that sent it a message.  With
+ * only two players, a cown is usually still in the queue from its previous
+ * batch when the message comes back, so `--players` should be large enough
+ * for the cowns to go to sleep between messages.
+ **/
+static std::atomic<bool> done;
+
+struct Player : public VCown<Player>
+{
+  Player* next = nullptr;
+
+  void trace(ObjectStack* st) const
+  {
+    if (next != nullptr)
+      st->push(next);
+  }
+};
+
+struct Noise : public VCown<Noise>
+{};
+
+struct Spin : public VAction<Spin>
+{
+  Noise* noise;
+
+  Spin(Noise* noise) : noise(noise) {}
+
+  void f()
+  {
+    volatile size_t x = 0;
+    for (size_t i = 0; i < 100; i++)
+      x = x + i;
+
+    if (!done)
+      Cown::schedule<Spin>(noise, noise);
+  }
+};
+
+struct Ball : public VAction<Ball>
+{
+  Player* self;
+  size_t remaining;
+
+  Ball(Player* self, size_t remaining) : self(self), remaining(remaining) {}
+
+  void f()
+  {
+    if (remaining == 0)
+    {
+      done = true;
+      return;
+    }
+
+    Player* next = self->next;
+    Cown::schedule<Ball>(next, next, remaining - 1);
+  }
+};
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t cores = opt.is<size_t>("--cores", 1);
+  size_t players = opt.is<size_t>("--players", 8);
+  size_t hops = opt.is<size_t>("--hops", 200000);
+  size_t noise = opt.is<size_t>("--noise", 16);
+
+  Scheduler& sched = Scheduler::get();
+  sched.init(cores);
+
+  done = false;
+
+  auto* alloc = ThreadAlloc::get();
+
+  for (size_t i = 0; i < noise; i++)
+  {
+    auto* n = new Noise;
+    Cown::schedule<Spin>(n, n);
+    Cown::release(alloc, n);
+  }
+
+  // The ring owns a reference to each player.
+  std::vector<Player*> ring(players);
+  for (size_t i = 0; i < players; i++)
+    ring[i] = new Player;
+  for (size_t i = 0; i < players; i++)
+    ring[i]->next = ring[(i + 1) % players];
+
+  Cown::schedule<Ball>(ring[0], ring[0], hops);
+
+  auto start = high_resolution_clock::now();
+  sched.run();
+  auto end = high_resolution_clock::now();
+
+  double ns = (double)duration_cast<nanoseconds>(end - start).count();
+  std::cout << "Cores: " << cores << "  players: " << players
+            << "  noise cowns: " << noise << "  latency per hop: " << std::fixed
+            << std::setprecision(0) << (ns / (double)hops) << "ns" << std::endl;
+
+  snmalloc::current_alloc_pool()->debug_check_empty();
+  return 0;
+}
@@ -0,0 +1,90 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <test/opt.h>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+using namespace std::chrono;
+
+/**
+ * Measures the throughput of Cown::schedule for behaviours over 1, 2, 4 and 8
+ * cowns.
+ *
+ * Each behaviour schedules its successor on the same set of cowns, so the
+ * measured cost is dominated by allocating, sending, and freeing behaviours
+ * rather than by the work they do.
+ **/
+static constexpr size_t MAX_COWNS = 8;
+
+struct Counter : public VCown<Counter>
+{};
+
+struct Loop : public VAction<Loop>
+{
+  size_t count;
+  size_t remaining;
+  Cown* cowns[MAX_COWNS];
+
+  Loop(size_t count, Cown** cowns, size_t remaining)
+  : count(count), remaining(remaining)
+  {
+    memcpy(this->cowns, cowns, count * sizeof(Cown*));
+  }
+
+  void f()
+  {
+    if (remaining > 0)
+      Cown::schedule<Loop>(count, cowns, count, cowns, remaining - 1);
+  }
+
+  void trace(ObjectStack* st) const
+  {
+    for (size_t i = 0; i < count; i++)
+      st->push(cowns[i]);
+  }
+};
+
+void test_schedule(size_t cores, size_t count, size_t behaviours)
+{
+  Scheduler& sched = Scheduler::get();
+  sched.init(cores);
+
+  auto* alloc = ThreadAlloc::get();
+  Cown* cowns[MAX_COWNS];
+
+  for (size_t i = 0; i < count; i++)
+    cowns[i] = new Counter;
+
+  Cown::schedule<Loop>(count, cowns, count, cowns, behaviours - 1);
+
+  for (size_t i = 0; i < count; i++)
+    Cown::release(alloc, cowns[i]);
+
+  auto start = high_resolution_clock::now();
+  sched.run();
+  auto end = high_resolution_clock::now();
+
+  double seconds = duration_cast<duration<double>>(end - start).count();
+  std::cout << "Cowns: " << std::setw(2) << count
+            << "  schedules/sec: " << std::setw(12) << std::fixed
+            << std::setprecision(0) << ((double)behaviours / seconds)
+            << std::endl;
+
+  snmalloc::current_alloc_pool()->debug_check_empty();
+}
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t cores = opt.is<size_t>("--cores", 1);
+  size_t behaviours = opt.is<size_t>("--behaviours", 1000000);
+
+  for (size_t count = 1; count <= MAX_COWNS; count <<= 1)
+    test_schedule(cores, count, behaviours);
+
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <test/opt.h>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+using namespace std::chrono;
+
+/**
+ * Measures how quickly work created on a single scheduler thread spreads to
+ * the others.
+ *
+ * One behaviour creates a large number of cowns, and schedules a short piece
+ * of work on each, so they all start out on the queue of the thread running
+ * it while the other threads are idle and must steal.
+ **/
+static std::atomic<size_t> remaining;
+static size_t work;
+
+struct Worker : public VCown<Worker>
+{};
+
+struct Work : public VAction<Work>
+{
+  void f()
+  {
+    volatile size_t x = 0;
+    for (size_t i = 0; i < work; i++)
+      x = x + i;
+
+    remaining--;
+  }
+};
+
+struct Spawn : public VAction<Spawn>
+{
+  size_t count;
+
+  Spawn(size_t count) : count(count) {}
+
+  void f()
+  {
+    auto* alloc = ThreadAlloc::get();
+
+    for (size_t i = 0; i < count; i++)
+    {
+      auto* w = new Worker;
+      Cown::schedule<Work>(w);
+      Cown::release(alloc, w);
+    }
+  }
+};
+
+struct Root : public VCown<Root>
+{};
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t cores = opt.is<size_t>("--cores", 4);
+  size_t cowns = opt.is<size_t>("--cowns", 100000);
+  work = opt.is<size_t>("--work", 1000);
+
+  Scheduler& sched = Scheduler::get();
+  sched.init(cores);
+
+  remaining = cowns;
+
+  auto* alloc = ThreadAlloc::get();
+  auto* root = new Root;
+  Cown::schedule<Spawn>(root, cowns);
+  Cown::release(alloc, root);
+
+  auto start = high_resolution_clock::now();
+  sched.run();
+  auto end = high_resolution_clock::now();
+
+  if (remaining != 0)
+  {
+    std::cout << "Not all work was run: " << remaining << std::endl;
+    return 1;
+  }
+
+  double seconds = duration_cast<duration<double>>(end - start).count();
+  std::cout << "Cores: " << cores << "  cowns: " << cowns
+            << "  time: " << std::fixed << std::setprecision(3) << seconds
+            << "s  cowns/sec: " << std::setprecision(0)
+            << ((double)cowns / seconds) << std::endl;
+
+  snmalloc::current_alloc_pool()->debug_check_empty();
+  return 0;
+}
@@ -0,0 +1,156 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <test/opt.h>
+#include <vector>
+#include <verona.h>
+
+using namespace snmalloc;
+using namespace verona::rt;
+using namespace std::chrono;
+
+/**
+ * Measures how long the scheduler loop stalls while the leak detector sweeps
+ * a large number of long lived cowns.
+ *
+ * A holder cown keeps a tree of `--cowns` cowns alive, while a heartbeat behaviour
+ * repeatedly reschedules itself, asks for leak detection every so often, and
+ * records the longest gap between two consecutive beats.  Build with
+ * USE_SCHED_STATS for histograms of the time taken by each sweep step.
+ **/
+/**
+ * The long lived cowns form a tree, so that none of them needs a container
+ * that is torn down by the finaliser before it is traced.
+ **/
+struct Node : public VCown<Node>
+{
+  static constexpr size_t FANOUT = 8;
+  Node* kids[FANOUT] = {};
+
+  void trace(ObjectStack* st) const
+  {
+    for (auto k : kids)
+    {
+      if (k != nullptr)
+        st->push(k);
+    }
+  }
+};
+
+// Builds a tree of `count` nodes, and returns its root.
+static Node* build(size_t count)
+{
+  auto* n = new Node;
+  count--;
+
+  for (size_t i = 0; (i < Node::FANOUT) && (count > 0); i++)
+  {
+    size_t share = (count + Node::FANOUT - 1 - i) / (Node::FANOUT - i);
+    n->kids[i] = build(share);
+    count -= share;
+  }
+
+  return n;
+}
+
+struct Holder : public VCown<Holder>
+{
+  Node* root = nullptr;
+
+  void trace(ObjectStack* st) const
+  {
+    if (root != nullptr)
+      st->push(root);
+  }
+};
+
+struct Fill : public VAction<Fill>
+{
+  Holder* holder;
+  size_t count;
+
+  Fill(Holder* holder, size_t count) : holder(holder), count(count) {}
+
+  void f()
+  {
+    // Allocated on a scheduler thread, so these are on its list of cowns.
+    holder->root = build(count);
+  }
+};
+
+struct Heart : public VCown<Heart>
+{
+  // Keeps the holder, and so every child, alive for as long as there are
+  // beats left.
+  Holder* holder;
+
+  Heart(Holder* holder) : holder(holder) {}
+
+  void trace(ObjectStack* st) const
+  {
+    st->push(holder);
+  }
+};
+
+static size_t ld_every;
+static steady_clock::time_point last_beat;
+static uint64_t max_gap_ns = 0;
+
+struct Beat : public VAction<Beat>
+{
+  Heart* heart;
+  size_t remaining;
+
+  Beat(Heart* heart, size_t remaining) : heart(heart), remaining(remaining) {}
+
+  void f()
+  {
+    auto now = steady_clock::now();
+    uint64_t gap = (uint64_t)duration_cast<nanoseconds>(now - last_beat).count();
+    if (gap > max_gap_ns)
+      max_gap_ns = gap;
+    last_beat = now;
+
+    if ((remaining % ld_every) == 0)
+      Scheduler::want_ld();
+
+    if (remaining > 0)
+      Cown::schedule<Beat>(heart, heart, remaining - 1);
+  }
+};
+
+int main(int argc, char** argv)
+{
+  opt::Opt opt(argc, argv);
+  size_t cores = opt.is<size_t>("--cores", 2);
+  size_t cowns = opt.is<size_t>("--cowns", 1000000);
+  size_t beats = opt.is<size_t>("--beats", 100000);
+  ld_every = opt.is<size_t>("--ld_every", 10000);
+
+  Scheduler& sched = Scheduler::get();
+  sched.init(cores);
+
+  auto* alloc = ThreadAlloc::get();
+  auto* holder = new Holder;
+  Cown::schedule<Fill>(holder, holder, cowns);
+
+  auto* heart = new Heart(holder);
+  last_beat = steady_clock::now();
+  Cown::schedule<Beat>(heart, heart, beats);
+  Cown::release(alloc, heart);
+
+  auto start = steady_clock::now();
+  sched.run();
+  auto end = steady_clock::now();
+
+  double seconds = duration_cast<duration<double>>(end - start).count();
+  std::cout << "Cores: " << cores << "  cowns: " << cowns
+            << "  beats: " << beats << "  time: " << std::fixed
+            << std::setprecision(3) << seconds << "s  longest gap: "
+            << std::setprecision(1) << ((double)max_gap_ns / 1000.0) << "us"
+            << std::endl;
+
+  return 0;
+}
@@ -15,9 +15,11 @@
 #include "region/immutable.h"
 #include "region/region.h"
 #include "sched/cown.h"
+#include "sched/deferredrc.h"
 #include "sched/epoch.h"
 #include "sched/multimessage.h"
 #include "sched/noticeboard.h"
+#include "sched/parallelfreeze.h"
 #include "sched/schedulerthread.h"
 #include "sched/spmcq.h"
 #include "test/systematic.h"
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+
+import os
+import os.path
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+FILE_EXTENSION = '.verona'
+REPEAT = 3
+
+# Lines printed by the interpreter when run with --stats.
+STATS = re.compile(
+  r'Executed (\d+) instructions in ([0-9.]+)s \(([0-9.]+)M instructions/s\)')
+ALLOCATIONS = re.compile(r'Made (\d+) heap allocations')
+
+class Runner:
+  def __init__(self, compiler, interpreter):
+    self.compiler = compiler
+    self.interpreter = interpreter
+    self.has_error = False
+    self.results = []
+
+  def log(self, *args):
+    print(*args, file=sys.stderr)
+
+  def error(self, *args):
+    self.log(*args)
+    self.has_error = True
+
+  def compile(self, source, bytecode):
+    cmd = [self.compiler, source, "--output=%s" % bytecode]
+    self.log("Running %r" % " ".join(cmd))
+    ret = subprocess.call(cmd)
+    if ret != 0:
+      self.error("Compiler exited with status %d" % ret)
+      return False
+    else:
+      return True
+
+  def run(self, bytecode):
+    cmd = [self.interpreter, "--cores=1", "--stats", bytecode]
+    result = subprocess.run(
+      cmd,
+      stdout=subprocess.DEVNULL,
+      stderr=subprocess.PIPE,
+      universal_newlines=True)
+    if result.returncode != 0:
+      self.error("Interpreter exited with status %d" % result.returncode)
+      return None
+
+    match = STATS.search(result.stderr)
+    if match is None:
+      self.error("Interpreter did not report its statistics")
+      return None
+
+    # Allocations are only counted if the interpreter was built with
+    # USE_ALLOCATION_STATS.
+    allocations = ALLOCATIONS.search(result.stderr)
+    if allocations is not None:
+      allocations = int(allocations.group(1))
+
+    return (int(match.group(1)), float(match.group(2)), allocations)
+
+  def benchmark(self, source):
+    name, _ = os.path.splitext(os.path.basename(source))
+    build_dir = tempfile.mkdtemp()
+
+    try:
+      bytecode = os.path.join(build_dir, name + ".vbc")
+      if not self.compile(source, bytecode):
+        return
+
+      best = None
+      for _ in range(REPEAT):
+        result = self.run(bytecode)
+        if result is None:
+          return
+        if best is None or result[1] < best[1]:
+          best = result
+
+      self.results.append((name,) + best)
+    finally:
+      shutil.rmtree(build_dir)
+
+  def benchmark_dir(self, dirpath):
+    for root, _, filenames in os.walk(dirpath):
+      for filename in sorted(filenames):
+        filepath = os.path.join(root, filename)
+        _, extension = os.path.splitext(filepath)
+        if extension == FILE_EXTENSION:
+          self.benchmark(filepath)
+
+  def report(self):
+    print("%-20s %14s %10s %16s %16s" %
+          ("benchmark", "instructions", "time (s)", "M instructions/s",
+           "allocs/instr"))
+    for name, instructions, seconds, allocations in self.results:
+      rate = instructions / seconds / 1e6 if seconds > 0 else 0
+      if allocations is None:
+        per_instruction = "-"
+      elif instructions > 0:
+        per_instruction = "%.4f" % (allocations / instructions)
+      else:
+        per_instruction = "%.4f" % 0
+      print("%-20s %14d %10.3f %16.2f %16s" %
+            (name, instructions, seconds, rate, per_instruction))
+
+if len(sys.argv) < 4:
+  print("Usage: %s VERONAC INTERPRETER FILES..." % sys.argv[0],
+        file=sys.stderr)
+  sys.exit(1)
+
+runner = Runner(sys.argv[1], sys.argv[2])
+
+for path in sys.argv[3:]:
+  if os.path.isdir(path):
+    runner.benchmark_dir(path)
+  else:
+    runner.benchmark(path)
+
+runner.report()
+
+if runner.has_error:
+  sys.exit(1)